@@ -38,11 +38,17 @@ either expressed or implied, of copyright holders.
 
 #include <opencv2/core.hpp>
 
+#include <cstdint>
+
 namespace objed
 {
   class ImagePool
   {
   public:
+    // Images and integrals may be recomputed lazily, so the classifiers bound to the pool
+    // must be prepared again after each update. Headers returned by image() and integral()
+    // stay valid for the life of the pool, but have no data from an update until they are
+    // requested again: classifiers evaluated on such headers assert and return false
     virtual bool update(IplImage *image) = 0;
     virtual IplImage * integral(const std::string &id) = 0;
     virtual IplImage * image(const std::string &id) = 0;
@@ -75,6 +81,7 @@ namespace objed
     virtual int height() const = 0;
     virtual bool prepare(ImagePool *imagePool) = 0;
     virtual bool evaluate(float *result, int x, int y, DebugInfo *debugInfo = 0) const = 0;
+    virtual bool evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
     virtual Json::Value serialize() const = 0;
     virtual std::string type() const = 0;
     virtual Classifier * clone() const = 0;
@@ -92,6 +99,43 @@ namespace objed
     static void destroy(Classifier *&classifier);
   };
 
+  // Mutable state of detection: classifiers bound to image pools, pyramid buffers and raw
+  // detections. A context is used by one thread at a time, while the detector it was created
+  // by is only read by detectInContext(context, image), so any number of threads share one detector
+  class DetectionContext
+  {
+  public:
+    virtual ~DetectionContext() {};
+
+  public:
+    static void destroy(DetectionContext *&context);
+  };
+
+  // Limits of one detection, zero means no limit. Detectors supporting budgets scan the most 
+  // promising windows first and return the detections found so far when the budget runs out
+  class DetectionBudget
+  {
+  public:
+    DetectionBudget() : milliseconds(0), windowCount(0) {};
+    DetectionBudget(double milliseconds, long long windowCount) : milliseconds(milliseconds), windowCount(windowCount) {};
+
+  public:
+    double milliseconds;
+    long long windowCount;
+  };
+
+  // Windows scanned by the last detection out of all windows of its search space
+  // (both are zero for detectors that don't report coverage)
+  class DetectionCoverage
+  {
+  public:
+    DetectionCoverage() : scannedWindowCount(0), totalWindowCount(0) {};
+
+  public:
+    long long scannedWindowCount;
+    long long totalWindowCount;
+  };
+
   class Detector
   {
   public:
@@ -102,6 +146,11 @@ namespace objed
 
   public:
     virtual DetectionList detect(IplImage *image, DebugInfo *debugInfo = 0) = 0;
+    virtual DetectionList detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo = 0) const;
+    virtual DetectionContext * createContext(ImagePool *extImagePool = 0) const;
+
+    virtual void setBudget(const DetectionBudget &budget);
+    virtual DetectionCoverage coverage(const DetectionContext *context = 0) const;
     
     virtual std::string type() const = 0;
     virtual Detector * clone() const = 0;
@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef OBJEDPROFILE_H_INCLUDED
+#define OBJEDPROFILE_H_INCLUDED
+
+#include <chrono>
+
+namespace objed
+{
+  // Wall-clock time spent in the stages of Detector::detect(). Profiling is off unless
+  // a profile is installed for the calling thread with setCurrent(). Stage times are exclusive:
+  // a stage started within another one pauses it, so every moment is counted once
+  class StageProfile
+  {
+  public:
+    enum Stage
+    {
+      STAGE_RESIZE = 0,
+      STAGE_UPDATE,
+      STAGE_SCAN,
+      STAGE_CLUSTER,
+      STAGE_MERGE,
+      STAGE_COUNT
+    };
+
+  public:
+    StageProfile();
+    void reset();
+
+  public:
+    double seconds[STAGE_COUNT];
+    long long windowCount;
+
+  public:
+    static StageProfile * current();
+    static void setCurrent(StageProfile *profile);
+    static void addWindows(long long count);
+    static const char * stageName(int stage);
+  };
+
+  // Adds the time from its construction until stop() (or destruction) to the stage of the current 
+  // profile, except the time of timers started meanwhile on the same thread. Timers of a thread 
+  // are stopped in the reverse order of their construction
+  class StageTimer
+  {
+  public:
+    StageTimer(StageProfile::Stage stage);
+    ~StageTimer();
+
+  private:
+    StageTimer(const StageTimer &);
+    StageTimer &operator=(const StageTimer &);
+
+  public:
+    void stop();
+
+  private:
+    StageProfile *profile;
+    StageProfile::Stage stage;
+    std::chrono::steady_clock::time_point start;
+    StageTimer *parent;
+  };
+
+  // Scope of a worker thread of a parallel stage: windows counted by the worker are added to the
+  // profile of the thread which started the stage when the scope ends. Timers of the worker are 
+  // not counted, their time is covered by the timers of that thread. On the thread owning the 
+  // profile the scope does nothing
+  class StageWorkerScope
+  {
+  public:
+    StageWorkerScope(StageProfile *profile);
+    ~StageWorkerScope();
+
+  private:
+    StageWorkerScope(const StageWorkerScope &);
+    StageWorkerScope &operator=(const StageWorkerScope &);
+
+  private:
+    StageProfile *profile;
+    StageProfile *previous;
+    bool isPreviousWorker;
+    StageProfile workerProfile;
+  };
+}
+
+#endif  // OBJEDPROFILE_H_INCLUDED
@@ -38,6 +38,7 @@ either expressed or implied, of copyright holders.
 
 #include <cassert>
 #include <cstdio>
+#include <cstddef>
 
 #include <opencv/cv.h>
 
@@ -60,10 +61,10 @@ namespace objed
     assert(x < integral->width && x + width < integral->width);
     assert(y < integral->height && y + height < integral->height);
 
-    const int *line1 = (int *)(integral->imageData + y * integral->widthStep);
-    const int *line2 = (int *)(integral->imageData + (y + height) * integral->widthStep);
+    const unsigned int *line1 = (unsigned int *)(integral->imageData + static_cast<ptrdiff_t>(y) * integral->widthStep);
+    const unsigned int *line2 = (unsigned int *)(integral->imageData + static_cast<ptrdiff_t>(y + height) * integral->widthStep);
 
-    return line2[x + width] - line1[x + width] - line2[x] + line1[x];
+    return static_cast<int>(line2[x + width] - line1[x + width] - line2[x] + line1[x]);
   }
 
   inline int rectAver(const IplImage *integral, int x, int y, int width, int height)
@@ -72,6 +73,32 @@ namespace objed
     return rectSum(integral, x, y, width, height) / (width * height);
   }
 
+  // Corner offsets (in ints) of the rect relative to the integral element at (0, 0)
+  inline void rectOffsets(int *offsets, const IplImage *integral, int x, int y, int width, int height)
+  {
+    assert(width > 0 && height > 0);
+    assert(integral->widthStep % sizeof(int) == 0);
+
+    const int step = integral->widthStep / sizeof(int);
+    offsets[0] = y * step + x;
+    offsets[1] = y * step + x + width;
+    offsets[2] = (y + height) * step + x;
+    offsets[3] = (y + height) * step + x + width;
+  }
+
+  inline const int * integralOrigin(const IplImage *integral, int x, int y)
+  {
+    return reinterpret_cast<const int *>(integral->imageData + static_cast<ptrdiff_t>(y) * integral->widthStep) + x;
+  }
+
+  // Integrals wrap around (see PrepareIntegralImage), so the corners are combined modulo 2^32:
+  // the sum is exact for any rect whose true sum fits int, whatever the size of the image
+  inline int rectSum(const int *origin, const int *offsets)
+  {
+    const unsigned int *corners = reinterpret_cast<const unsigned int *>(origin);
+    return static_cast<int>(corners[offsets[3]] - corners[offsets[1]] - corners[offsets[2]] + corners[offsets[0]]);
+  }
+
   template<class T> static inline Point<T> center(const Rect<T> &rect)
   {
     return Point<T>(rect.x + rect.width / 2, rect.y + rect.height / 2);
@@ -93,10 +120,18 @@ namespace objed
     return (width <= 0 || height <= 0) ? Rect<T>() : Rect<T>(x, y, width, height);
   }
 
+  // Greedy clustering: each rect joins the latest created cluster whose intersection with it is larger
+  // than overlap of the larger area of the two, or starts a new cluster. Only neighbor clusters are 
+  // compared, but the result is exactly the same as of comparing every rect with all clusters
   template<class T> std::vector<Cluster<T> > cluster(const std::vector<Rect<T> > &rectList, double overlap);
 
   template<class T> std::vector<Cluster<T> > cluster(const std::vector<Cluster<T> > &clusterList, double overlap);
 
+  // Clusters horizontal strips of the rects in threadCount threads, then clusters again the clusters 
+  // near strip borders. Results differ slightly from cluster(), whose order of merging is global
+  template<class T> std::vector<Cluster<T> > clusterParallel(const std::vector<Rect<T> > &rectList, 
+    double overlap, int threadCount);
+
   template<class T> std::vector<Cluster<T> > mergeIncluded(const std::vector<Cluster<T> > &clusterList);
 }
 
@@ -30,7 +30,9 @@ either expressed or implied, of copyright holders.
 */
 
 #include "additivecl.h"
+#include "batchutils.h"
 
+#include <algorithm>
 #include <cassert>
 
 #define INCREASE_DBG_OUPUT_LEVEL \
@@ -120,6 +122,39 @@ bool objed::AdditiveClassifier::evaluate(float *result, int x, int y, DebugInfo
   return ok;
 }
 
+bool objed::AdditiveClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  bool ok = true;
+  float clResults[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+    float *totalResults = results + i;
+    uint8_t *chunkAlive = alive + i;
+
+    for (int j = 0; j < count; j++)
+    {
+      if (chunkAlive[j] != 0)
+        totalResults[j] = 0.0;
+    }
+
+    for (size_t k = 0; k < clList.size(); k++)
+    {
+      assert(clList[k] != 0);
+      ok &= clList[k]->evaluateBatch(xs + i, ys + i, count, clResults, chunkAlive);
+
+      for (int j = 0; j < count; j++)
+      {
+        if (chunkAlive[j] != 0)
+          totalResults[j] += clResults[j];
+      }
+    }
+  }
+
+  return ok;
+}
+
 Json::Value objed::AdditiveClassifier::serialize() const
 {
   Json::Value data;
@@ -0,0 +1,357 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include "batchutils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#if defined(OBJED_WITH_AVX2) || defined(__AVX2__)
+#  define OBJED_BATCH_AVX2
+#  include <immintrin.h>
+#elif defined(OBJED_WITH_SSE41) || defined(__SSE4_1__)
+#  define OBJED_BATCH_SSE41
+#  include <smmintrin.h>
+#endif
+
+// Must give the same value as Haar?StumpClassifier::compute for the same sums
+static inline int haarValue(const int *sums, const int *areas, int rectCount, bool normalize)
+{
+  if (rectCount == 1)
+    return sums[0] / areas[0];
+
+  if (normalize == true)
+  {
+    int positive = rectCount == 3 ? sums[0] + sums[2] : sums[0];
+    int total = rectCount == 3 ? sums[0] + sums[1] + sums[2] : sums[0] + sums[1];
+    return 255 * positive / (total + 1);
+  }
+
+  int value = sums[0] / areas[0] - sums[1] / areas[1] + 255;
+  if (rectCount == 3)
+    value += sums[2] / areas[2];
+  return value / rectCount;
+}
+
+static void haarScalar(int *values, const IplImage *integral, const int *offsets, const int *areas,
+  int rectCount, bool normalize, const int *xs, const int *ys, int n)
+{
+  int sums[3] = {0};
+  for (int i = 0; i < n; i++)
+  {
+    const int *origin = objed::integralOrigin(integral, xs[i], ys[i]);
+    for (int r = 0; r < rectCount; r++)
+      sums[r] = objed::rectSum(origin, offsets + 4 * r);
+    values[i] = haarValue(sums, areas, rectCount, normalize);
+  }
+}
+
+#if defined(OBJED_BATCH_AVX2)
+
+// Exact truncating int32 division: quotients of |a|, |b| < 2^31 are correctly
+// rounded in double precision, so truncation gives the integer result
+static inline __m256i divide(__m256i a, __m256i b)
+{
+  __m256d lo = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a)),
+    _mm256_cvtepi32_pd(_mm256_castsi256_si128(b)));
+  __m256d hi = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a, 1)),
+    _mm256_cvtepi32_pd(_mm256_extracti128_si256(b, 1)));
+  return _mm256_insertf128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lo)), _mm256_cvttpd_epi32(hi), 1);
+}
+
+static inline __m256i gatherSum(const int *base, __m256i origin, const int *offsets)
+{
+  __m256i p0 = _mm256_i32gather_epi32(base, _mm256_add_epi32(origin, _mm256_set1_epi32(offsets[0])), 4);
+  __m256i p1 = _mm256_i32gather_epi32(base, _mm256_add_epi32(origin, _mm256_set1_epi32(offsets[1])), 4);
+  __m256i p2 = _mm256_i32gather_epi32(base, _mm256_add_epi32(origin, _mm256_set1_epi32(offsets[2])), 4);
+  __m256i p3 = _mm256_i32gather_epi32(base, _mm256_add_epi32(origin, _mm256_set1_epi32(offsets[3])), 4);
+  return _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(p3, p1), p2), p0);
+}
+
+static inline __m256i aliveMask(const uint8_t *alive)
+{
+  __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(alive));
+  return _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(bytes), _mm256_setzero_si256());
+}
+
+void objed::haarBatch(int *values, const IplImage *integral, const int *offsets, const int *areas,
+  int rectCount, bool normalize, const int *xs, const int *ys, int n)
+{
+  assert(rectCount >= 1 && rectCount <= 3);
+  assert(integral->widthStep % sizeof(int) == 0);
+
+  const int *base = reinterpret_cast<const int *>(integral->imageData);
+  const __m256i step = _mm256_set1_epi32(integral->widthStep / sizeof(int));
+  const __m256i bias = _mm256_set1_epi32(255), one = _mm256_set1_epi32(1);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xs + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ys + i));
+    __m256i origin = _mm256_add_epi32(_mm256_mullo_epi32(y, step), x);
+
+    __m256i sum0 = gatherSum(base, origin, offsets);
+    __m256i value;
+
+    if (rectCount == 1)
+    {
+      value = divide(sum0, _mm256_set1_epi32(areas[0]));
+    }
+    else
+    {
+      __m256i sum1 = gatherSum(base, origin, offsets + 4);
+      __m256i sum2 = rectCount == 3 ? gatherSum(base, origin, offsets + 8) : _mm256_setzero_si256();
+
+      if (normalize == true)
+      {
+        __m256i positive = _mm256_add_epi32(sum0, sum2);
+        __m256i total = _mm256_add_epi32(_mm256_add_epi32(positive, sum1), one);
+        value = divide(_mm256_mullo_epi32(positive, bias), total);
+      }
+      else
+      {
+        value = _mm256_sub_epi32(divide(sum0, _mm256_set1_epi32(areas[0])), divide(sum1, _mm256_set1_epi32(areas[1])));
+        if (rectCount == 3)
+          value = _mm256_add_epi32(value, divide(sum2, _mm256_set1_epi32(areas[2])));
+        value = divide(_mm256_add_epi32(value, bias), _mm256_set1_epi32(rectCount));
+      }
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(values + i), value);
+  }
+
+  haarScalar(values + i, integral, offsets, areas, rectCount, normalize, xs + i, ys + i, n - i);
+}
+
+void objed::stumpBatch(float *results, const uint8_t *alive, const int *values,
+  int threshold, const float *leafs, int n)
+{
+  const __m256i thr = _mm256_set1_epi32(threshold);
+  const __m256 leaf0 = _mm256_set1_ps(leafs[0]), leaf1 = _mm256_set1_ps(leafs[1]);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+    __m256 greater = _mm256_castsi256_ps(_mm256_cmpgt_epi32(value, thr));
+    _mm256_maskstore_ps(results + i, aliveMask(alive + i), _mm256_blendv_ps(leaf1, leaf0, greater));
+  }
+
+  for (; i < n; i++)
+  {
+    if (alive[i] != 0)
+      results[i] = values[i] > threshold ? leafs[0] : leafs[1];
+  }
+}
+
+void objed::pwBatch(float *results, const uint8_t *alive, const int *values,
+  const float *bins, int binCount, int n)
+{
+  const __m256i count = _mm256_set1_epi32(binCount);
+  const __m256i last = _mm256_set1_epi32(binCount - 1);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+    __m256i index = _mm256_min_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(value, count), 8), last);
+    _mm256_maskstore_ps(results + i, aliveMask(alive + i), _mm256_i32gather_ps(bins, index, 4));
+  }
+
+  for (; i < n; i++)
+  {
+    if (alive[i] != 0)
+      results[i] = bins[values[i] * binCount / 256];
+  }
+}
+
+#elif defined(OBJED_BATCH_SSE41)
+
+// Exact truncating int32 division (see the AVX2 version)
+static inline __m128i divide(__m128i a, __m128i b)
+{
+  __m128d lo = _mm_div_pd(_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(b));
+  __m128d hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(a, a)), _mm_cvtepi32_pd(_mm_unpackhi_epi64(b, b)));
+  return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+static inline __m128i gather(const int *base, const int *origin, int offset)
+{
+  return _mm_setr_epi32(base[origin[0] + offset], base[origin[1] + offset],
+    base[origin[2] + offset], base[origin[3] + offset]);
+}
+
+static inline __m128i gatherSum(const int *base, const int *origin, const int *offsets)
+{
+  __m128i p0 = gather(base, origin, offsets[0]), p1 = gather(base, origin, offsets[1]);
+  __m128i p2 = gather(base, origin, offsets[2]), p3 = gather(base, origin, offsets[3]);
+  return _mm_add_epi32(_mm_sub_epi32(_mm_sub_epi32(p3, p1), p2), p0);
+}
+
+static inline __m128i aliveMask(const uint8_t *alive)
+{
+  int packed = 0;
+  memcpy(&packed, alive, sizeof(packed));
+  __m128i bytes = _mm_cvtsi32_si128(packed);
+  return _mm_cmpgt_epi32(_mm_cvtepu8_epi32(bytes), _mm_setzero_si128());
+}
+
+void objed::haarBatch(int *values, const IplImage *integral, const int *offsets, const int *areas,
+  int rectCount, bool normalize, const int *xs, const int *ys, int n)
+{
+  assert(rectCount >= 1 && rectCount <= 3);
+  assert(integral->widthStep % sizeof(int) == 0);
+
+  const int *base = reinterpret_cast<const int *>(integral->imageData);
+  const __m128i step = _mm_set1_epi32(integral->widthStep / sizeof(int));
+  const __m128i bias = _mm_set1_epi32(255), one = _mm_set1_epi32(1);
+
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xs + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ys + i));
+
+    int origin[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(origin), _mm_add_epi32(_mm_mullo_epi32(y, step), x));
+
+    __m128i sum0 = gatherSum(base, origin, offsets);
+    __m128i value;
+
+    if (rectCount == 1)
+    {
+      value = divide(sum0, _mm_set1_epi32(areas[0]));
+    }
+    else
+    {
+      __m128i sum1 = gatherSum(base, origin, offsets + 4);
+      __m128i sum2 = rectCount == 3 ? gatherSum(base, origin, offsets + 8) : _mm_setzero_si128();
+
+      if (normalize == true)
+      {
+        __m128i positive = _mm_add_epi32(sum0, sum2);
+        __m128i total = _mm_add_epi32(_mm_add_epi32(positive, sum1), one);
+        value = divide(_mm_mullo_epi32(positive, bias), total);
+      }
+      else
+      {
+        value = _mm_sub_epi32(divide(sum0, _mm_set1_epi32(areas[0])), divide(sum1, _mm_set1_epi32(areas[1])));
+        if (rectCount == 3)
+          value = _mm_add_epi32(value, divide(sum2, _mm_set1_epi32(areas[2])));
+        value = divide(_mm_add_epi32(value, bias), _mm_set1_epi32(rectCount));
+      }
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), value);
+  }
+
+  haarScalar(values + i, integral, offsets, areas, rectCount, normalize, xs + i, ys + i, n - i);
+}
+
+void objed::stumpBatch(float *results, const uint8_t *alive, const int *values,
+  int threshold, const float *leafs, int n)
+{
+  const __m128i thr = _mm_set1_epi32(threshold);
+  const __m128 leaf0 = _mm_set1_ps(leafs[0]), leaf1 = _mm_set1_ps(leafs[1]);
+
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+    __m128 result = _mm_blendv_ps(leaf1, leaf0, _mm_castsi128_ps(_mm_cmpgt_epi32(value, thr)));
+
+    // Dead lanes may hold uninitialized results, so they are neither read nor written
+    const int mask = _mm_movemask_ps(_mm_castsi128_ps(aliveMask(alive + i)));
+    if (mask == 0xF)
+    {
+      _mm_storeu_ps(results + i, result);
+    }
+    else if (mask != 0)
+    {
+      float lanes[4];
+      _mm_storeu_ps(lanes, result);
+      for (int k = 0; k < 4; k++)
+      {
+        if (mask & (1 << k))
+          results[i + k] = lanes[k];
+      }
+    }
+  }
+
+  for (; i < n; i++)
+  {
+    if (alive[i] != 0)
+      results[i] = values[i] > threshold ? leafs[0] : leafs[1];
+  }
+}
+
+void objed::pwBatch(float *results, const uint8_t *alive, const int *values,
+  const float *bins, int binCount, int n)
+{
+  for (int i = 0; i < n; i++)
+  {
+    if (alive[i] != 0)
+      results[i] = bins[values[i] * binCount / 256];
+  }
+}
+
+#else
+
+void objed::haarBatch(int *values, const IplImage *integral, const int *offsets, const int *areas,
+  int rectCount, bool normalize, const int *xs, const int *ys, int n)
+{
+  assert(rectCount >= 1 && rectCount <= 3);
+  haarScalar(values, integral, offsets, areas, rectCount, normalize, xs, ys, n);
+}
+
+void objed::stumpBatch(float *results, const uint8_t *alive, const int *values,
+  int threshold, const float *leafs, int n)
+{
+  for (int i = 0; i < n; i++)
+  {
+    if (alive[i] != 0)
+      results[i] = values[i] > threshold ? leafs[0] : leafs[1];
+  }
+}
+
+void objed::pwBatch(float *results, const uint8_t *alive, const int *values,
+  const float *bins, int binCount, int n)
+{
+  for (int i = 0; i < n; i++)
+  {
+    if (alive[i] != 0)
+      results[i] = bins[values[i] * binCount / 256];
+  }
+}
+
+#endif
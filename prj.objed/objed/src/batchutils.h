@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef BATCHUTILS_H_INCLUDED
+#define BATCHUTILS_H_INCLUDED
+
+#include <objed/objed.h>
+#include <objed/objedutils.h>
+
+namespace objed
+{
+  // Maximum number of windows kept on stack by the batch evaluation
+  const int BATCH_CHUNK_SIZE = 256;
+
+  // Haar feature values of n windows (see Haar?StumpClassifier::compute). Offsets and
+  // areas describe rectCount rects; xs and ys of every lane must be valid window centers.
+  void haarBatch(int *values, const IplImage *integral, const int *offsets, const int *areas,
+    int rectCount, bool normalize, const int *xs, const int *ys, int n);
+
+  // Stump responses for alive lanes: values[i] > threshold ? leafs[0] : leafs[1].
+  // Results of dead lanes are neither read nor written.
+  void stumpBatch(float *results, const uint8_t *alive, const int *values,
+    int threshold, const float *leafs, int n);
+
+  // Piecewise responses for alive lanes: bins[values[i] * binCount / 256].
+  // Results of dead lanes are neither read nor written.
+  void pwBatch(float *results, const uint8_t *alive, const int *values,
+    const float *bins, int binCount, int n);
+}
+
+#endif  // BATCHUTILS_H_INCLUDED
@@ -0,0 +1,1162 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include "binarycl.h"
+#include "batchutils.h"
+
+#include "maxcl.h"
+#include "linearcl.h"
+#include "additivecl.h"
+#include "cascadecl.h"
+#include "treecl.h"
+#include "haar1stumpcl.h"
+#include "haar2stumpcl.h"
+#include "haar3stumpcl.h"
+#include "haar1pwcl.h"
+#include "haar2pwcl.h"
+#include "haar3pwcl.h"
+
+#include <objed/objedutils.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#if defined _MSC_VER
+#  undef NOMINMAX
+#  define NOMINMAX
+#  include <windows.h>
+#else  // _MSC_VER
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif // _MSC_VER
+
+// Layout of .objedb files (version 1, native byte order). All sections start at 8-byte 
+// aligned offsets and nodes refer to their children by index, so the file is evaluated 
+// in place. Node 0 is the root and children always follow their parent.
+//
+//   BinaryHeader
+//   BinaryNode[nodeCount]       cascade and max: links [first, first + count) of children
+//                               tree: links first, first + 1, first + 2 of central, left and
+//                               right classifiers (-1 if absent)
+//                               additive, linear and wc: wcs [first, first + count)
+//   int32_t[linkCount]          node indices
+//   BinaryWc[wcCount]           Haar weak classifiers
+//   float[binCount]             bins of piecewise weak classifiers
+//   BinaryChannel[channelCount] preproc names of the integral images
+
+static const char BINARY_MAGIC[8] = {'O', 'B', 'J', 'E', 'D', 'B', 'I', 'N'};
+static const uint32_t BINARY_BYTE_ORDER = 0x01020304;
+static const uint32_t BINARY_VERSION = 1;
+static const int CHANNEL_NAME_SIZE = 64;
+
+enum BinaryNodeType { NODE_CASCADE = 1, NODE_TREE = 2, NODE_MAX = 3, NODE_ADDITIVE = 4, NODE_LINEAR = 5, NODE_WC = 6 };
+enum BinaryWcKind { WC_HAAR1 = 1, WC_HAAR2 = 2, WC_HAAR3 = 3, WC_RECT_MASK = 3, WC_NORMALIZE = 4, WC_PW = 8 };
+
+struct BinaryHeader
+{
+  char magic[8];
+  uint32_t byteOrder;
+  uint32_t version;
+  uint32_t fileSize;
+  uint32_t nodeCount, nodeOffset;
+  uint32_t linkCount, linkOffset;
+  uint32_t wcCount, wcOffset;
+  uint32_t binCount, binOffset;
+  uint32_t channelCount, channelOffset;
+  uint32_t reserved;
+};
+
+struct BinaryNode
+{
+  int32_t type;
+  int32_t width, height;
+  int32_t first, count;
+};
+
+struct BinaryWc
+{
+  int32_t kind;
+  int32_t channel;
+  int32_t width, height;
+  int32_t threshold;
+  int32_t binBegin, binCount;
+  int32_t rects[12];
+  int32_t areas[3];
+  float values[2];
+  float alpha;
+};
+
+struct BinaryChannel
+{
+  char name[CHANNEL_NAME_SIZE];
+};
+
+struct objed::BinaryModel
+{
+  BinaryModel();
+  ~BinaryModel();
+
+  bool map(const std::string &path);
+  void attach(std::vector<uint64_t> &modelData);
+  bool validate();
+
+  const char *data;
+  size_t size;
+  bool mapped;
+  std::vector<uint64_t> buffer;
+
+  const BinaryHeader *header;
+  const BinaryNode *nodes;
+  const int32_t *links;
+  const BinaryWc *wcs;
+  const float *bins;
+  std::vector<std::string> channelNames;
+
+#if defined _MSC_VER
+  HANDLE file, mapping;
+#endif // _MSC_VER
+};
+
+objed::BinaryModel::BinaryModel() :
+data(0), size(0), mapped(false), header(0), nodes(0), links(0), wcs(0), bins(0)
+{
+#if defined _MSC_VER
+  file = INVALID_HANDLE_VALUE;
+  mapping = 0;
+#endif // _MSC_VER
+}
+
+objed::BinaryModel::~BinaryModel()
+{
+#if defined _MSC_VER
+  if (mapped == true)
+    UnmapViewOfFile(data);
+  if (mapping != 0)
+    CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+#else  // _MSC_VER
+  if (mapped == true)
+    munmap(const_cast<char *>(data), size);
+#endif // _MSC_VER
+}
+
+bool objed::BinaryModel::map(const std::string &path)
+{
+#if defined _MSC_VER
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  if (GetFileSizeEx(file, &fileSize) == FALSE || fileSize.QuadPart < sizeof(BinaryHeader))
+    return false;
+
+  mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+  if (mapping == 0)
+    return false;
+
+  data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  size = static_cast<size_t>(fileSize.QuadPart);
+  mapped = data != 0;
+  return mapped;
+#else  // _MSC_VER
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(BinaryHeader)))
+  {
+    close(fd);
+    return false;
+  }
+
+  void *mappedData = mmap(0, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mappedData == MAP_FAILED)
+    return false;
+
+  data = static_cast<const char *>(mappedData);
+  size = static_cast<size_t>(fileStat.st_size);
+  mapped = true;
+  return true;
+#endif // _MSC_VER
+}
+
+// Takes the contents of a model built in memory (see BinaryBuilder::build)
+void objed::BinaryModel::attach(std::vector<uint64_t> &modelData)
+{
+  assert(data == 0);
+  buffer.swap(modelData);
+  data = reinterpret_cast<const char *>(buffer.data());
+  size = buffer.empty() == false ? reinterpret_cast<const BinaryHeader *>(data)->fileSize : 0;
+}
+
+static bool isSectionValid(size_t fileSize, uint32_t offset, uint32_t count, size_t itemSize)
+{
+  return offset % 8 == 0 && offset <= fileSize && count <= (fileSize - offset) / itemSize;
+}
+
+// Checks every record once, so that evaluation needs no range checks
+bool objed::BinaryModel::validate()
+{
+  header = reinterpret_cast<const BinaryHeader *>(data);
+  if (std::memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+    return false;
+  if (header->byteOrder != BINARY_BYTE_ORDER || header->version != BINARY_VERSION || header->fileSize != size)
+    return false;
+
+  if (isSectionValid(size, header->nodeOffset, header->nodeCount, sizeof(BinaryNode)) == false ||
+    isSectionValid(size, header->linkOffset, header->linkCount, sizeof(int32_t)) == false ||
+    isSectionValid(size, header->wcOffset, header->wcCount, sizeof(BinaryWc)) == false ||
+    isSectionValid(size, header->binOffset, header->binCount, sizeof(float)) == false ||
+    isSectionValid(size, header->channelOffset, header->channelCount, sizeof(BinaryChannel)) == false)
+    return false;
+
+  if (header->nodeCount == 0 || header->channelCount > BinaryClassifier::MAX_CHANNEL_COUNT)
+    return false;
+
+  nodes = reinterpret_cast<const BinaryNode *>(data + header->nodeOffset);
+  links = reinterpret_cast<const int32_t *>(data + header->linkOffset);
+  wcs = reinterpret_cast<const BinaryWc *>(data + header->wcOffset);
+  bins = reinterpret_cast<const float *>(data + header->binOffset);
+
+  const BinaryChannel *channels = reinterpret_cast<const BinaryChannel *>(data + header->channelOffset);
+  for (uint32_t i = 0; i < header->channelCount; i++)
+  {
+    const char *name = channels[i].name;
+    if (std::find(name, name + CHANNEL_NAME_SIZE, '\0') == name + CHANNEL_NAME_SIZE)
+      return false;
+    channelNames.push_back(name);
+  }
+
+  const int64_t nodeCount = header->nodeCount, linkCount = header->linkCount, wcCount = header->wcCount;
+  for (int64_t i = 0; i < nodeCount; i++)
+  {
+    const BinaryNode &node = nodes[i];
+    if (node.width <= 0 || node.height <= 0 || node.first < 0 || node.count < 0)
+      return false;
+    // Windows are scanned by the size of the root node, no node may reach out of it
+    if (node.width > nodes[0].width || node.height > nodes[0].height)
+      return false;
+
+    switch (node.type)
+    {
+    case NODE_CASCADE:
+    case NODE_MAX:
+    case NODE_TREE:
+      if (node.first + static_cast<int64_t>(node.count) > linkCount)
+        return false;
+      if (node.type == NODE_TREE && (node.count != 3 || links[node.first] < 0))
+        return false;
+      // Children follow their parent, so evaluation always terminates
+      for (int32_t j = node.first; j < node.first + node.count; j++)
+      {
+        if ((links[j] != -1 || node.type != NODE_TREE) && (links[j] <= i || links[j] >= nodeCount))
+          return false;
+      }
+      break;
+    case NODE_ADDITIVE:
+    case NODE_LINEAR:
+    case NODE_WC:
+      if (node.first + static_cast<int64_t>(node.count) > wcCount)
+        return false;
+      if (node.type == NODE_WC && node.count != 1)
+        return false;
+      for (int32_t j = node.first; j < node.first + node.count; j++)
+      {
+        if (wcs[j].width > node.width || wcs[j].height > node.height)
+          return false;
+      }
+      break;
+    default:
+      return false;
+    }
+  }
+
+  for (int64_t i = 0; i < wcCount; i++)
+  {
+    const BinaryWc &wc = wcs[i];
+    const int rectCount = wc.kind & WC_RECT_MASK;
+    if (rectCount == 0 || wc.channel < 0 || wc.channel >= static_cast<int32_t>(header->channelCount))
+      return false;
+    if (wc.width <= 0 || wc.height <= 0)
+      return false;
+    if ((wc.kind & WC_PW) != 0 && (wc.binBegin < 0 || wc.binCount <= 0 || wc.binBegin + static_cast<int64_t>(wc.binCount) > header->binCount))
+      return false;
+    // Rects are relative to the window center and must lie in the window pixels
+    // [-width / 2, width - width / 2) x [-height / 2, height - height / 2)
+    const int64_t minX = -(wc.width / 2), maxX = wc.width - wc.width / 2;
+    const int64_t minY = -(wc.height / 2), maxY = wc.height - wc.height / 2;
+    for (int j = 0; j < rectCount; j++)
+    {
+      const int64_t x = wc.rects[4 * j + 0], y = wc.rects[4 * j + 1];
+      const int64_t width = wc.rects[4 * j + 2], height = wc.rects[4 * j + 3];
+      if (width <= 0 || height <= 0 || wc.areas[j] <= 0)
+        return false;
+      if (x < minX || y < minY || x + width > maxX || y + height > maxY)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// Lowers classifier graphs into the records of a binary model
+class BinaryBuilder
+{
+public:
+  int lowerNode(const objed::Classifier *classifier);
+  bool lowerWc(const objed::Classifier *classifier, float alpha);
+  bool build(std::vector<uint64_t> *modelData) const;
+  bool save(const std::string &path) const;
+
+private:
+  int channelIndex(const std::string &preproc);
+
+private:
+  std::vector<BinaryNode> nodes;
+  std::vector<int32_t> links;
+  std::vector<BinaryWc> wcs;
+  std::vector<float> bins;
+  std::vector<std::string> channelNames;
+};
+
+int BinaryBuilder::lowerNode(const objed::Classifier *classifier)
+{
+  using namespace objed;
+
+  if (classifier == 0)
+    return -1;
+
+  const std::string clType = classifier->type();
+  const int index = static_cast<int>(nodes.size());
+
+  BinaryNode node = {0, classifier->width(), classifier->height(), 0, 0};
+  nodes.push_back(node);
+
+  std::vector<int32_t> children;
+  if (clType == CascadeClassifier::typeStatic() || clType == MaxClassifier::typeStatic())
+  {
+    const std::vector<Classifier *> &clList = clType == CascadeClassifier::typeStatic() ?
+      static_cast<const CascadeClassifier *>(classifier)->clList : static_cast<const MaxClassifier *>(classifier)->clList;
+
+    node.type = clType == CascadeClassifier::typeStatic() ? NODE_CASCADE : NODE_MAX;
+    for (size_t i = 0; i < clList.size(); i++)
+    {
+      children.push_back(lowerNode(clList[i]));
+      if (children.back() < 0)
+        return -1;
+    }
+  }
+  else if (clType == TreeClassifier::typeStatic())
+  {
+    const TreeClassifier *treeCl = static_cast<const TreeClassifier *>(classifier);
+    node.type = NODE_TREE;
+
+    children.push_back(lowerNode(treeCl->centralCl));
+    if (children.back() < 0)
+      return -1;
+
+    const Classifier *branches[2] = {treeCl->leftCl, treeCl->rightCl};
+    for (int i = 0; i < 2; i++)
+    {
+      children.push_back(branches[i] != 0 ? lowerNode(branches[i]) : -1);
+      if (branches[i] != 0 && children.back() < 0)
+        return -1;
+    }
+  }
+  else if (clType == AdditiveClassifier::typeStatic() || clType == LinearClassifier::typeStatic())
+  {
+    const bool linear = clType == LinearClassifier::typeStatic();
+    const std::vector<Classifier *> &clList = linear == true ?
+      static_cast<const LinearClassifier *>(classifier)->clList : static_cast<const AdditiveClassifier *>(classifier)->clList;
+
+    node.type = linear == true ? NODE_LINEAR : NODE_ADDITIVE;
+    node.first = static_cast<int32_t>(wcs.size());
+    node.count = static_cast<int32_t>(clList.size());
+    for (size_t i = 0; i < clList.size(); i++)
+    {
+      float alpha = linear == true ? static_cast<const LinearClassifier *>(classifier)->alphaList[i] : 1.0f;
+      if (lowerWc(clList[i], alpha) == false)
+        return -1;
+    }
+  }
+  else
+  {
+    node.type = NODE_WC;
+    node.first = static_cast<int32_t>(wcs.size());
+    node.count = 1;
+    if (lowerWc(classifier, 1.0f) == false)
+      return -1;
+  }
+
+  if (node.type == NODE_CASCADE || node.type == NODE_MAX || node.type == NODE_TREE)
+  {
+    node.first = static_cast<int32_t>(links.size());
+    node.count = static_cast<int32_t>(children.size());
+    links.insert(links.end(), children.begin(), children.end());
+  }
+
+  nodes[index] = node;
+  return index;
+}
+
+bool BinaryBuilder::lowerWc(const objed::Classifier *classifier, float alpha)
+{
+  using namespace objed;
+
+  const std::string clType = classifier->type();
+
+  BinaryWc wc;
+  std::memset(&wc, 0, sizeof(wc));
+  wc.width = classifier->width();
+  wc.height = classifier->height();
+  wc.alpha = alpha;
+
+  std::string preproc;
+  Rect<int> rects[3];
+  const std::vector<float> *wcBins = 0;
+
+  if (clType == Haar1StumpClassifier::typeStatic())
+  {
+    const Haar1StumpClassifier *haarCl = static_cast<const Haar1StumpClassifier *>(classifier);
+    wc.kind = WC_HAAR1; preproc = haarCl->preproc; rects[0] = haarCl->rect;
+    wc.threshold = haarCl->threshold; wc.values[0] = haarCl->values[0]; wc.values[1] = haarCl->values[1];
+  }
+  else if (clType == Haar2StumpClassifier::typeStatic())
+  {
+    const Haar2StumpClassifier *haarCl = static_cast<const Haar2StumpClassifier *>(classifier);
+    wc.kind = WC_HAAR2 | (haarCl->normalize ? WC_NORMALIZE : 0); preproc = haarCl->preproc;
+    rects[0] = haarCl->rect0; rects[1] = haarCl->rect1;
+    wc.threshold = haarCl->threshold; wc.values[0] = haarCl->values[0]; wc.values[1] = haarCl->values[1];
+  }
+  else if (clType == Haar3StumpClassifier::typeStatic())
+  {
+    const Haar3StumpClassifier *haarCl = static_cast<const Haar3StumpClassifier *>(classifier);
+    wc.kind = WC_HAAR3 | (haarCl->normalize ? WC_NORMALIZE : 0); preproc = haarCl->preproc;
+    rects[0] = haarCl->rect0; rects[1] = haarCl->rect1; rects[2] = haarCl->rect2;
+    wc.threshold = haarCl->threshold; wc.values[0] = haarCl->values[0]; wc.values[1] = haarCl->values[1];
+  }
+  else if (clType == Haar1PwClassifier::typeStatic())
+  {
+    const Haar1PwClassifier *haarCl = static_cast<const Haar1PwClassifier *>(classifier);
+    wc.kind = WC_HAAR1 | WC_PW; preproc = haarCl->preproc; rects[0] = haarCl->rect;
+    wcBins = &haarCl->bins;
+  }
+  else if (clType == Haar2PwClassifier::typeStatic())
+  {
+    const Haar2PwClassifier *haarCl = static_cast<const Haar2PwClassifier *>(classifier);
+    wc.kind = WC_HAAR2 | WC_PW | (haarCl->normalize ? WC_NORMALIZE : 0); preproc = haarCl->preproc;
+    rects[0] = haarCl->rect0; rects[1] = haarCl->rect1;
+    wcBins = &haarCl->bins;
+  }
+  else if (clType == Haar3PwClassifier::typeStatic())
+  {
+    const Haar3PwClassifier *haarCl = static_cast<const Haar3PwClassifier *>(classifier);
+    wc.kind = WC_HAAR3 | WC_PW | (haarCl->normalize ? WC_NORMALIZE : 0); preproc = haarCl->preproc;
+    rects[0] = haarCl->rect0; rects[1] = haarCl->rect1; rects[2] = haarCl->rect2;
+    wcBins = &haarCl->bins;
+  }
+  else
+  {
+    return false;
+  }
+
+  wc.channel = channelIndex(preproc);
+  if (wc.channel < 0)
+    return false;
+
+  if (wcBins != 0)
+  {
+    if (wcBins->empty() == true)
+      return false;
+    wc.binBegin = static_cast<int32_t>(bins.size());
+    wc.binCount = static_cast<int32_t>(wcBins->size());
+    bins.insert(bins.end(), wcBins->begin(), wcBins->end());
+  }
+
+  for (int i = 0; i < 3; i++)
+  {
+    wc.rects[4 * i + 0] = rects[i].x;
+    wc.rects[4 * i + 1] = rects[i].y;
+    wc.rects[4 * i + 2] = rects[i].width;
+    wc.rects[4 * i + 3] = rects[i].height;
+    wc.areas[i] = std::max(1, rects[i].width * rects[i].height);
+  }
+
+  wcs.push_back(wc);
+  return true;
+}
+
+int BinaryBuilder::channelIndex(const std::string &preproc)
+{
+  std::vector<std::string>::const_iterator it = std::find(channelNames.begin(), channelNames.end(), preproc);
+  if (it != channelNames.end())
+    return static_cast<int>(it - channelNames.begin());
+
+  if (channelNames.size() >= objed::BinaryClassifier::MAX_CHANNEL_COUNT || preproc.size() >= CHANNEL_NAME_SIZE)
+    return -1;
+
+  channelNames.push_back(preproc);
+  return static_cast<int>(channelNames.size() - 1);
+}
+
+static uint32_t alignedOffset(uint64_t offset)
+{
+  return static_cast<uint32_t>((offset + 7) / 8 * 8);
+}
+
+// Lays the model out in 8-byte words, so that it can be evaluated in place from memory
+bool BinaryBuilder::build(std::vector<uint64_t> *modelData) const
+{
+  BinaryHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.byteOrder = BINARY_BYTE_ORDER;
+  header.version = BINARY_VERSION;
+
+  std::vector<BinaryChannel> channels(channelNames.size());
+  for (size_t i = 0; i < channelNames.size(); i++)
+  {
+    std::memset(channels[i].name, 0, CHANNEL_NAME_SIZE);
+    std::memcpy(channels[i].name, channelNames[i].c_str(), channelNames[i].size());
+  }
+
+  const uint64_t fileSize = alignedOffset(sizeof(header)) + alignedOffset(nodes.size() * sizeof(BinaryNode)) +
+    alignedOffset(links.size() * sizeof(int32_t)) + alignedOffset(wcs.size() * sizeof(BinaryWc)) +
+    alignedOffset(bins.size() * sizeof(float)) + channels.size() * sizeof(BinaryChannel);
+  if (fileSize > std::numeric_limits<uint32_t>::max())
+    return false;
+
+  header.nodeCount = static_cast<uint32_t>(nodes.size());
+  header.nodeOffset = alignedOffset(sizeof(header));
+  header.linkCount = static_cast<uint32_t>(links.size());
+  header.linkOffset = alignedOffset(header.nodeOffset + nodes.size() * sizeof(BinaryNode));
+  header.wcCount = static_cast<uint32_t>(wcs.size());
+  header.wcOffset = alignedOffset(header.linkOffset + links.size() * sizeof(int32_t));
+  header.binCount = static_cast<uint32_t>(bins.size());
+  header.binOffset = alignedOffset(header.wcOffset + wcs.size() * sizeof(BinaryWc));
+  header.channelCount = static_cast<uint32_t>(channels.size());
+  header.channelOffset = alignedOffset(header.binOffset + bins.size() * sizeof(float));
+  header.fileSize = static_cast<uint32_t>(header.channelOffset + channels.size() * sizeof(BinaryChannel));
+
+  modelData->assign((header.fileSize + 7) / 8, 0);
+  char *fileData = reinterpret_cast<char *>(modelData->data());
+  std::memcpy(&fileData[0], &header, sizeof(header));
+  if (nodes.empty() == false)
+    std::memcpy(&fileData[header.nodeOffset], &nodes[0], nodes.size() * sizeof(BinaryNode));
+  if (links.empty() == false)
+    std::memcpy(&fileData[header.linkOffset], &links[0], links.size() * sizeof(int32_t));
+  if (wcs.empty() == false)
+    std::memcpy(&fileData[header.wcOffset], &wcs[0], wcs.size() * sizeof(BinaryWc));
+  if (bins.empty() == false)
+    std::memcpy(&fileData[header.binOffset], &bins[0], bins.size() * sizeof(float));
+  if (channels.empty() == false)
+    std::memcpy(&fileData[header.channelOffset], &channels[0], channels.size() * sizeof(BinaryChannel));
+
+  return true;
+}
+
+bool BinaryBuilder::save(const std::string &path) const
+{
+  std::vector<uint64_t> modelData;
+  if (build(&modelData) == false)
+    return false;
+
+  std::ofstream ofs(path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+  if (ofs.is_open() == false)
+    return false;
+
+  const BinaryHeader *header = reinterpret_cast<const BinaryHeader *>(modelData.data());
+  ofs.write(reinterpret_cast<const char *>(modelData.data()), header->fileSize);
+  return ofs.good();
+}
+
+objed::BinaryClassifier::BinaryClassifier(const std::shared_ptr<const BinaryModel> &model) :
+model(model), channelIntegrals(model->channelNames.size(), 0)
+{
+  return;
+}
+
+objed::BinaryClassifier::~BinaryClassifier()
+{
+  return;
+}
+
+int objed::BinaryClassifier::width() const
+{
+  return model->nodes[0].width;
+}
+
+int objed::BinaryClassifier::height() const
+{
+  return model->nodes[0].height;
+}
+
+bool objed::BinaryClassifier::prepare(ImagePool *imagePool)
+{
+  bool ok = true;
+  for (size_t i = 0; i < channelIntegrals.size(); i++)
+  {
+    channelIntegrals[i] = imagePool->integral(model->channelNames[i]);
+    ok &= channelIntegrals[i] != 0;
+  }
+
+  assert(ok == true);
+  return ok;
+}
+
+bool objed::BinaryClassifier::evaluate(float *result, int x, int y, DebugInfo *debugInfo) const
+{
+  const int *origins[MAX_CHANNEL_COUNT];
+  int steps[MAX_CHANNEL_COUNT];
+  for (size_t i = 0; i < channelIntegrals.size(); i++)
+  {
+    // Integrals of a pool updated since prepare() have no data until they are requested again
+    assert(channelIntegrals[i] != 0 && channelIntegrals[i]->imageData != 0);
+    if (channelIntegrals[i]->imageData == 0)
+      return false;
+    origins[i] = integralOrigin(channelIntegrals[i], x, y);
+    steps[i] = channelIntegrals[i]->widthStep / sizeof(int);
+  }
+
+  return evaluateNode(0, result, origins, steps, debugInfo);
+}
+
+// Mirrors evaluate() of the classifier each node was lowered from, including its early exits
+bool objed::BinaryClassifier::evaluateNode(int index, float *result, const int * const *origins, const int *steps, DebugInfo *debugInfo) const
+{
+  const BinaryNode &node = model->nodes[index];
+  const int32_t *children = model->links + node.first;
+
+  switch (node.type)
+  {
+  case NODE_CASCADE:
+    {
+      if (node.count == 0)
+        return false;
+
+      if (node.count < 6)
+      {
+        bool ok = false;
+        for (int i = 0; i < node.count - 1; i++)
+        {
+          ok = evaluateNode(children[i], result, origins, steps, debugInfo);
+          if (ok == false || CascadeClassifier::rejects(node.count, *result) == true)
+            return ok;
+        }
+        return evaluateNode(children[node.count - 1], result, origins, steps, debugInfo);
+      }
+
+      *result = objed::epsilon;
+      bool ok = true;
+      for (int i = 0; i < node.count && CascadeClassifier::rejects(node.count, *result) == false; i++)
+        ok &= evaluateNode(children[i], result, origins, steps, debugInfo);
+      return ok;
+    }
+  case NODE_TREE:
+    {
+      bool ok = evaluateNode(children[0], result, origins, steps, debugInfo);
+      const int32_t branch = *result > 0 ? children[2] : children[1];
+      return branch >= 0 ? ok && evaluateNode(branch, result, origins, steps, debugInfo) : ok;
+    }
+  case NODE_MAX:
+    {
+      bool ok = true;
+      float clResult = 0.0;
+      float totalResult = -std::numeric_limits<float>::max();
+
+      for (int i = 0; i < node.count; i++)
+      {
+        ok &= evaluateNode(children[i], &clResult, origins, steps, 0);
+        totalResult = std::max(totalResult, clResult);
+      }
+
+      *result = totalResult;
+      return ok;
+    }
+  case NODE_ADDITIVE:
+    {
+      float totalResult = 0.0;
+      for (int wc = node.first; wc < node.first + node.count; wc++)
+        totalResult += evaluateWc(wc, origins, steps);
+
+      INCREASE_SC_COUNT(debugInfo);
+      *result = totalResult;
+      return true;
+    }
+  case NODE_LINEAR:
+    {
+      float totalResult = 0.0;
+      for (int wc = node.first; wc < node.first + node.count; wc++)
+        totalResult += model->wcs[wc].alpha * evaluateWc(wc, origins, steps);
+
+      INCREASE_SC_COUNT(debugInfo);
+      *result = totalResult;
+      return true;
+    }
+  case NODE_WC:
+    *result = evaluateWc(node.first, origins, steps);
+    return true;
+  }
+
+  return false;
+}
+
+float objed::BinaryClassifier::evaluateWc(int index, const int * const *origins, const int *steps) const
+{
+  const BinaryWc &wc = model->wcs[index];
+  const unsigned int *origin = reinterpret_cast<const unsigned int *>(origins[wc.channel]);
+  const int step = steps[wc.channel];
+  const int rectCount = wc.kind & WC_RECT_MASK;
+
+  // Same corner arithmetic as rectSum(), modulo 2^32
+  int sums[3] = {0, 0, 0};
+  for (int i = 0; i < rectCount; i++)
+  {
+    const int32_t *rect = wc.rects + 4 * i;
+    const unsigned int *line1 = origin + rect[1] * step + rect[0];
+    const unsigned int *line2 = line1 + rect[3] * step;
+    sums[i] = static_cast<int>(line2[rect[2]] - line1[rect[2]] - line2[0] + line1[0]);
+  }
+
+  int value = 0;
+  if (rectCount == WC_HAAR1)
+    value = sums[0] / wc.areas[0];
+  else if (rectCount == WC_HAAR2 && (wc.kind & WC_NORMALIZE) != 0)
+    value = 255 * sums[0] / (sums[0] + sums[1] + 1);
+  else if (rectCount == WC_HAAR2)
+    value = (sums[0] / wc.areas[0] - sums[1] / wc.areas[1] + 255) / 2;
+  else if ((wc.kind & WC_NORMALIZE) != 0)
+    value = 255 * (sums[0] + sums[2]) / (sums[0] + sums[1] + sums[2] + 1);
+  else
+    value = (sums[0] / wc.areas[0] - sums[1] / wc.areas[1] + sums[2] / wc.areas[2] + 255) / 3;
+
+  if ((wc.kind & WC_PW) != 0)
+    return model->bins[wc.binBegin + static_cast<size_t>(value) * wc.binCount / 256];
+  return value > wc.threshold ? wc.values[0] : wc.values[1];
+}
+
+// Evaluates alive lanes in chunks; lanes whose evaluation fails are cleared from alive
+bool objed::BinaryClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  for (size_t i = 0; i < channelIntegrals.size(); i++)
+  {
+    assert(channelIntegrals[i] != 0 && channelIntegrals[i]->imageData != 0);
+    if (channelIntegrals[i]->imageData == 0)
+    {
+      std::fill(alive, alive + n, 0);
+      return false;
+    }
+  }
+
+  const std::ptrdiff_t deadCount = std::count(alive, alive + n, 0);
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+    evaluateNodeBatch(0, xs + i, ys + i, std::min(n - i, BATCH_CHUNK_SIZE), results + i, alive + i);
+
+  return std::count(alive, alive + n, 0) == deadCount;
+}
+
+// Batch counterpart of evaluateNode for up to BATCH_CHUNK_SIZE lanes. Results of lanes that are 
+// not alive are undefined; lanes are cleared from alive where evaluateNode would return false. 
+// Cascades and trees pass only their remaining lanes on, compacted, to the children
+void objed::BinaryClassifier::evaluateNodeBatch(int index, const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  assert(n <= BATCH_CHUNK_SIZE);
+
+  const BinaryNode &node = model->nodes[index];
+  const int32_t *children = model->links + node.first;
+
+  int laneIndices[BATCH_CHUNK_SIZE], laneXs[BATCH_CHUNK_SIZE], laneYs[BATCH_CHUNK_SIZE];
+  float laneResults[BATCH_CHUNK_SIZE];
+  uint8_t laneAlive[BATCH_CHUNK_SIZE];
+
+  switch (node.type)
+  {
+  case NODE_CASCADE:
+    {
+      if (node.count == 0)
+      {
+        std::fill(alive, alive + n, 0);
+        return;
+      }
+
+      int laneCount = 0;
+      for (int j = 0; j < n; j++)
+      {
+        if (alive[j] == 0)
+          continue;
+
+        laneIndices[laneCount] = j;
+        laneXs[laneCount] = xs[j];
+        laneYs[laneCount] = ys[j];
+        laneAlive[laneCount] = 1;
+        laneCount++;
+      }
+
+      for (int i = 0; i < node.count && laneCount > 0; i++)
+      {
+        evaluateNodeBatch(children[i], laneXs, laneYs, laneCount, laneResults, laneAlive);
+
+        int passedCount = 0;
+        for (int j = 0; j < laneCount; j++)
+        {
+          const int lane = laneIndices[j];
+          if (laneAlive[j] == 0)
+          {
+            alive[lane] = 0;
+            continue;
+          }
+
+          results[lane] = laneResults[j];
+          if (CascadeClassifier::rejects(node.count, laneResults[j]) == true)
+            continue;
+
+          laneIndices[passedCount] = lane;
+          laneXs[passedCount] = laneXs[j];
+          laneYs[passedCount] = laneYs[j];
+          laneAlive[passedCount] = 1;
+          passedCount++;
+        }
+
+        laneCount = passedCount;
+      }
+      return;
+    }
+  case NODE_TREE:
+    {
+      evaluateNodeBatch(children[0], xs, ys, n, results, alive);
+
+      // Branches are chosen by the central results before either branch overwrites them
+      uint8_t isRight[BATCH_CHUNK_SIZE];
+      for (int j = 0; j < n; j++)
+        isRight[j] = results[j] > 0;
+
+      for (int branch = 1; branch <= 2; branch++)
+      {
+        if (children[branch] < 0)
+          continue;
+
+        int laneCount = 0;
+        for (int j = 0; j < n; j++)
+        {
+          if (alive[j] == 0 || isRight[j] != (branch == 2))
+            continue;
+
+          laneIndices[laneCount] = j;
+          laneXs[laneCount] = xs[j];
+          laneYs[laneCount] = ys[j];
+          laneAlive[laneCount] = 1;
+          laneCount++;
+        }
+
+        if (laneCount == 0)
+          continue;
+
+        evaluateNodeBatch(children[branch], laneXs, laneYs, laneCount, laneResults, laneAlive);
+        for (int j = 0; j < laneCount; j++)
+        {
+          alive[laneIndices[j]] = laneAlive[j];
+          results[laneIndices[j]] = laneResults[j];
+        }
+      }
+      return;
+    }
+  case NODE_MAX:
+    {
+      std::fill(results, results + n, -std::numeric_limits<float>::max());
+      for (int i = 0; i < node.count; i++)
+      {
+        evaluateNodeBatch(children[i], xs, ys, n, laneResults, alive);
+        for (int j = 0; j < n; j++)
+        {
+          if (alive[j] != 0)
+            results[j] = std::max(results[j], laneResults[j]);
+        }
+      }
+      return;
+    }
+  case NODE_ADDITIVE:
+  case NODE_LINEAR:
+    {
+      std::fill(results, results + n, 0.0f);
+      for (int wc = node.first; wc < node.first + node.count; wc++)
+      {
+        evaluateWcBatch(wc, xs, ys, n, laneResults, alive);
+
+        if (node.type == NODE_LINEAR)
+        {
+          const float alpha = model->wcs[wc].alpha;
+          for (int j = 0; j < n; j++)
+          {
+            if (alive[j] != 0)
+              results[j] += alpha * laneResults[j];
+          }
+        }
+        else
+        {
+          for (int j = 0; j < n; j++)
+          {
+            if (alive[j] != 0)
+              results[j] += laneResults[j];
+          }
+        }
+      }
+      return;
+    }
+  case NODE_WC:
+    evaluateWcBatch(node.first, xs, ys, n, results, alive);
+    return;
+  }
+
+  std::fill(alive, alive + n, 0);
+}
+
+// Corner offsets follow the integral bound to the channel, so the kernels of batchutils 
+// evaluate the flat records the same way the Haar classifiers evaluate their own rects
+void objed::BinaryClassifier::evaluateWcBatch(int index, const int *xs, const int *ys, int n, float *results, const uint8_t *alive) const
+{
+  const BinaryWc &wc = model->wcs[index];
+  const IplImage *integral = channelIntegrals[wc.channel];
+  const int rectCount = wc.kind & WC_RECT_MASK;
+  assert(integral != 0);
+
+  int offsets[12];
+  for (int i = 0; i < rectCount; i++)
+  {
+    const int32_t *rect = wc.rects + 4 * i;
+    rectOffsets(offsets + 4 * i, integral, rect[0], rect[1], rect[2], rect[3]);
+  }
+
+  int values[BATCH_CHUNK_SIZE];
+  haarBatch(values, integral, offsets, wc.areas, rectCount, (wc.kind & WC_NORMALIZE) != 0, xs, ys, n);
+
+  if ((wc.kind & WC_PW) != 0)
+    pwBatch(results, alive, values, model->bins + wc.binBegin, wc.binCount, n);
+  else
+    stumpBatch(results, alive, values, wc.threshold, wc.values, n);
+}
+
+// Serializes the classifier the file was written from, so JSON -> .objedb -> JSON is lossless
+Json::Value objed::BinaryClassifier::serialize() const
+{
+  Classifier *classifier = restoreNode(0);
+  Json::Value data = classifier != 0 ? classifier->serialize() : Json::Value();
+  Classifier::destroy(classifier);
+  return data;
+}
+
+objed::Classifier * objed::BinaryClassifier::clone() const
+{
+  return new BinaryClassifier(model);
+}
+
+objed::Classifier * objed::BinaryClassifier::restoreNode(int index) const
+{
+  const BinaryNode &node = model->nodes[index];
+  const int32_t *children = model->links + node.first;
+
+  if (node.type == NODE_CASCADE)
+  {
+    CascadeClassifier *cascadeCl = new CascadeClassifier(node.width, node.height);
+    for (int i = 0; i < node.count; i++)
+      cascadeCl->clList.push_back(restoreNode(children[i]));
+    return cascadeCl;
+  }
+  else if (node.type == NODE_MAX)
+  {
+    MaxClassifier *maxCl = new MaxClassifier(node.width, node.height);
+    for (int i = 0; i < node.count; i++)
+      maxCl->clList.push_back(restoreNode(children[i]));
+    return maxCl;
+  }
+  else if (node.type == NODE_TREE)
+  {
+    TreeClassifier *treeCl = new TreeClassifier(node.width, node.height);
+    treeCl->centralCl = restoreNode(children[0]);
+    treeCl->leftCl = children[1] >= 0 ? restoreNode(children[1]) : 0;
+    treeCl->rightCl = children[2] >= 0 ? restoreNode(children[2]) : 0;
+    return treeCl;
+  }
+  else if (node.type == NODE_LINEAR)
+  {
+    LinearClassifier *linearCl = new LinearClassifier(node.width, node.height);
+    for (int wc = node.first; wc < node.first + node.count; wc++)
+    {
+      linearCl->clList.push_back(restoreWc(wc));
+      linearCl->alphaList.push_back(model->wcs[wc].alpha);
+    }
+    return linearCl;
+  }
+  else if (node.type == NODE_ADDITIVE)
+  {
+    AdditiveClassifier *additiveCl = new AdditiveClassifier(node.width, node.height);
+    for (int wc = node.first; wc < node.first + node.count; wc++)
+      additiveCl->clList.push_back(restoreWc(wc));
+    return additiveCl;
+  }
+
+  return restoreWc(node.first);
+}
+
+objed::Classifier * objed::BinaryClassifier::restoreWc(int index) const
+{
+  const BinaryWc &wc = model->wcs[index];
+  const std::string &preproc = model->channelNames[wc.channel];
+  const float *wcBins = model->bins + wc.binBegin;
+
+  Rect<int> rects[3];
+  for (int i = 0; i < 3; i++)
+    rects[i] = Rect<int>(wc.rects[4 * i + 0], wc.rects[4 * i + 1], wc.rects[4 * i + 2], wc.rects[4 * i + 3]);
+
+  switch (wc.kind & ~WC_NORMALIZE)
+  {
+  case WC_HAAR1:
+    {
+      Haar1StumpClassifier *haarCl = new Haar1StumpClassifier(wc.width, wc.height);
+      haarCl->preproc = preproc; haarCl->rect = rects[0];
+      haarCl->threshold = wc.threshold; haarCl->values[0] = wc.values[0]; haarCl->values[1] = wc.values[1];
+      return haarCl;
+    }
+  case WC_HAAR2:
+    {
+      Haar2StumpClassifier *haarCl = new Haar2StumpClassifier(wc.width, wc.height);
+      haarCl->preproc = preproc; haarCl->rect0 = rects[0]; haarCl->rect1 = rects[1];
+      haarCl->normalize = (wc.kind & WC_NORMALIZE) != 0;
+      haarCl->threshold = wc.threshold; haarCl->values[0] = wc.values[0]; haarCl->values[1] = wc.values[1];
+      return haarCl;
+    }
+  case WC_HAAR3:
+    {
+      Haar3StumpClassifier *haarCl = new Haar3StumpClassifier(wc.width, wc.height);
+      haarCl->preproc = preproc; haarCl->rect0 = rects[0]; haarCl->rect1 = rects[1]; haarCl->rect2 = rects[2];
+      haarCl->normalize = (wc.kind & WC_NORMALIZE) != 0;
+      haarCl->threshold = wc.threshold; haarCl->values[0] = wc.values[0]; haarCl->values[1] = wc.values[1];
+      return haarCl;
+    }
+  case WC_HAAR1 | WC_PW:
+    {
+      Haar1PwClassifier *haarCl = new Haar1PwClassifier(wc.width, wc.height);
+      haarCl->preproc = preproc; haarCl->rect = rects[0];
+      haarCl->bins.assign(wcBins, wcBins + wc.binCount);
+      return haarCl;
+    }
+  case WC_HAAR2 | WC_PW:
+    {
+      Haar2PwClassifier *haarCl = new Haar2PwClassifier(wc.width, wc.height);
+      haarCl->preproc = preproc; haarCl->rect0 = rects[0]; haarCl->rect1 = rects[1];
+      haarCl->normalize = (wc.kind & WC_NORMALIZE) != 0;
+      haarCl->bins.assign(wcBins, wcBins + wc.binCount);
+      return haarCl;
+    }
+  case WC_HAAR3 | WC_PW:
+    {
+      Haar3PwClassifier *haarCl = new Haar3PwClassifier(wc.width, wc.height);
+      haarCl->preproc = preproc; haarCl->rect0 = rects[0]; haarCl->rect1 = rects[1]; haarCl->rect2 = rects[2];
+      haarCl->normalize = (wc.kind & WC_NORMALIZE) != 0;
+      haarCl->bins.assign(wcBins, wcBins + wc.binCount);
+      return haarCl;
+    }
+  }
+
+  assert(false);
+  return 0;
+}
+
+bool objed::BinaryClassifier::isBinary(const std::string &path)
+{
+  char magic[sizeof(BINARY_MAGIC)] = {0};
+
+  std::ifstream ifs(path.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (ifs.is_open() == false || ifs.read(magic, sizeof(magic)).good() == false)
+    return false;
+
+  return std::memcmp(magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0;
+}
+
+objed::BinaryClassifier * objed::BinaryClassifier::load(const std::string &path)
+{
+  std::shared_ptr<BinaryModel> model = std::make_shared<BinaryModel>();
+  if (model->map(path) == false || model->validate() == false)
+    return 0;
+
+  return new BinaryClassifier(model);
+}
+
+objed::BinaryClassifier * objed::BinaryClassifier::compile(const Classifier *classifier)
+{
+  if (classifier == 0)
+    return 0;
+  if (classifier->type() == BinaryClassifier::typeStatic())
+    return static_cast<BinaryClassifier *>(classifier->clone());
+
+  BinaryBuilder builder;
+  std::vector<uint64_t> modelData;
+  if (builder.lowerNode(classifier) != 0 || builder.build(&modelData) == false)
+    return 0;
+
+  std::shared_ptr<BinaryModel> model = std::make_shared<BinaryModel>();
+  model->attach(modelData);
+  if (model->validate() == false)
+    return 0;
+
+  return new BinaryClassifier(model);
+}
+
+bool objed::BinaryClassifier::write(const Classifier *classifier, const std::string &path)
+{
+  if (classifier == 0)
+    return false;
+
+  // Binary classifiers are written as the plain classifier they were lowered from
+  if (classifier->type() == BinaryClassifier::typeStatic())
+  {
+    Json::Value data = classifier->serialize();
+    Classifier *plainClassifier = Classifier::create(data);
+    bool ok = write(plainClassifier, path);
+    Classifier::destroy(plainClassifier);
+    return ok;
+  }
+
+  BinaryBuilder builder;
+  if (builder.lowerNode(classifier) != 0)
+    return false;
+
+  return builder.save(path);
+}
@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef BINARYCL_H_INCLUDED
+#define BINARYCL_H_INCLUDED
+
+#include <objed/objed.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace objed
+{
+  struct BinaryModel;
+
+  // BinaryClassifier evaluates a classifier stored in the binary model format (.objedb). 
+  // The file is mapped read-only and evaluated straight from its flat records, so loading 
+  // neither parses nor allocates per weak classifier, and processes mapping the same file 
+  // share its pages. Clones share the mapping. Results are bit-identical to 
+  // Classifier::evaluate() of the classifier the file was written from.
+  class BinaryClassifier : public Classifier
+  {
+    OBJED_TYPE("binaryClassifier")
+    OBJED_DISABLE_COPY(BinaryClassifier)
+
+  public:
+    static const int MAX_CHANNEL_COUNT = 16;
+
+  public:
+    virtual ~BinaryClassifier();
+
+  public:
+    virtual int width() const;
+    virtual int height() const;
+    virtual bool prepare(ImagePool *imagePool);
+    virtual bool evaluate(float *result, int x, int y, DebugInfo *debugInfo) const;
+    virtual bool evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
+    virtual Json::Value serialize() const;
+    virtual Classifier * clone() const;
+
+  public:
+    // Checks the file magic only
+    static bool isBinary(const std::string &path);
+    // Returns 0 if the file cannot be mapped or fails validation
+    static BinaryClassifier * load(const std::string &path);
+    // Lowers the classifier into a model held in memory; returns 0 for graphs write() rejects
+    static BinaryClassifier * compile(const Classifier *classifier);
+    // Supports cascade, tree and max classifiers of additive or linear classifiers 
+    // of Haar weak classifiers (or of Haar weak classifiers themselves)
+    static bool write(const Classifier *classifier, const std::string &path);
+
+  private:
+    BinaryClassifier(const std::shared_ptr<const BinaryModel> &model);
+
+  private:
+    bool evaluateNode(int index, float *result, const int * const *origins, const int *steps, DebugInfo *debugInfo) const;
+    float evaluateWc(int index, const int * const *origins, const int *steps) const;
+    void evaluateNodeBatch(int index, const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
+    void evaluateWcBatch(int index, const int *xs, const int *ys, int n, float *results, const uint8_t *alive) const;
+    Classifier * restoreNode(int index) const;
+    Classifier * restoreWc(int index) const;
+
+  private:
+    std::shared_ptr<const BinaryModel> model;
+    std::vector<const IplImage *> channelIntegrals;
+  };
+}
+
+#endif  // BINARYCL_H_INCLUDED
@@ -30,7 +30,9 @@ either expressed or implied, of copyright holders.
 */
 
 #include "cascadecl.h"
+#include "batchutils.h"
 
+#include <algorithm>
 #include <cassert>
 
 objed::CascadeClassifier::CascadeClassifier(int width, int height) :
@@ -110,6 +112,71 @@ bool objed::CascadeClassifier::evaluate(float *result, int x, int y, DebugInfo *
   }
 }
 
+bool objed::CascadeClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  if (clList.empty() == true)
+  {
+    std::fill(alive, alive + n, 0);
+    return false;
+  }
+
+  bool ok = true;
+
+  int laneIndices[BATCH_CHUNK_SIZE], laneXs[BATCH_CHUNK_SIZE], laneYs[BATCH_CHUNK_SIZE];
+  float laneResults[BATCH_CHUNK_SIZE];
+  uint8_t laneAlive[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+
+    int laneCount = 0;
+    for (int j = i; j < i + count; j++)
+    {
+      if (alive[j] == 0)
+        continue;
+
+      laneIndices[laneCount] = j;
+      laneXs[laneCount] = xs[j];
+      laneYs[laneCount] = ys[j];
+      laneAlive[laneCount] = 1;
+      laneCount++;
+    }
+
+    for (size_t k = 0; k < clList.size() && laneCount > 0; k++)
+    {
+      ok &= clList[k]->evaluateBatch(laneXs, laneYs, laneCount, laneResults, laneAlive);
+
+      // Compact lanes which passed the stage to the front of the batch
+      int passedCount = 0;
+      for (int j = 0; j < laneCount; j++)
+      {
+        const int index = laneIndices[j];
+        if (laneAlive[j] == 0)
+        {
+          alive[index] = 0;
+          continue;
+        }
+
+        const float result = laneResults[j];
+        results[index] = result;
+        if (rejects(clList.size(), result) == true)
+          continue;
+
+        laneIndices[passedCount] = index;
+        laneXs[passedCount] = laneXs[j];
+        laneYs[passedCount] = laneYs[j];
+        laneAlive[passedCount] = 1;
+        passedCount++;
+      }
+
+      laneCount = passedCount;
+    }
+  }
+
+  return ok;
+}
+
 Json::Value objed::CascadeClassifier::serialize() const
 {
   Json::Value data;
@@ -55,9 +55,18 @@ namespace objed
     virtual int height() const;
     virtual bool prepare(ImagePool *imagePool);
     virtual bool evaluate(float *result, int x, int y, DebugInfo *debugInfo) const;
+    virtual bool evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
     virtual Json::Value serialize() const;
     virtual Classifier * clone() const;
 
+  public:
+    // Stage rejection rule of evaluate(): cascades of up to five stages stop on
+    // negative results only, longer ones stop on zero results as well
+    static inline bool rejects(size_t stageCount, float result)
+    {
+      return stageCount < 6 ? result < 0.0 : !(result > 0.0);
+    }
+
   private:
     bool evaluate1(float *result, int x, int y, DebugInfo *debugInfo) const;
     bool evaluate2(float *result, int x, int y, DebugInfo *debugInfo) const;
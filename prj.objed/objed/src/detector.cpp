@@ -28,3 +28,108 @@ The views and conclusions contained in the software and documentation are those
 of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of copyright holders.
 */
+
+#include "detector.h"
+#include "binarycl.h"
+
+#include <cassert>
+
+objed::ScanContext::ScanContext(Classifier *classifier, bool isClassifierOwn, ImagePool *extImagePool) :
+imagePool(0), isImagePoolOwn(false), classifier(classifier), isClassifierOwn(isClassifierOwn), levelPools(0)
+{
+  imagePool = extImagePool != 0 ? extImagePool : ImagePool::create();
+  isImagePoolOwn = extImagePool == 0;
+
+  if (classifier != 0)
+    classifier->prepare(imagePool);
+}
+
+objed::ScanContext::~ScanContext()
+{
+  delete levelPools;
+
+  if (isImagePoolOwn == true)
+    ImagePool::destroy(imagePool);
+
+  if (isClassifierOwn == true)
+    Classifier::destroy(classifier);
+}
+
+IplImage * objed::ScanContext::prepareLevel(size_t level, const IplImage *levelSource, int width, int height)
+{
+  return prepareLevel(level, levelSource, Rect<int>(0, 0, levelSource->width, levelSource->height), width, height);
+}
+
+// Resizes the region of the level source to width x height and binds the classifier to the 
+// pool of the result. Levels of a shared MultiScaleImagePool are prepared once per frame for 
+// all detectors using it, other contexts keep the level in their own pyramid. The pool computes 
+// channels on access and parallel workers only read it, so the classifier is re-bound here, 
+// before the scan of the level
+IplImage * objed::ScanContext::prepareLevel(size_t level, const IplImage *levelSource, const Rect<int> &region, int width, int height)
+{
+  MultiScaleImagePool *scaledPools = dynamic_cast<MultiScaleImagePool *>(imagePool);
+  ImagePool *levelPool = imagePool;
+  IplImage *scaledImage = 0;
+
+  if (scaledPools != 0)
+  {
+    levelPool = scaledPools->level(levelSource, region, width, height);
+    scaledImage = levelPool->base();
+  }
+  else
+  {
+    scaledImage = pyramid.level(level, levelSource, region, width, height);
+    levelPool->update(scaledImage);
+  }
+
+  classifier->prepare(levelPool);
+  return scaledImage;
+}
+
+void objed::ScanContext::startCachedFrame()
+{
+  // Frames of a shared pool are started by its owner (see MultiDetector)
+  if (dynamic_cast<MultiScaleImagePool *>(imagePool) != 0)
+    return;
+
+  if (levelPools == 0)
+    levelPools = new MultiScaleImagePool();
+  levelPools->startFrame();
+}
+
+// Cached levels are only scaled here, the classifier is bound by prepareCachedLevel
+IplImage * objed::ScanContext::cachedLevel(const IplImage *image, int width, int height)
+{
+  return cachedLevelPool(image, width, height)->base();
+}
+
+IplImage * objed::ScanContext::prepareCachedLevel(const IplImage *image, int width, int height)
+{
+  ImagePool *levelPool = cachedLevelPool(image, width, height);
+  classifier->prepare(levelPool);
+  return levelPool->base();
+}
+
+objed::ImagePool * objed::ScanContext::cachedLevelPool(const IplImage *image, int width, int height)
+{
+  MultiScaleImagePool *scaledPools = dynamic_cast<MultiScaleImagePool *>(imagePool);
+  if (scaledPools == 0)
+    scaledPools = levelPools;
+  assert(scaledPools != 0);
+
+  return scaledPools->level(image, Rect<int>(0, 0, image->width, image->height), width, height);
+}
+
+objed::Classifier * objed::createSharedClassifier(const Json::Value &data, const std::string &workDir)
+{
+  Classifier *classifier = Classifier::create(data, workDir);
+  if (classifier == 0 || classifier->type() == BinaryClassifier::typeStatic())
+    return classifier;
+
+  Classifier *binaryClassifier = BinaryClassifier::compile(classifier);
+  if (binaryClassifier == 0)
+    return classifier;
+
+  Classifier::destroy(classifier);
+  return binaryClassifier;
+}
@@ -33,9 +33,65 @@ either expressed or implied, of copyright holders.
 #ifndef DETECTOR_H_INCLUDED
 #define DETECTOR_H_INCLUDED
 
+#include <objed/objed.h>
+#include <objed/objedutils.h>
+
+#include "imagepool.h"
+
+#include <vector>
+
 namespace objed
 {
-  
+  // Context of detectors scanning one classifier over an image pyramid. It binds a classifier
+  // instance to its image pool: contexts of Detector::createContext() own a clone of the 
+  // detector classifier (see createSharedClassifier), while the context used by 
+  // Detector::detect(image) borrows the detector classifier itself
+  class ScanContext : public DetectionContext
+  {
+    OBJED_DISABLE_COPY(ScanContext)
+
+  public:
+    ScanContext(Classifier *classifier, bool isClassifierOwn, ImagePool *extImagePool);
+    virtual ~ScanContext();
+
+  public:
+    IplImage * prepareLevel(size_t level, const IplImage *levelSource, int width, int height);
+    IplImage * prepareLevel(size_t level, const IplImage *levelSource, const Rect<int> &region, int width, int height);
+
+    // Levels visited out of order (see SimpleDetector::scanBudgeted) are prepared once a frame:
+    // in the shared MultiScaleImagePool if the context has one, otherwise in its own levelPools
+    void startCachedFrame();
+    IplImage * cachedLevel(const IplImage *image, int width, int height);
+    IplImage * prepareCachedLevel(const IplImage *image, int width, int height);
+
+  private:
+    ImagePool * cachedLevelPool(const IplImage *image, int width, int height);
+
+  public:
+    ImagePool *imagePool;
+    bool isImagePoolOwn;
+    Classifier *classifier;
+    bool isClassifierOwn;
+
+  public:
+    ImagePyramid pyramid;
+    MultiScaleImagePool *levelPools;
+    std::vector<Rect<int> > rawDetectionList;
+    std::vector<std::vector<Rect<int> > > blockDetectionLists;
+
+  public:
+    // Coverage of the last detection and, for budgeted scans, smoothed rates of raw 
+    // detections per window of the pyramid levels in the previous frames
+    DetectionCoverage coverage;
+    std::vector<double> levelScores;
+  };
+
+  // Creates the classifier of a detector. Classifiers that BinaryClassifier supports are 
+  // lowered into it: its instances share one copy of the weights and only differ in the 
+  // integrals they are bound to, so every context costs a few pointers whatever the model size.
+  // Its batch evaluation runs the same kernels with the same cascade compaction as the original 
+  // classifiers, so the lowering costs no scanning throughput
+  Classifier * createSharedClassifier(const Json::Value &data, const std::string &workDir);
 }
 
-#endif  // DETECTOR_H_INCLUDED
\ No newline at end of file
+#endif  // DETECTOR_H_INCLUDED
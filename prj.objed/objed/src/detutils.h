@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef DETUTILS_H_INCLUDED
+#define DETUTILS_H_INCLUDED
+
+#include <objed/objed.h>
+#include <objed/objedutils.h>
+#include <objed/objedprofile.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+namespace objed
+{
+  // Number of scanning threads requested by the "threadCount" field (0 means all cores)
+  inline int scanThreadCount(const Json::Value &data)
+  {
+    int threadCount = data.get("threadCount", 1).asInt();
+#ifdef _OPENMP
+    if (threadCount <= 0)
+      threadCount = omp_get_max_threads();
+#else
+    threadCount = 1;
+#endif
+    return std::max(1, threadCount);
+  }
+
+  // Number of positions begin, begin + step, ... below end
+  inline long long gridCount(int begin, int end, int step)
+  {
+    return end > begin ? (end - begin + step - 1) / step : 0;
+  }
+
+  // Clusters raw detections with the exact greedy cluster() or, when the exact order of merging
+  // doesn't matter ("exactClustering": false), in threadCount threads (see clusterParallel)
+  inline DetectionList clusterDetections(const std::vector<Rect<int> > &rawDetectionList, 
+    double overlap, bool exactClustering, int threadCount)
+  {
+    if (exactClustering == true || threadCount <= 1)
+      return cluster(rawDetectionList, overlap);
+    return clusterParallel(rawDetectionList, overlap, threadCount);
+  }
+
+  // Splits rows yBegin, yBegin + yStep, ... (< yEnd) into blocks scanned by threadCount threads.
+  // scanFn(rawDetectionList, yBegin, yEnd) must only read the image pool and the classifier.
+  // Each block collects its own raw detections in blockDetectionLists (kept by the caller
+  // to reuse their capacity); they are appended in row order afterwards.
+  template<class ScanFn> void scanRowsParallel(std::vector<Rect<int> > &rawDetectionList,
+    std::vector<std::vector<Rect<int> > > &blockDetectionLists,
+    int yBegin, int yEnd, int yStep, int threadCount, ScanFn scanFn)
+  {
+    const int rowCount = yEnd > yBegin ? (yEnd - yBegin + yStep - 1) / yStep : 0;
+    const int blockCount = std::min(rowCount, 4 * threadCount);
+    if (blockCount <= 1 || threadCount <= 1)
+    {
+      scanFn(rawDetectionList, yBegin, yEnd);
+      return;
+    }
+
+    if (blockDetectionLists.size() < static_cast<size_t>(blockCount))
+      blockDetectionLists.resize(blockCount);
+    for (int block = 0; block < blockCount; block++)
+      blockDetectionLists[block].clear();
+
+    StageProfile *profile = StageProfile::current();
+
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+    for (int block = 0; block < blockCount; block++)
+    {
+      StageWorkerScope workerScope(profile);
+      const int rowBegin = block * rowCount / blockCount;
+      const int rowEnd = (block + 1) * rowCount / blockCount;
+      scanFn(blockDetectionLists[block], yBegin + rowBegin * yStep, std::min(yEnd, yBegin + rowEnd * yStep));
+    }
+
+    for (int block = 0; block < blockCount; block++)
+      rawDetectionList.insert(rawDetectionList.end(), blockDetectionLists[block].begin(), blockDetectionLists[block].end());
+  }
+}
+
+#endif  // DETUTILS_H_INCLUDED
@@ -30,20 +30,22 @@ either expressed or implied, of copyright holders.
 */
 
 #include "haar1pwcl.h"
+#include "batchutils.h"
 #include "imgutils.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cassert>
 
 objed::Haar1PwClassifier::Haar1PwClassifier(int width, int height) :
-clWidth(width), clHeight(height), integral(0)
+clWidth(width), clHeight(height), integral(0), offsetStep(0)
 {
   assert(clWidth > 0 && clHeight > 0);
   assert(clWidth & 1 && clHeight & 1);
 }
 
 objed::Haar1PwClassifier::Haar1PwClassifier(const Json::Value &data) :
-clWidth(0), clHeight(0), integral(0)
+clWidth(0), clHeight(0), integral(0), offsetStep(0)
 {
   clWidth = data["width"].asInt();
   clHeight = data["height"].asUInt();
@@ -78,6 +80,8 @@ bool objed::Haar1PwClassifier::prepare(ImagePool *imagePool)
 {
   assert(preproc.length() > 0);
   integral = imagePool->integral(preproc);
+  if (integral != 0)
+    bindOffsets();
 
   assert(integral != 0);
   return integral != 0;
@@ -85,10 +89,39 @@ bool objed::Haar1PwClassifier::prepare(ImagePool *imagePool)
 
 bool objed::Haar1PwClassifier::evaluate(float *result, int x, int y, DebugInfo *debugInfo) const
 {
-  *result = bins[compute(integral, x, y) * bins.size() / 256];
+  assert(integral != 0 && integral->imageData != 0);
+  assert(integral->widthStep == offsetStep);
+  *result = bins[compute(x, y) * bins.size() / 256];
   return true;
 }
 
+bool objed::Haar1PwClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  assert(integral != 0 && integral->imageData != 0);
+  assert(bins.empty() == false);
+
+  assert(integral->widthStep == offsetStep);
+
+  const int areas[1] = {rect.width * rect.height};
+  int chunkValues[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+    haarBatch(chunkValues, integral, offsets, areas, 1, false, xs + i, ys + i, count);
+    pwBatch(results + i, alive + i, chunkValues, &bins[0], static_cast<int>(bins.size()), count);
+  }
+
+  return true;
+}
+
+void objed::Haar1PwClassifier::bindOffsets()
+{
+  assert(integral != 0);
+  rectOffsets(offsets, integral, rect.x, rect.y, rect.width, rect.height);
+  offsetStep = integral->widthStep;
+}
+
 Json::Value objed::Haar1PwClassifier::serialize() const
 {
   Json::Value data;
@@ -30,13 +30,15 @@ either expressed or implied, of copyright holders.
 */
 
 #include "haar1stumpcl.h"
+#include "batchutils.h"
 #include "imgutils.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cassert>
 
 objed::Haar1StumpClassifier::Haar1StumpClassifier(int width, int height) :
-clWidth(width), clHeight(height), threshold(0), integral(0)
+clWidth(width), clHeight(height), threshold(0), integral(0), offsetStep(0)
 {
   assert(clWidth > 0 && clHeight > 0);
   assert(clWidth & 1 && clHeight & 1);
@@ -44,7 +46,7 @@ clWidth(width), clHeight(height), threshold(0), integral(0)
 }
 
 objed::Haar1StumpClassifier::Haar1StumpClassifier(const Json::Value &data) :
-clWidth(0), clHeight(0), threshold(0), integral(0)
+clWidth(0), clHeight(0), threshold(0), integral(0), offsetStep(0)
 {
   clWidth = data["width"].asInt();
   clHeight = data["height"].asUInt();
@@ -79,6 +81,8 @@ bool objed::Haar1StumpClassifier::prepare(ImagePool *imagePool)
 {
   assert(preproc.length() > 0);
   integral = imagePool->integral(preproc);
+  if (integral != 0)
+    bindOffsets();
 
   assert(integral != 0);
   return integral != 0;
@@ -86,10 +90,37 @@ bool objed::Haar1StumpClassifier::prepare(ImagePool *imagePool)
 
 bool objed::Haar1StumpClassifier::evaluate(float *result, int x, int y, DebugInfo *debugInfo) const
 {
-  *result = compute(integral, x, y) > threshold ? values[0] : values[1];
+  assert(integral != 0 && integral->imageData != 0);
+  assert(integral->widthStep == offsetStep);
+  *result = compute(x, y) > threshold ? values[0] : values[1];
   return true;
 }
 
+bool objed::Haar1StumpClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  assert(integral != 0 && integral->imageData != 0);
+  assert(integral->widthStep == offsetStep);
+
+  const int areas[1] = {rect.width * rect.height};
+  int chunkValues[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+    haarBatch(chunkValues, integral, offsets, areas, 1, false, xs + i, ys + i, count);
+    stumpBatch(results + i, alive + i, chunkValues, threshold, values, count);
+  }
+
+  return true;
+}
+
+void objed::Haar1StumpClassifier::bindOffsets()
+{
+  assert(integral != 0);
+  rectOffsets(offsets, integral, rect.x, rect.y, rect.width, rect.height);
+  offsetStep = integral->widthStep;
+}
+
 Json::Value objed::Haar1StumpClassifier::serialize() const
 {
   Json::Value data;
@@ -53,6 +53,7 @@ namespace objed
     virtual int height() const;
     virtual bool prepare(ImagePool *imagePool);
     virtual bool evaluate(float *result, int x, int y, DebugInfo *debugInfo) const;
+    virtual bool evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
     virtual Json::Value serialize() const;
     virtual Classifier * clone() const;
 
@@ -63,9 +64,22 @@ namespace objed
       return rectAver(integral, x0, y0, rect.width, rect.height);
     }
 
+    inline int compute(int x, int y) const
+    {
+      const int *origin = integralOrigin(integral, x, y);
+      return rectSum(origin, offsets) / (rect.width * rect.height);
+    }
+
+  private:
+    void bindOffsets();
+
   public:
     const IplImage *integral;
 
+  private:
+    int offsetStep;
+    int offsets[4];
+
   public:
     int clWidth, clHeight;
     std::string preproc;
@@ -53,6 +53,7 @@ namespace objed
     virtual int height() const;
     virtual bool prepare(ImagePool *imagePool);
     virtual bool evaluate(float *result, int x, int y, DebugInfo *debugInfo) const;
+    virtual bool evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
     virtual Json::Value serialize() const;
     virtual Classifier * clone() const;
 
@@ -63,7 +64,18 @@ namespace objed
       int x1 = x + rect1.x, y1 = y + rect1.y;
       int sum0 = rectSum(integral, x0, y0, rect0.width, rect0.height);
       int sum1 = rectSum(integral, x1, y1, rect1.width, rect1.height);
+      return combine(sum0, sum1);
+    }
+
+    inline int compute(int x, int y) const
+    {
+      const int *origin = integralOrigin(integral, x, y);
+      return combine(rectSum(origin, offsets + 0), rectSum(origin, offsets + 4));
+    }
 
+  private:
+    inline int combine(int sum0, int sum1) const
+    {
       if (normalize == true)
       {
         return 255 * sum0 / (sum0 + sum1 + 1);
@@ -75,9 +87,15 @@ namespace objed
       }
     }
 
+    void bindOffsets();
+
   public:
     const IplImage *integral;
 
+  private:
+    int offsetStep;
+    int offsets[8];
+
   public:
     int clWidth, clHeight;
     Rect<int> rect0, rect1;
@@ -30,13 +30,15 @@ either expressed or implied, of copyright holders.
 */
 
 #include "haar2stumpcl.h"
+#include "batchutils.h"
 #include "imgutils.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cassert>
 
 objed::Haar2StumpClassifier::Haar2StumpClassifier(int width, int height) : 
-clWidth(width), clHeight(height), threshold(0), normalize(false), integral(0)
+clWidth(width), clHeight(height), threshold(0), normalize(false), integral(0), offsetStep(0)
 {
   assert(clWidth > 0 && clHeight > 0);
   assert(clWidth & 1 && clHeight & 1);
@@ -44,7 +46,7 @@ clWidth(width), clHeight(height), threshold(0), normalize(false), integral(0)
 }
 
 objed::Haar2StumpClassifier::Haar2StumpClassifier(const Json::Value &data) : 
-clWidth(0), clHeight(0), threshold(0), normalize(false), integral(0)
+clWidth(0), clHeight(0), threshold(0), normalize(false), integral(0), offsetStep(0)
 {
   clWidth = data["width"].asInt();
   clHeight = data["height"].asInt();
@@ -82,6 +84,8 @@ bool objed::Haar2StumpClassifier::prepare(ImagePool *imagePool)
 {
   assert(preproc.length() > 0);
   integral = imagePool->integral(preproc);
+  if (integral != 0)
+    bindOffsets();
 
   assert(integral != 0);
   return integral != 0;
@@ -89,10 +93,38 @@ bool objed::Haar2StumpClassifier::prepare(ImagePool *imagePool)
 
 bool objed::Haar2StumpClassifier::evaluate(float *result, int x, int y, DebugInfo *debugInfo) const
 {
-  *result = compute(integral, x, y) > threshold ? values[0] : values[1];
+  assert(integral != 0 && integral->imageData != 0);
+  assert(integral->widthStep == offsetStep);
+  *result = compute(x, y) > threshold ? values[0] : values[1];
   return true;
 }
 
+bool objed::Haar2StumpClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  assert(integral != 0 && integral->imageData != 0);
+  assert(integral->widthStep == offsetStep);
+
+  const int areas[2] = {rect0.width * rect0.height, rect1.width * rect1.height};
+  int chunkValues[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+    haarBatch(chunkValues, integral, offsets, areas, 2, normalize, xs + i, ys + i, count);
+    stumpBatch(results + i, alive + i, chunkValues, threshold, values, count);
+  }
+
+  return true;
+}
+
+void objed::Haar2StumpClassifier::bindOffsets()
+{
+  assert(integral != 0);
+  rectOffsets(offsets + 0, integral, rect0.x, rect0.y, rect0.width, rect0.height);
+  rectOffsets(offsets + 4, integral, rect1.x, rect1.y, rect1.width, rect1.height);
+  offsetStep = integral->widthStep;
+}
+
 Json::Value objed::Haar2StumpClassifier::serialize() const
 {
   Json::Value data;
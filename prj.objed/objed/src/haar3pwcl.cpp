@@ -30,20 +30,22 @@ either expressed or implied, of copyright holders.
 */
 
 #include "haar3pwcl.h"
+#include "batchutils.h"
 #include "imgutils.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cassert>
 
 objed::Haar3PwClassifier::Haar3PwClassifier(int width, int height):
-clWidth(width), clHeight(height), normalize(false), integral(0)
+clWidth(width), clHeight(height), normalize(false), integral(0), offsetStep(0)
 {
   assert(clWidth > 0 && clHeight > 0);
   assert(clWidth & 1 && clHeight & 1);
 }
 
 objed::Haar3PwClassifier::Haar3PwClassifier(const Json::Value &data) :
-clWidth(0), clHeight(0), normalize(false), integral(0)
+clWidth(0), clHeight(0), normalize(false), integral(0), offsetStep(0)
 {
   clWidth = data["width"].asInt();
   clHeight = data["height"].asUInt();
@@ -81,6 +83,8 @@ bool objed::Haar3PwClassifier::prepare(ImagePool *imagePool)
 {
   assert(preproc.length() > 0);
   integral = imagePool->integral(preproc);
+  if (integral != 0)
+    bindOffsets();
 
   assert(integral != 0);
   return integral != 0;
@@ -88,10 +92,41 @@ bool objed::Haar3PwClassifier::prepare(ImagePool *imagePool)
 
 bool objed::Haar3PwClassifier::evaluate(float *result, int x, int y, DebugInfo *debugInfo) const
 {
-  *result = bins[compute(integral, x, y) * bins.size() / 256];
+  assert(integral != 0 && integral->imageData != 0);
+  assert(integral->widthStep == offsetStep);
+  *result = bins[compute(x, y) * bins.size() / 256];
   return true;
 }
 
+bool objed::Haar3PwClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  assert(integral != 0 && integral->imageData != 0);
+  assert(bins.empty() == false);
+
+  assert(integral->widthStep == offsetStep);
+
+  const int areas[3] = {rect0.width * rect0.height, rect1.width * rect1.height, rect2.width * rect2.height};
+  int chunkValues[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+    haarBatch(chunkValues, integral, offsets, areas, 3, normalize, xs + i, ys + i, count);
+    pwBatch(results + i, alive + i, chunkValues, &bins[0], static_cast<int>(bins.size()), count);
+  }
+
+  return true;
+}
+
+void objed::Haar3PwClassifier::bindOffsets()
+{
+  assert(integral != 0);
+  rectOffsets(offsets + 0, integral, rect0.x, rect0.y, rect0.width, rect0.height);
+  rectOffsets(offsets + 4, integral, rect1.x, rect1.y, rect1.width, rect1.height);
+  rectOffsets(offsets + 8, integral, rect2.x, rect2.y, rect2.width, rect2.height);
+  offsetStep = integral->widthStep;
+}
+
 Json::Value objed::Haar3PwClassifier::serialize() const
 {
   Json::Value data;
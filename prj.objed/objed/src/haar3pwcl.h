@@ -53,6 +53,7 @@ namespace objed
     virtual int height() const;
     virtual bool prepare(ImagePool *imagePool);
     virtual bool evaluate(float *result, int x, int y, DebugInfo *debugInfo) const;
+    virtual bool evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
     virtual Json::Value serialize() const;
     virtual Classifier * clone() const;
 
@@ -65,7 +66,18 @@ namespace objed
       int sum0 = rectSum(integral, x0, y0, rect0.width, rect0.height);
       int sum1 = rectSum(integral, x1, y1, rect1.width, rect1.height);
       int sum2 = rectSum(integral, x2, y2, rect2.width, rect2.height);
+      return combine(sum0, sum1, sum2);
+    }
+
+    inline int compute(int x, int y) const
+    {
+      const int *origin = integralOrigin(integral, x, y);
+      return combine(rectSum(origin, offsets + 0), rectSum(origin, offsets + 4), rectSum(origin, offsets + 8));
+    }
 
+  private:
+    inline int combine(int sum0, int sum1, int sum2) const
+    {
       if (normalize == true)
       {
         return 255 * (sum0 + sum2) / (sum0 + sum1 + sum2 + 1);
@@ -77,9 +89,15 @@ namespace objed
       }
     }
 
+    void bindOffsets();
+
   public:
     const IplImage *integral;
 
+  private:
+    int offsetStep;
+    int offsets[12];
+
   public:
     int clWidth, clHeight;
     Rect<int> rect0, rect1, rect2;
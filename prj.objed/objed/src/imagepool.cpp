@@ -32,9 +32,12 @@ either expressed or implied, of copyright holders.
 #include "imgutils.h"
 #include "imagepool.h"
 
+#include <objed/objedprofile.h>
+
 #include <opencv/cv.h>
 
 #include <cstring>
+#include <tuple>
 #include <cassert>
 
 static const std::string METHOD_GRAY         = "gray";
@@ -45,15 +48,56 @@ static const std::string METHOD_CANNY        = "canny";
 static const std::string METHOD_RAWCANNY     = "rawCanny";
 static const std::string METHOD_FILTER       = "filter";
 static const std::string METHOD_NOSALT       = "noSalt";
+static const std::string METHOD_INTEGRAL     = "integral";
+
+// Images computed by a single call of PrepareGradientImages
+static const int GRADIENT_METHOD_COUNT = 7;
+static const std::string GRADIENT_METHODS[GRADIENT_METHOD_COUNT] = {
+  "gradient0", "gradient1", "gradient2", "canny0", "canny1", "canny2", "rawCanny"
+};
+
+// Header of the region of the image sharing its data
+static IplImage regionHeader(const IplImage *image, const objed::Rect<int> &region)
+{
+  IplImage header;
+  cvInitImageHeader(&header, cvSize(region.width, region.height), image->depth, image->nChannels, image->origin);
+  header.imageData = image->imageData + region.y * image->widthStep + region.x * image->nChannels * ((image->depth & 255) / 8);
+  header.widthStep = image->widthStep;
+  return header;
+}
+
+static bool isGradientMethod(const std::string &method)
+{
+  for (int i = 0; i < GRADIENT_METHOD_COUNT; i++)
+    if (method == GRADIENT_METHODS[i]) return true;
+  return false;
+}
+
+// Number of pool updates an image or integral may stay unaccessed before its data is released
+static const unsigned int EVICTION_AGE = 16;
+
+static void updateIntegralItem(objed::ImagePoolItem *integralItem, IplImage *image)
+{
+  if (integralItem == 0 || image == 0 || image->imageData == 0)
+    return;
+
+  IplImage *integral = integralItem->image(image->width + 1, image->height + 1, image->nChannels, IPL_DEPTH_32S);
+  objed::PrepareIntegralImage(integral, image);
+}
 
-static void updateImageItem(objed::ImagePoolItem *imageItem, const std::string &method, IplImage *image)
+// The integral of the image, if given, is computed along with it
+static void updateImageItem(objed::ImagePoolItem *imageItem, const std::string &method, IplImage *image,
+  objed::ImagePoolItem *integralItem = 0)
 {
   if (imageItem == 0 || image == 0 || image->imageData == 0)
     return;
 
   if (method.compare(0, METHOD_GRAY.length(), METHOD_GRAY) == 0)
   {
-    objed::PrepareGrayImage(imageItem->image(image->width, image->height, 1, IPL_DEPTH_8U), image);
+    IplImage *grayImage = imageItem->image(image->width, image->height, 1, IPL_DEPTH_8U);
+    IplImage *grayIntegral = integralItem != 0 ? integralItem->image(image->width + 1, image->height + 1, 1, IPL_DEPTH_32S) : 0;
+    objed::PrepareGrayImage(grayImage, image, grayIntegral);
+    return;
   }
   else if (method.compare(0, METHOD_SATURATION.length(), METHOD_SATURATION) == 0)
   {
@@ -91,15 +135,8 @@ static void updateImageItem(objed::ImagePoolItem *imageItem, const std::string &
   {
     assert(false);
   }
-}
-
-static void updateIntegralItem(objed::ImagePoolItem *integralItem, IplImage *image)
-{
-  if (integralItem == 0 || image == 0 || image->imageData == 0)
-    return;
 
-  IplImage *integral = integralItem->image(image->width + 1, image->height + 1, image->nChannels, IPL_DEPTH_32S);
-  cvIntegral(image, integral);
+  updateIntegralItem(integralItem, imageItem->image());
 }
 
 objed::ImagePoolItem::ImagePoolItem()
@@ -118,7 +155,7 @@ objed::ImagePoolItem::~ImagePoolItem()
 
 IplImage * objed::ImagePoolItem::image(int width, int height, int channels, int depth)
 {
-  if (sourceImage == 0 || sourceImage->width < width || sourceImage->height < height ||
+  if (sourceImage->imageData == 0 || sourceImage->width < width || sourceImage->height < height ||
     sourceImage->depth != depth || sourceImage->nChannels != channels)
   {
     if (sourceImage->imageData != 0)
@@ -144,7 +181,52 @@ IplImage * objed::ImagePoolItem::image() const
   return regionImage;
 }
 
-objed::ImagePoolImpl::ImagePoolImpl()
+void objed::ImagePoolItem::invalidate()
+{
+  regionImage->imageData = 0;
+}
+
+void objed::ImagePoolItem::release()
+{
+  if (sourceImage->imageData != 0)
+    cvReleaseData(sourceImage);
+  sourceImage->imageData = 0;
+  regionImage->imageData = 0;
+}
+
+objed::ImagePoolEntry::ImagePoolEntry(const std::string &id, const std::string &method, ImagePoolEntry *parent) :
+id(id), method(method), parent(parent), generation(0), touched(0), released(false)
+{
+  return;
+}
+
+objed::ImagePyramid::ImagePyramid()
+{
+  return;
+}
+
+objed::ImagePyramid::~ImagePyramid()
+{
+  for (size_t i = 0; i < levelItems.size(); i++)
+    delete levelItems[i];
+  levelItems.clear();
+}
+
+// Resizes the region of the image into the buffer of the level, which is kept between 
+// frames and reallocated only when the level grows
+IplImage * objed::ImagePyramid::level(size_t index, const IplImage *image, const Rect<int> &region, int width, int height)
+{
+  while (levelItems.size() <= index)
+    levelItems.push_back(new ImagePoolItem());
+
+  StageTimer timer(StageProfile::STAGE_RESIZE);
+  IplImage sourceRegion = regionHeader(image, region);
+  IplImage *levelImage = levelItems[index]->image(width, height, image->nChannels, image->depth);
+  cvResize(&sourceRegion, levelImage);
+  return levelImage;
+}
+
+objed::ImagePoolImpl::ImagePoolImpl() : generation(1)
 {
   baseItem = new ImagePoolItem();
 }
@@ -153,103 +235,344 @@ objed::ImagePoolImpl::~ImagePoolImpl()
 {
   delete baseItem;
 
-  std::map<std::string, ImagePoolItem *>::iterator itImageItem;
-  for (itImageItem = imageItems.begin(); itImageItem != imageItems.end(); ++itImageItem)
-    delete itImageItem->second;
-  imageItems.clear();
+  std::map<std::string, ImagePoolEntry *>::iterator itIntegralEntry;
+  for (itIntegralEntry = integralEntries.begin(); itIntegralEntry != integralEntries.end(); ++itIntegralEntry)
+    delete itIntegralEntry->second;
+  integralEntries.clear();
 
-  std::map<std::string, ImagePoolItem *>::iterator itIntegralItem;
-  for (itIntegralItem = integralItems.begin(); itIntegralItem != integralItems.end(); ++itIntegralItem)
-    delete itIntegralItem->second;
-  integralItems.clear();
+  std::map<std::string, ImagePoolEntry *>::iterator itImageEntry;
+  for (itImageEntry = imageEntries.begin(); itImageEntry != imageEntries.end(); ++itImageEntry)
+    delete itImageEntry->second;
+  imageEntries.clear();
 }
 
+// Only the base image is copied here; derived images and integrals are recomputed on
+// their first access after the update (see compute). Until then their headers have no
+// data, so a classifier bound before the update and not prepared again fails on its
+// first read instead of reading the previous image
 bool objed::ImagePoolImpl::update(IplImage *image)
 {
-  cvCopy(image, baseItem->image(image->width, image->height, image->nChannels, image->depth));
+  StageTimer timer(StageProfile::STAGE_UPDATE);
+  cvCopy(image, update(image->width, image->height, image->nChannels, image->depth));
+  return true;
+}
+
+// Same as update(image) for callers producing the image in place: returns the base
+// image of the given format, which the caller fills before requesting any entry
+IplImage * objed::ImagePoolImpl::update(int width, int height, int channels, int depth)
+{
+  generation++;
+  invalidate(integralEntries);
+  invalidate(imageEntries);
+
+  return baseItem->image(width, height, channels, depth);
+}
+
+IplImage *objed::ImagePoolImpl::integral(const std::string &id)
+{
+  ImagePoolEntry *&integralEntry = integralEntries[id];
+  if (integralEntry == 0)
+    integralEntry = new ImagePoolEntry(id, METHOD_INTEGRAL, imageEntry(id));
+
+  StageTimer timer(StageProfile::STAGE_UPDATE);
+  return compute(integralEntry);
+}
+
+IplImage *objed::ImagePoolImpl::image(const std::string &id)
+{
+  StageTimer timer(StageProfile::STAGE_UPDATE);
+  return compute(imageEntry(id));
+}
+
+IplImage *objed::ImagePoolImpl::base()
+{
+  return baseItem->image();
+}
+
+std::vector<std::string> objed::ImagePoolImpl::imageNames() const
+{
+  std::vector<std::string> names;
+
+  std::map<std::string, ImagePoolEntry *>::const_iterator it;
+  for (it = imageEntries.begin(); it != imageEntries.end(); ++it)
+  {
+    if (it->second->released == false)
+      names.push_back(it->first);
+  }
+
+  return names;
+}
+
+std::vector<std::string> objed::ImagePoolImpl::integralNames() const
+{
+  std::vector<std::string> names;
 
-  std::map<std::string, ImagePoolItem *>::iterator itImageItem;
-  for (itImageItem = imageItems.begin(); itImageItem != imageItems.end(); ++itImageItem)
+  std::map<std::string, ImagePoolEntry *>::const_iterator it;
+  for (it = integralEntries.begin(); it != integralEntries.end(); ++it)
   {
-    const std::string &id = itImageItem->first;
-    ImagePoolItem *imageItem = itImageItem->second;
+    if (it->second->released == false)
+      names.push_back(it->first);
+  }
 
+  return names;
+}
+
+// Entry of the image with the given id; entries of all its predecessors
+// ("gray" for "gray|gradient1") are created as well
+objed::ImagePoolEntry * objed::ImagePoolImpl::imageEntry(const std::string &id)
+{
+  ImagePoolEntry *&entry = imageEntries[id];
+  if (entry == 0)
+  {
     size_t sepPos = id.rfind("|");
     std::string method = sepPos >= std::string::npos ? id : id.substr(sepPos + 1);
     std::string subid = sepPos >= std::string::npos ? std::string() : id.substr(0, sepPos);
 
-    if (method.empty() || subid.empty())
-      updateImageItem(imageItem, method, image);
-    else
-      updateImageItem(imageItem, method, imageItems[subid]->image());
+    ImagePoolEntry *parent = (method.empty() || subid.empty()) ? 0 : imageEntry(subid);
+    entry = new ImagePoolEntry(id, method, parent);
   }
 
-  std::map<std::string, ImagePoolItem *>::iterator itIntegralItem;
-  for (itIntegralItem = integralItems.begin(); itIntegralItem != integralItems.end(); ++itIntegralItem)
+  return entry;
+}
+
+// Brings the entry up to date with the base image, recomputing stale predecessors first.
+// An entry is marked up to date only once its data has been computed
+IplImage * objed::ImagePoolImpl::compute(ImagePoolEntry *entry)
+{
+  assert(entry != 0);
+
+  for (ImagePoolEntry *touchedEntry = entry; touchedEntry != 0 && touchedEntry->touched != generation;
+    touchedEntry = touchedEntry->parent)
   {
-    const std::string &id = itIntegralItem->first;
-    ImagePoolItem *integralItem = itIntegralItem->second;
+    touchedEntry->touched = generation;
+  }
 
-    updateIntegralItem(integralItem, imageItems[id]->image());
+  if (entry->generation != generation)
+  {
+    IplImage *source = entry->parent != 0 ? compute(entry->parent) : baseItem->image();
+    if (source == 0 || source->imageData == 0)
+      return entry->item.image();
+
+    // An integral is usually built together with its image, while computing the parent
+    if (entry->generation == generation)
+      return entry->item.image();
+
+    entry->released = false;
+    if (entry->method == METHOD_INTEGRAL)
+    {
+      updateIntegralItem(&entry->item, source);
+    }
+    else if (isGradientMethod(entry->method) == true)
+    {
+      computeGradients(source, entry->id.substr(0, entry->id.length() - entry->method.length()));
+    }
+    else
+    {
+      ImagePoolEntry *integralEntry = staleIntegral(entry->id);
+      updateImageItem(&entry->item, entry->method, source, integralEntry != 0 ? &integralEntry->item : 0);
+      if (integralEntry != 0)
+        integralEntry->generation = generation;
+    }
+    entry->generation = generation;
   }
 
-  return true;
+  return entry->item.image();
 }
 
-IplImage *objed::ImagePoolImpl::integral(const std::string &id)
+// Stale gradient and Canny images of the same gray image (ids "<prefix>gradient1",
+// "<prefix>canny2", ...) are computed together with their integrals in a single pass over it.
+// Released siblings are left alone, unless it is the requested one (see compute)
+void objed::ImagePoolImpl::computeGradients(IplImage *grayImage, const std::string &prefix)
 {
-  ImagePoolItem *&integralItem = integralItems[id];
-  if (integralItem == 0)
+  GradientImages images;
+  IplImage **outputs[GRADIENT_METHOD_COUNT][2] = {
+    {&images.gradient[0], &images.gradientIntegral[0]},
+    {&images.gradient[1], &images.gradientIntegral[1]},
+    {&images.gradient[2], &images.gradientIntegral[2]},
+    {&images.canny[0], &images.cannyIntegral[0]},
+    {&images.canny[1], &images.cannyIntegral[1]},
+    {&images.canny[2], &images.cannyIntegral[2]},
+    {&images.rawCanny, &images.rawCannyIntegral}
+  };
+
+  ImagePoolEntry *computedEntries[GRADIENT_METHOD_COUNT][2] = {};
+  for (int i = 0; i < GRADIENT_METHOD_COUNT; i++)
+  {
+    const std::string id = prefix + GRADIENT_METHODS[i];
+    std::map<std::string, ImagePoolEntry *>::iterator itEntry = imageEntries.find(id);
+    if (itEntry == imageEntries.end() || itEntry->second->generation == generation || itEntry->second->released == true)
+      continue;
+
+    computedEntries[i][0] = itEntry->second;
+    *outputs[i][0] = itEntry->second->item.image(grayImage->width, grayImage->height, 1, IPL_DEPTH_8U);
+
+    computedEntries[i][1] = staleIntegral(id);
+    if (computedEntries[i][1] != 0)
+      *outputs[i][1] = computedEntries[i][1]->item.image(grayImage->width + 1, grayImage->height + 1, 1, IPL_DEPTH_32S);
+  }
+
+  objed::PrepareGradientImages(images, grayImage, &gradientLines);
+
+  for (int i = 0; i < GRADIENT_METHOD_COUNT; i++)
   {
-    integralItem = new ImagePoolItem();
-    updateIntegralItem(integralItem, image(id));
+    for (int j = 0; j < 2; j++)
+    {
+      if (computedEntries[i][j] != 0)
+        computedEntries[i][j]->generation = generation;
+    }
   }
+}
 
-  return integralItem->image();
+// Integral entry of the image that is about to be recomputed, if it is stale as well and
+// still holds data; it is then built along with the image (the caller marks it up to date)
+objed::ImagePoolEntry * objed::ImagePoolImpl::staleIntegral(const std::string &id)
+{
+  std::map<std::string, ImagePoolEntry *>::iterator itEntry = integralEntries.find(id);
+  if (itEntry == integralEntries.end() || itEntry->second->generation == generation || itEntry->second->released == true)
+    return 0;
+
+  return itEntry->second;
 }
 
-IplImage *objed::ImagePoolImpl::image(const std::string &id)
+// Detaches the data of all entries from their headers after an update. Data of entries not
+// accessed during the last EVICTION_AGE updates is released. Entries themselves are kept for 
+// the life of the pool: classifiers may still hold their headers, which then have no data 
+// instead of dangling
+void objed::ImagePoolImpl::invalidate(std::map<std::string, ImagePoolEntry *> &entries)
 {
-  ImagePoolItem *&imageItem = imageItems[id];
-  if (imageItem == 0)
+  std::map<std::string, ImagePoolEntry *>::iterator itEntry;
+  for (itEntry = entries.begin(); itEntry != entries.end(); ++itEntry)
   {
-    size_t sepPos = id.rfind("|");
-    std::string method = sepPos >= std::string::npos ? id : id.substr(sepPos + 1);
-    std::string subid = sepPos >= std::string::npos ? std::string() : id.substr(0, sepPos);
-
-    imageItem = new ImagePoolItem();
-    if (method.empty() || subid.empty())
-      updateImageItem(imageItem, method, baseItem->image());
-    else
-      updateImageItem(imageItem, method, image(subid));
+    ImagePoolEntry *entry = itEntry->second;
+    if (entry->released == false && generation - entry->touched > EVICTION_AGE)
+    {
+      entry->item.release();
+      entry->released = true;
+    }
+    entry->item.invalidate();
   }
+}
 
-  return imageItem->image();
+objed::ImagePoolLevelKey::ImagePoolLevelKey(const ImagePoolLevel *source, const Rect<int> &region, int width, int height) :
+  source(source), region(region), width(width), height(height)
+{
+  return;
 }
 
-IplImage *objed::ImagePoolImpl::base()
+bool objed::ImagePoolLevelKey::operator<(const ImagePoolLevelKey &other) const
 {
-  return baseItem->image();
+  return std::tie(source, region.x, region.y, region.width, region.height, width, height) <
+    std::tie(other.source, other.region.x, other.region.y, other.region.width, other.region.height, other.width, other.height);
 }
 
-std::vector<std::string> objed::ImagePoolImpl::imageNames() const
+objed::MultiScaleImagePool::MultiScaleImagePool() : frame(1), frameDepth(0)
 {
-  std::vector<std::string> names;
+  return;
+}
 
-  std::map<std::string, ImagePoolItem *>::const_iterator it;
-  for (it = imageItems.begin(); it != imageItems.end(); ++it)
-    names.push_back(it->first);
+objed::MultiScaleImagePool::~MultiScaleImagePool()
+{
+  std::map<ImagePoolLevelKey, ImagePoolLevel *>::iterator itLevel;
+  for (itLevel = levels.begin(); itLevel != levels.end(); ++itLevel)
+    delete itLevel->second;
+  levels.clear();
+  levelBases.clear();
+}
 
-  return names;
+bool objed::MultiScaleImagePool::update(IplImage *image)
+{
+  return basePool.update(image);
 }
 
-std::vector<std::string> objed::ImagePoolImpl::integralNames() const
+IplImage * objed::MultiScaleImagePool::integral(const std::string &id)
 {
-  std::vector<std::string> names;
+  return basePool.integral(id);
+}
+
+IplImage * objed::MultiScaleImagePool::image(const std::string &id)
+{
+  return basePool.image(id);
+}
 
-  std::map<std::string, ImagePoolItem *>::const_iterator it;
-  for (it = integralItems.begin(); it != integralItems.end(); ++it)
-    names.push_back(it->first);
+IplImage * objed::MultiScaleImagePool::base()
+{
+  return basePool.base();
+}
 
-  return names;
+std::vector<std::string> objed::MultiScaleImagePool::imageNames() const
+{
+  return basePool.imageNames();
+}
+
+std::vector<std::string> objed::MultiScaleImagePool::integralNames() const
+{
+  return basePool.integralNames();
+}
+
+// Invalidates all levels; levels not used during the previous frame are released. A level
+// is only reached through its source, so no remaining level is keyed by a released one
+void objed::MultiScaleImagePool::startFrame()
+{
+  frame++;
+
+  std::map<ImagePoolLevelKey, ImagePoolLevel *>::iterator itLevel = levels.begin();
+  while (itLevel != levels.end())
+  {
+    if (frame - itLevel->second->frame > 1)
+    {
+      levelBases.erase(itLevel->second->pool.base());
+      delete itLevel->second;
+      levels.erase(itLevel++);
+    }
+    else
+    {
+      ++itLevel;
+    }
+  }
+}
+
+// Pools shared by nested detectors (see MultiDetector) are framed by every user, while only
+// the outermost one starts a frame, so inner users keep the levels prepared for the frame
+void objed::MultiScaleImagePool::beginFrame()
+{
+  if (frameDepth++ == 0)
+    startFrame();
+}
+
+void objed::MultiScaleImagePool::endFrame()
+{
+  assert(frameDepth > 0);
+  frameDepth--;
+}
+
+// Pool of the region of the image resized to width x height, updated once per frame by the 
+// first caller. Levels are keyed by their source as well, so detectors building pyramids from 
+// the previous level or from bands of the frame never share a resize of another source
+objed::ImagePool * objed::MultiScaleImagePool::level(const IplImage *image, const Rect<int> &region, int width, int height)
+{
+  ImagePoolLevelKey key(sourceLevel(image), region, width, height);
+  ImagePoolLevel *&poolLevel = levels[key];
+  if (poolLevel == 0)
+  {
+    poolLevel = new ImagePoolLevel();
+    levelBases[poolLevel->pool.base()] = poolLevel;
+  }
+
+  if (poolLevel->frame != frame)
+  {
+    StageTimer timer(StageProfile::STAGE_RESIZE);
+    IplImage sourceRegion = regionHeader(image, region);
+    cvResize(&sourceRegion, poolLevel->pool.update(width, height, image->nChannels, image->depth));
+    poolLevel->frame = frame;
+  }
+
+  return &poolLevel->pool;
+}
+
+// Level whose base is the image, or null for any other (frame) image. Base headers of the
+// levels are allocated once, so they identify the levels for their lifetime
+const objed::ImagePoolLevel * objed::MultiScaleImagePool::sourceLevel(const IplImage *image)
+{
+  std::map<const IplImage *, ImagePoolLevel *>::const_iterator itBase = levelBases.find(image);
+  return itBase != levelBases.end() ? itBase->second : 0;
 }
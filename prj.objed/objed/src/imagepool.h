@@ -35,6 +35,8 @@ either expressed or implied, of copyright holders.
 
 #include <objed/objed.h>
 
+#include "imgutils.h"
+
 #include <string>
 #include <vector>
 #include <map>
@@ -54,11 +56,53 @@ namespace objed
   public:
     IplImage * image(int width, int height, int channels, int depth);
     IplImage * image() const;
+    // Both keep the header returned by image(), only its data is detached (until the next
+    // image(width, height, ...) call) or released
+    void invalidate();
+    void release();
 
   private:
     IplImage *regionImage, *sourceImage;
   };
 
+  // Node of the preprocessing graph of ImagePoolImpl: an image derived from its parent
+  // (or from the base image) by the method, or the integral of its parent image
+  class ImagePoolEntry
+  {
+  public:
+    ImagePoolEntry(const std::string &id, const std::string &method, ImagePoolEntry *parent);
+
+  private:
+    ImagePoolEntry(const ImagePoolEntry &);
+    ImagePoolEntry &operator=(const ImagePoolEntry &);
+
+  public:
+    ImagePoolItem item;
+    std::string id;
+    std::string method;
+    ImagePoolEntry *parent;
+    unsigned int generation;
+    unsigned int touched;
+    bool released;
+  };
+
+  class ImagePyramid
+  {
+  public:
+    ImagePyramid();
+    virtual ~ImagePyramid();
+
+  private:
+    ImagePyramid(const ImagePyramid &);
+    ImagePyramid &operator=(const ImagePyramid &);
+
+  public:
+    IplImage * level(size_t index, const IplImage *image, const Rect<int> &region, int width, int height);
+
+  private:
+    std::vector<ImagePoolItem *> levelItems;
+  };
+
   class ImagePoolImpl : public ImagePool
   {
   public:
@@ -78,10 +122,91 @@ namespace objed
     virtual std::vector<std::string> imageNames() const;
     virtual std::vector<std::string> integralNames() const;
 
+  public:
+    IplImage * update(int width, int height, int channels, int depth);
+
+  private:
+    ImagePoolEntry * imageEntry(const std::string &id);
+    IplImage * compute(ImagePoolEntry *entry);
+    void computeGradients(IplImage *grayImage, const std::string &prefix);
+    ImagePoolEntry * staleIntegral(const std::string &id);
+    void invalidate(std::map<std::string, ImagePoolEntry *> &entries);
+
   private:
     ImagePoolItem *baseItem;
-    std::map<std::string, ImagePoolItem *> imageItems;
-    std::map<std::string, ImagePoolItem *> integralItems;
+    std::map<std::string, ImagePoolEntry *> imageEntries;
+    std::map<std::string, ImagePoolEntry *> integralEntries;
+    GradientLines gradientLines;
+    unsigned int generation;
+  };
+
+  class ImagePoolLevel
+  {
+  public:
+    ImagePoolLevel() : frame(0) {}
+
+  private:
+    ImagePoolLevel(const ImagePoolLevel &);
+    ImagePoolLevel &operator=(const ImagePoolLevel &);
+
+  public:
+    ImagePoolImpl pool;
+    unsigned int frame;
+  };
+
+  // Identity of a level of MultiScaleImagePool: the region of its source (another level of 
+  // the pool or, when source is null, the frame) resized to width x height
+  class ImagePoolLevelKey
+  {
+  public:
+    ImagePoolLevelKey(const ImagePoolLevel *source, const Rect<int> &region, int width, int height);
+
+  public:
+    bool operator<(const ImagePoolLevelKey &other) const;
+
+  public:
+    const ImagePoolLevel *source;
+    Rect<int> region;
+    int width, height;
+  };
+
+  // Holds one preprocessed pool per scaled source region (see ImagePoolLevelKey) so that
+  // detectors sharing it (see MultiDetector) reuse the levels of each other.
+  // The ImagePool interface itself refers to the base pool.
+  class MultiScaleImagePool : public ImagePool
+  {
+  public:
+    MultiScaleImagePool();
+    virtual ~MultiScaleImagePool();
+
+  private:
+    MultiScaleImagePool(const MultiScaleImagePool &);
+    MultiScaleImagePool &operator=(const MultiScaleImagePool &);
+
+  public:
+    virtual bool update(IplImage *image);
+    virtual IplImage *integral(const std::string &id);
+    virtual IplImage *image(const std::string &id);
+    virtual IplImage *base();
+
+    virtual std::vector<std::string> imageNames() const;
+    virtual std::vector<std::string> integralNames() const;
+
+  public:
+    void startFrame();
+    void beginFrame();
+    void endFrame();
+    ImagePool * level(const IplImage *image, const Rect<int> &region, int width, int height);
+
+  private:
+    const ImagePoolLevel * sourceLevel(const IplImage *image);
+
+  private:
+    ImagePoolImpl basePool;
+    std::map<ImagePoolLevelKey, ImagePoolLevel *> levels;
+    std::map<const IplImage *, ImagePoolLevel *> levelBases;
+    unsigned int frame;
+    int frameDepth;
   };
 }
 
@@ -36,70 +36,331 @@ either expressed or implied, of copyright holders.
 #include <cstring>
 #include <cassert>
 #include <string>
-#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 static const int DIR_0    = 1;
 static const int DIR_45   = 2;
 static const int DIR_90   = 4;
 static const int DIR_135  = 8;
 
-static void GetGradientComponents(IplImage *mx, IplImage *my, IplImage *mg, IplImage *gray)
+// atan(pi / 8) in units of 1 / 65536. For differences of 8-bit images the condition
+// "dya < dxa * atan(pi / 8)" evaluated in floats is exactly "dya * 65536 < dxa * DIR_SLOPE"
+static const int DIR_SLOPE = 24524;
+
+static inline int GradientDirection(int dx, int dy)
+{
+  const int dxa = std::abs(dx), dya = std::abs(dy);
+
+  if (dya * 65536 < dxa * DIR_SLOPE)
+    return DIR_0;
+  else if (dxa * 65536 < dya * DIR_SLOPE)
+    return DIR_90;
+  else if (dx * dy > 0)
+    return DIR_45;
+  else if (dx * dy < 0)
+    return DIR_135;
+  return 0;
+}
+
+// floor(sqrt(value)) for value < 65536, which equals the truncated float magnitude / sqrt(2)
+// computed before for value = (dx * dx + dy * dy) / 2
+static inline int GradientMagnitude(int value)
 {
-  cvSetZero(mx); cvSetImageROI(mx, cvRect(1, 1, gray->width - 2, gray->height - 2));
-  cvSetZero(my); cvSetImageROI(my, cvRect(1, 1, gray->width - 2, gray->height - 2));
+  int root = 0;
+  for (int bit = 128; bit > 0; bit >>= 1)
+    if ((root | bit) * (root | bit) <= value) root |= bit;
+  return root;
+}
 
-  cvSetImageROI(gray, cvRect(2, 1, gray->width - 2, gray->height - 2)); cvAdd(mx, gray, mx);
-  cvSetImageROI(gray, cvRect(0, 1, gray->width - 2, gray->height - 2)); cvSub(mx, gray, mx);
+#if defined(__SSE2__)
+static inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
 
-  cvSetImageROI(gray, cvRect(1, 2, gray->width - 2, gray->height - 2)); cvAdd(my, gray, my);
-  cvSetImageROI(gray, cvRect(1, 0, gray->width - 2, gray->height - 2)); cvSub(my, gray, my);
+// Squared magnitude, magnitude / sqrt(2) and discretized direction of the gradient along
+// the interior of the line of the gray image given with its previous and next lines
+static void GradientLine(int *sqrMgLine, uchar *mgLine, uchar *dirLine,
+  const uchar *prevLine, const uchar *currLine, const uchar *nextLine, int width)
+{
+  sqrMgLine[0] = sqrMgLine[width - 1] = 0;
+  mgLine[0] = mgLine[width - 1] = 0;
+  dirLine[0] = dirLine[width - 1] = 0;
+
+  int x = 1;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128(), ones = _mm_cmpeq_epi16(zero, zero);
+  const __m128i one = _mm_set1_epi16(1), sign = _mm_set1_epi16(-32768), slope = _mm_set1_epi16(DIR_SLOPE);
+
+  for (; x + 8 <= width - 1; x += 8)
+  {
+    const __m128i left = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(currLine + x - 1)), zero);
+    const __m128i right = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(currLine + x + 1)), zero);
+    const __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(prevLine + x)), zero);
+    const __m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(nextLine + x)), zero);
+
+    const __m128i dx = _mm_sub_epi16(right, left), dy = _mm_sub_epi16(bottom, top);
+    const __m128i dxa = _mm_max_epi16(dx, _mm_sub_epi16(zero, dx));
+    const __m128i dya = _mm_max_epi16(dy, _mm_sub_epi16(zero, dy));
+
+    // Squares of the differences fit unsigned 16-bit lanes, their sum does not
+    const __m128i dx2 = _mm_mullo_epi16(dx, dx), dy2 = _mm_mullo_epi16(dy, dy);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sqrMgLine + x),
+      _mm_add_epi32(_mm_unpacklo_epi16(dx2, zero), _mm_unpacklo_epi16(dy2, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sqrMgLine + x + 4),
+      _mm_add_epi32(_mm_unpackhi_epi16(dx2, zero), _mm_unpackhi_epi16(dy2, zero)));
+
+    const __m128i half = _mm_add_epi16(_mm_add_epi16(_mm_srli_epi16(dx2, 1), _mm_srli_epi16(dy2, 1)),
+      _mm_and_si128(_mm_and_si128(dx2, dy2), one));
+    const __m128i biasedHalf = _mm_xor_si128(half, sign);
+
+    __m128i root = zero;
+    for (int bit = 128; bit > 0; bit >>= 1)
+    {
+      const __m128i candidate = _mm_or_si128(root, _mm_set1_epi16(bit));
+      const __m128i square = _mm_xor_si128(_mm_mullo_epi16(candidate, candidate), sign);
+      root = Select(_mm_cmpgt_epi16(square, biasedHalf), root, candidate);
+    }
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(mgLine + x), _mm_packus_epi16(root, zero));
+
+    // dya <= (dxa * DIR_SLOPE) >> 16 with dxa > 0 is the same as dya * 65536 < dxa * DIR_SLOPE
+    const __m128i dir0 = _mm_cmplt_epi16(dya,
+      _mm_sub_epi16(_mm_mulhi_epu16(dxa, slope), _mm_cmpgt_epi16(dxa, zero)));
+    const __m128i dir90 = _mm_cmplt_epi16(dxa,
+      _mm_sub_epi16(_mm_mulhi_epu16(dya, slope), _mm_cmpgt_epi16(dya, zero)));
+    const __m128i nonZero = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi16(dx, zero), _mm_cmpeq_epi16(dy, zero)), ones);
+    const __m128i opposite = _mm_cmplt_epi16(_mm_xor_si128(dx, dy), zero);
+
+    __m128i dir = _mm_and_si128(_mm_and_si128(opposite, nonZero), _mm_set1_epi16(DIR_135));
+    dir = Select(_mm_andnot_si128(opposite, nonZero), _mm_set1_epi16(DIR_45), dir);
+    dir = Select(dir90, _mm_set1_epi16(DIR_90), dir);
+    dir = Select(dir0, _mm_set1_epi16(DIR_0), dir);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dirLine + x), _mm_packus_epi16(dir, zero));
+  }
+#endif
 
-  cvResetImageROI(gray);
-  cvResetImageROI(mx);
-  cvResetImageROI(my);
+  for (; x < width - 1; x++)
+  {
+    const int dx = currLine[x + 1] - currLine[x - 1], dy = nextLine[x] - prevLine[x];
+    sqrMgLine[x] = dx * dx + dy * dy;
+    mgLine[x] = static_cast<uchar>(GradientMagnitude(sqrMgLine[x] >> 1));
+    dirLine[x] = static_cast<uchar>(GradientDirection(dx, dy));
+  }
+}
 
-  cvCartToPolar(mx, my, mg);
+static inline unsigned int * IntegralLine(IplImage *integralImage, int y)
+{
+  return reinterpret_cast<unsigned int *>(integralImage->imageData + y * integralImage->widthStep);
 }
 
-static void DiscretizeGradientDirection(IplImage *dstImage, const IplImage *dxImage, const IplImage *dyImage)
+// Line y + 1 of the integral from its line y and the line y of the image; the sums wrap around
+static void IntegrateLine(IplImage *integralImage, int y, const uchar *line, int width)
 {
-  static const float pi = static_cast<float>(4.0 * atan(1.0));
-  static const float atan_pi_8 = static_cast<float>(atan(pi / 8));
+  const unsigned int *prevIntegralLine = IntegralLine(integralImage, y);
+  unsigned int *integralLine = IntegralLine(integralImage, y + 1);
+  integralLine[0] = 0;
+
+  unsigned int sum = 0;
+  int x = 0;
 
-  cvSetZero(dstImage);
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i carry = zero;
 
-  for (int y = 1; y < dstImage->height - 1; y++)
+  for (; x + 16 <= width; x += 16)
   {
-    const float *dxLine = reinterpret_cast<float *>(dxImage->imageData + dxImage->widthStep * y);
-    const float *dyLine = reinterpret_cast<float *>(dyImage->imageData + dyImage->widthStep * y);
-    uchar *dstLine = reinterpret_cast<uchar *>(dstImage->imageData + dstImage->widthStep * y);
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + x));
+    const __m128i words[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
 
-    for (int x = 1; x < dstImage->width - 1; x++)
+    for (int i = 0; i < 4; i++)
     {
-      uchar &dir = dstLine[x];
-      const float &dx = dxLine[x], &dy = dyLine[x], dxdy = dx * dy;
-      const float dxa = std::abs(dx), dya = std::abs(dy);
-
-      if (dya < dxa * atan_pi_8)
-        dir = DIR_0;
-      else if (dxa < dya * atan_pi_8)
-        dir = DIR_90;
-      else if (dxdy > 0)
-        dir = DIR_45;
-      else if (dxdy < 0)
-        dir = DIR_135;
+      // Prefix sum of four pixels plus the sum of all the preceding ones
+      __m128i quad = (i % 2 == 0) ? _mm_unpacklo_epi16(words[i / 2], zero) : _mm_unpackhi_epi16(words[i / 2], zero);
+      quad = _mm_add_epi32(quad, _mm_slli_si128(quad, 4));
+      quad = _mm_add_epi32(quad, _mm_slli_si128(quad, 8));
+      quad = _mm_add_epi32(quad, carry);
+      carry = _mm_shuffle_epi32(quad, _MM_SHUFFLE(3, 3, 3, 3));
+
+      const __m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prevIntegralLine + x + 1 + 4 * i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(integralLine + x + 1 + 4 * i), _mm_add_epi32(quad, above));
     }
   }
+
+  sum = static_cast<unsigned int>(_mm_cvtsi128_si32(carry));
+#endif
+
+  for (; x < width; x++)
+  {
+    sum += line[x];
+    integralLine[x + 1] = prevIntegralLine[x + 1] + sum;
+  }
+}
+
+static void BeginIntegral(IplImage *integralImage, int width, int height)
+{
+  assert(integralImage->nChannels == 1 && integralImage->depth == static_cast<int>(IPL_DEPTH_32S));
+  assert(integralImage->width == width + 1 && integralImage->height == height + 1);
+
+  unsigned int *firstLine = IntegralLine(integralImage, 0);
+  std::fill(firstLine, firstLine + width + 1, 0);
+}
+
+static void GradientOutputLine(uchar *gradientLine, const uchar *mgLine, const uchar *dirLine, int width, int direction)
+{
+  for (int x = 0; x < width; x++)
+  {
+    if (direction == 0)
+      gradientLine[x] = mgLine[x];
+    else if (direction == 1 && dirLine[x] == DIR_0)
+      gradientLine[x] = 128 + (mgLine[x] >> 1);
+    else if (direction == 1 && dirLine[x] == DIR_90)
+      gradientLine[x] = 128 - (mgLine[x] >> 1);
+    else if (direction == 2 && dirLine[x] == DIR_45)
+      gradientLine[x] = 128 + (mgLine[x] >> 1);
+    else if (direction == 2 && dirLine[x] == DIR_135)
+      gradientLine[x] = 128 - (mgLine[x] >> 1);
+    else
+      gradientLine[x] = 128;
+  }
+}
+
+// Non-maximum suppression along the gradient direction; squared magnitudes are compared
+// since the square root is monotonic
+static void CannyOutputLine(uchar *cannyLine, const int *sqrMgPrevLine, const int *sqrMgCurrLine,
+  const int *sqrMgNextLine, const uchar *dirLine, int width, int direction)
+{
+  cannyLine[0] = cannyLine[width - 1] = 0;
+
+  for (int x = 1; x < width - 1; x++)
+  {
+    const int &mg = sqrMgCurrLine[x];
+    if (dirLine[x] == DIR_0 && sqrMgCurrLine[x - 1] < mg && mg >= sqrMgCurrLine[x + 1])
+      cannyLine[x] = (direction == 0 || direction == 1) ? 255 : 128;
+    else if (dirLine[x] == DIR_45 && sqrMgPrevLine[x - 1] < mg && mg >= sqrMgNextLine[x + 1])
+      cannyLine[x] = (direction == 0 || direction == 2) ? 255 : 128;
+    else if (dirLine[x] == DIR_90 && sqrMgPrevLine[x] < mg && mg >= sqrMgNextLine[x])
+      cannyLine[x] = direction == 0 ? 255 : (direction == 1 ? 0 : 128);
+    else if (dirLine[x] == DIR_135 && sqrMgPrevLine[x + 1] < mg && mg >= sqrMgNextLine[x - 1])
+      cannyLine[x] = direction == 0 ? 255 : (direction == 2 ? 0 : 128);
+    else
+      cannyLine[x] = direction == 0 ? 0 : 128;
+  }
+}
+
+static void RawCannyOutputLine(uchar *rawCannyLine, const int *sqrMgPrevLine, const int *sqrMgCurrLine,
+  const int *sqrMgNextLine, const uchar *dirLine, int width)
+{
+  rawCannyLine[0] = rawCannyLine[width - 1] = 0;
+
+  for (int x = 1; x < width - 1; x++)
+  {
+    const int &mg = sqrMgCurrLine[x];
+    bool maximum = false;
+
+    if (dirLine[x] == DIR_0)
+      maximum = sqrMgCurrLine[x - 1] < mg && mg > sqrMgCurrLine[x + 1];
+    else if (dirLine[x] == DIR_45)
+      maximum = sqrMgPrevLine[x - 1] < mg && mg > sqrMgNextLine[x + 1];
+    else if (dirLine[x] == DIR_90)
+      maximum = sqrMgPrevLine[x] < mg && mg > sqrMgNextLine[x];
+    else if (dirLine[x] == DIR_135)
+      maximum = sqrMgPrevLine[x + 1] < mg && mg > sqrMgNextLine[x - 1];
+
+    rawCannyLine[x] = maximum == true ? dirLine[x] : 0;
+  }
+}
+
+// Writes the line y of the requested Canny images and their integrals, zero when no magnitudes are given
+static void SuppressionOutputLines(objed::GradientImages &images, int y, const int *sqrMgPrevLine,
+  const int *sqrMgCurrLine, const int *sqrMgNextLine, const uchar *dirLine, int width)
+{
+  for (int direction = 0; direction < 3; direction++)
+  {
+    if (images.canny[direction] == 0)
+      continue;
+
+    uchar *cannyLine = reinterpret_cast<uchar *>(images.canny[direction]->imageData + y * images.canny[direction]->widthStep);
+    if (sqrMgCurrLine == 0)
+      std::fill(cannyLine, cannyLine + width, 0);
+    else
+      CannyOutputLine(cannyLine, sqrMgPrevLine, sqrMgCurrLine, sqrMgNextLine, dirLine, width, direction);
+
+    if (images.cannyIntegral[direction] != 0)
+      IntegrateLine(images.cannyIntegral[direction], y, cannyLine, width);
+  }
+
+  if (images.rawCanny != 0)
+  {
+    uchar *rawCannyLine = reinterpret_cast<uchar *>(images.rawCanny->imageData + y * images.rawCanny->widthStep);
+    if (sqrMgCurrLine == 0)
+      std::fill(rawCannyLine, rawCannyLine + width, 0);
+    else
+      RawCannyOutputLine(rawCannyLine, sqrMgPrevLine, sqrMgCurrLine, sqrMgNextLine, dirLine, width);
+
+    if (images.rawCannyIntegral != 0)
+      IntegrateLine(images.rawCannyIntegral, y, rawCannyLine, width);
+  }
+}
+
+objed::GradientImages::GradientImages() : rawCanny(0), rawCannyIntegral(0)
+{
+  std::fill(gradient, gradient + 3, static_cast<IplImage *>(0));
+  std::fill(gradientIntegral, gradientIntegral + 3, static_cast<IplImage *>(0));
+  std::fill(canny, canny + 3, static_cast<IplImage *>(0));
+  std::fill(cannyIntegral, cannyIntegral + 3, static_cast<IplImage *>(0));
 }
 
-void objed::PrepareGrayImage(IplImage *grayImage, IplImage *image)
+// Buffers keep their capacity, so images of the same width reuse them without allocation
+void objed::GradientLines::reset(int width)
+{
+  sqrMgLines.assign(3 * width, 0);
+  mgLine.assign(width, 0);
+  dirLines.assign(2 * width, 0);
+}
+
+void objed::PrepareGrayImage(IplImage *grayImage, IplImage *image, IplImage *grayIntegral)
 {
   assert(grayImage != 0 && image != 0);
 
-  if (grayImage->nChannels == image->nChannels)
-    cvCopy(image, grayImage);
-  else
-    cvCvtColor(image, grayImage, CV_RGB2GRAY);
+  if (grayIntegral == 0 || grayImage->depth != IPL_DEPTH_8U)
+  {
+    if (grayImage->nChannels == image->nChannels)
+      cvCopy(image, grayImage);
+    else
+      cvCvtColor(image, grayImage, CV_RGB2GRAY);
+
+    if (grayIntegral != 0)
+      PrepareIntegralImage(grayIntegral, grayImage);
+    return;
+  }
+
+  // Line by line, so that each gray line is integrated while it is still in cache
+  BeginIntegral(grayIntegral, grayImage->width, grayImage->height);
+
+  IplImage imageLine, grayLine;
+  cvInitImageHeader(&imageLine, cvSize(image->width, 1), image->depth, image->nChannels, image->origin);
+  cvInitImageHeader(&grayLine, cvSize(grayImage->width, 1), grayImage->depth, grayImage->nChannels, grayImage->origin);
+
+  for (int y = 0; y < grayImage->height; y++)
+  {
+    imageLine.imageData = image->imageData + y * image->widthStep;
+    grayLine.imageData = grayImage->imageData + y * grayImage->widthStep;
+
+    if (grayImage->nChannels == image->nChannels)
+      cvCopy(&imageLine, &grayLine);
+    else
+      cvCvtColor(&imageLine, &grayLine, CV_RGB2GRAY);
+
+    IntegrateLine(grayIntegral, y, reinterpret_cast<const uchar *>(grayLine.imageData), grayImage->width);
+  }
 }
 
 void objed::PrepareSaturationImage(IplImage *saturationImage, IplImage *image)
@@ -130,139 +391,111 @@ void objed::PrepareChannelImage(IplImage *channelImage, IplImage *image, int cha
   cv::extractChannel(src, dst, channel);
 }
 
-void objed::PrepareGradientImage(IplImage *gradientImage, IplImage *grayImage, int direction)
+void objed::PrepareGradientImages(GradientImages &images, IplImage *grayImage, GradientLines *lines)
 {
-  assert(gradientImage != 0 && grayImage != 0);
-  assert(gradientImage->nChannels == 1 && grayImage->nChannels == 1);
+  assert(grayImage != 0);
+  assert(grayImage->nChannels == 1 && grayImage->depth == IPL_DEPTH_8U);
 
-  IplImage *realGrayImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realDxImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realDyImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realMgImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  cvConvert(grayImage, realGrayImage);
+  const int width = grayImage->width, height = grayImage->height;
+  const bool interior = width > 2 && height > 2;
+  const bool suppression = images.canny[0] != 0 || images.canny[1] != 0 || images.canny[2] != 0 || images.rawCanny != 0;
 
-  GetGradientComponents(realDxImage, realDyImage, realMgImage, realGrayImage);
-  if (direction == 1 || direction == 2)
-    DiscretizeGradientDirection(gradientImage, realDxImage, realDyImage);
-
-  for (int y = 0; y < realMgImage->height; y++)
+  for (int direction = 0; direction < 3; direction++)
   {
-    static const float sqrt2 = static_cast<float>(sqrt(2.0));
-    float *realMgLine = reinterpret_cast<float *>(realMgImage->imageData + y * realMgImage->widthStep);
-    for (int x = 0; x < realMgImage->width; x++) realMgLine[x] /= sqrt2;
+    if (images.gradientIntegral[direction] != 0)
+      BeginIntegral(images.gradientIntegral[direction], width, height);
+    if (images.cannyIntegral[direction] != 0)
+      BeginIntegral(images.cannyIntegral[direction], width, height);
   }
+  if (images.rawCannyIntegral != 0)
+    BeginIntegral(images.rawCannyIntegral, width, height);
+
+  // Rolling lines: three of squared magnitudes and two of directions are needed for the
+  // suppression of the line preceding the current one
+  GradientLines localLines;
+  GradientLines &gradientLines = lines != 0 ? *lines : localLines;
+  gradientLines.reset(width);
 
-  for (int y = 0; y < gradientImage->height; y++)
+  std::vector<int> &sqrMgLines = gradientLines.sqrMgLines;
+  std::vector<uchar> &mgLine = gradientLines.mgLine, &dirLines = gradientLines.dirLines;
+
+  for (int y = 0; y < height; y++)
   {
-    uchar *gradientLine = reinterpret_cast<uchar *>(gradientImage->imageData + y * gradientImage->widthStep);
-    const float *realMgLine = reinterpret_cast<float *>(realMgImage->imageData + y * realMgImage->widthStep);
+    int *sqrMgLine = &sqrMgLines[(y % 3) * width];
+    uchar *dirLine = &dirLines[(y % 2) * width];
 
-    for (int x = 0; x < gradientImage->width; x++)
+    if (interior == true && y > 0 && y < height - 1)
     {
-      if (direction == 0)
-        gradientLine[x] = static_cast<int>(realMgLine[x]);
-      else if (direction == 1 && gradientLine[x] == DIR_0)
-        gradientLine[x] = 128 + (static_cast<int>(realMgLine[x]) >> 1);
-      else if (direction == 1 && gradientLine[x] == DIR_90)
-        gradientLine[x] = 128 - (static_cast<int>(realMgLine[x]) >> 1);
-      else if (direction == 2 && gradientLine[x] == DIR_45)
-        gradientLine[x] = 128 + (static_cast<int>(realMgLine[x]) >> 1);
-      else if (direction == 2 && gradientLine[x] == DIR_135)
-        gradientLine[x] = 128 - (static_cast<int>(realMgLine[x]) >> 1);
-      else
-        gradientLine[x] = 128;
+      const uchar *grayLine = reinterpret_cast<const uchar *>(grayImage->imageData + y * grayImage->widthStep);
+      GradientLine(sqrMgLine, &mgLine[0], dirLine, grayLine - grayImage->widthStep, grayLine,
+        grayLine + grayImage->widthStep, width);
+    }
+    else
+    {
+      std::fill(sqrMgLine, sqrMgLine + width, 0);
+      std::fill(mgLine.begin(), mgLine.end(), 0);
+      std::fill(dirLine, dirLine + width, 0);
     }
-  }
-
-  cvReleaseImage(&realGrayImage);
-  cvReleaseImage(&realDxImage);
-  cvReleaseImage(&realDyImage);
-  cvReleaseImage(&realMgImage);
-}
 
-void objed::PrepareCannyImage(IplImage *cannyImage, IplImage *grayImage, int direction)
-{
-  assert(cannyImage != 0 && grayImage != 0);
-  assert(cannyImage->nChannels == 1 && grayImage->nChannels == 1);
+    for (int direction = 0; direction < 3; direction++)
+    {
+      if (images.gradient[direction] == 0)
+        continue;
 
-  IplImage *realGrayImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realDxImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realDyImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realMgImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  cvConvert(grayImage, realGrayImage);
+      uchar *gradientLine = reinterpret_cast<uchar *>(images.gradient[direction]->imageData + y * images.gradient[direction]->widthStep);
+      GradientOutputLine(gradientLine, &mgLine[0], dirLine, width, direction);
 
-  GetGradientComponents(realDxImage, realDyImage, realMgImage, realGrayImage);
-  DiscretizeGradientDirection(cannyImage, realDxImage, realDyImage);
+      if (images.gradientIntegral[direction] != 0)
+        IntegrateLine(images.gradientIntegral[direction], y, gradientLine, width);
+    }
 
-  for (int y = 1; y < cannyImage->height - 1; y++)
-  {
-    uchar *cannyLine = reinterpret_cast<uchar *>(cannyImage->imageData + y * cannyImage->widthStep);
-    const float *realMgPrevLine = reinterpret_cast<float *>(realMgImage->imageData + (y - 1) * realMgImage->widthStep);
-    const float *realMgCurrLine = reinterpret_cast<float *>(realMgImage->imageData + y * realMgImage->widthStep);
-    const float *realMgNextLine = reinterpret_cast<float *>(realMgImage->imageData + (y + 1) * realMgImage->widthStep);
+    if (suppression == false)
+      continue;
 
-    for (int x = 1; x < cannyImage->width - 1; x++)
+    // Interior lines of Canny images are suppressed one line behind, border lines are zero;
+    // lines are written in order for the integrals to be accumulated
+    if (interior == true && y >= 2)
     {
-      const float &mg = realMgCurrLine[x];
-      if (cannyLine[x] == DIR_0 && realMgCurrLine[x - 1] < mg && mg >= realMgCurrLine[x + 1])
-          cannyLine[x] = (direction == 0 || direction == 1) ? 255 : 128;
-      else if (cannyLine[x] == DIR_45 && realMgPrevLine[x - 1] < mg && mg >= realMgNextLine[x + 1])
-          cannyLine[x] = (direction == 0 || direction == 2) ? 255 : 128;
-      else if (cannyLine[x] == DIR_90 && realMgPrevLine[x] < mg && mg >= realMgNextLine[x])
-          cannyLine[x] = direction == 0 ? 255 : (direction == 1 ? 0 : 128);
-      else if (cannyLine[x] == DIR_135 && realMgPrevLine[x + 1] < mg && mg >= realMgNextLine[x - 1])
-          cannyLine[x] = direction == 0 ? 255 : (direction == 2 ? 0 : 128);
-      else
-        cannyLine[x] = direction == 0 ? 0 : 128;
+      SuppressionOutputLines(images, y - 1, &sqrMgLines[((y + 1) % 3) * width],
+        &sqrMgLines[((y - 1) % 3) * width], sqrMgLine, &dirLines[((y - 1) % 2) * width], width);
     }
+    if (interior == false || y == 0 || y == height - 1)
+      SuppressionOutputLines(images, y, 0, 0, 0, 0, width);
   }
-
-  cvReleaseImage(&realGrayImage);
-  cvReleaseImage(&realDxImage);
-  cvReleaseImage(&realDyImage);
-  cvReleaseImage(&realMgImage);
 }
 
-void objed::PrepareRawCannyImage(IplImage *rawCannyImage, IplImage *grayImage)
+void objed::PrepareGradientImage(IplImage *gradientImage, IplImage *grayImage, int direction)
 {
-  assert(rawCannyImage != 0 && grayImage != 0);
-  assert(rawCannyImage->nChannels == 1 && grayImage->nChannels == 1);
+  assert(gradientImage != 0 && grayImage != 0);
+  assert(gradientImage->nChannels == 1 && grayImage->nChannels == 1);
+  assert(direction >= 0 && direction < 3);
 
-  IplImage *realGrayImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realDxImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realDyImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  IplImage *realMgImage = cvCreateImage(cvSize(grayImage->width, grayImage->height), IPL_DEPTH_32F, 1);
-  cvConvert(grayImage, realGrayImage);
+  GradientImages images;
+  if (direction >= 0 && direction < 3)
+    images.gradient[direction] = gradientImage;
+  PrepareGradientImages(images, grayImage);
+}
 
-  GetGradientComponents(realDxImage, realDyImage, realMgImage, realGrayImage);
-  DiscretizeGradientDirection(rawCannyImage, realDxImage, realDyImage);
+void objed::PrepareCannyImage(IplImage *cannyImage, IplImage *grayImage, int direction)
+{
+  assert(cannyImage != 0 && grayImage != 0);
+  assert(cannyImage->nChannels == 1 && grayImage->nChannels == 1);
+  assert(direction >= 0 && direction < 3);
 
-  for (int y = 1; y < rawCannyImage->height - 1; y++)
-  {
-    uchar *rawCannyLine = reinterpret_cast<uchar *>(rawCannyImage->imageData + y * rawCannyImage->widthStep);
-    const float *realMgPrevLine = reinterpret_cast<float *>(realMgImage->imageData + (y - 1) * realMgImage->widthStep);
-    const float *realMgCurrLine = reinterpret_cast<float *>(realMgImage->imageData + y * realMgImage->widthStep);
-    const float *realMgNextLine = reinterpret_cast<float *>(realMgImage->imageData + (y + 1) * realMgImage->widthStep);
+  GradientImages images;
+  if (direction >= 0 && direction < 3)
+    images.canny[direction] = cannyImage;
+  PrepareGradientImages(images, grayImage);
+}
 
-    for (int x = 1; x < rawCannyImage->width - 1; x++)
-    {
-      const float &mg = realMgCurrLine[x];
-
-      if ((rawCannyLine[x] == DIR_0) && (realMgCurrLine[x - 1] >= mg || mg <= realMgCurrLine[x + 1]))
-        rawCannyLine[x] = 0;
-      if ((rawCannyLine[x] == DIR_45) && (realMgPrevLine[x - 1] >= mg || mg <= realMgNextLine[x + 1]))
-        rawCannyLine[x] = 0;
-      if ((rawCannyLine[x] == DIR_90) && (realMgPrevLine[x] >= mg || mg <= realMgNextLine[x]))
-        rawCannyLine[x] = 0;
-      if ((rawCannyLine[x] == DIR_135) && ((realMgPrevLine[x + 1] >= mg || mg <= realMgNextLine[x - 1])))
-        rawCannyLine[x] = 0;
-    }
-  }
+void objed::PrepareRawCannyImage(IplImage *rawCannyImage, IplImage *grayImage)
+{
+  assert(rawCannyImage != 0 && grayImage != 0);
+  assert(rawCannyImage->nChannels == 1 && grayImage->nChannels == 1);
 
-  cvReleaseImage(&realGrayImage);
-  cvReleaseImage(&realDxImage);
-  cvReleaseImage(&realDyImage);
-  cvReleaseImage(&realMgImage);
+  GradientImages images;
+  images.rawCanny = rawCannyImage;
+  PrepareGradientImages(images, grayImage);
 }
 
 void objed::PrepareFilterImage(IplImage *filterImage, IplImage *grayImage, int index)
@@ -303,3 +536,18 @@ void objed::PrepareNoSaltImage(IplImage *noSaltImage, IplImage *grayImage)
   }
 
 }
+
+void objed::PrepareIntegralImage(IplImage *integralImage, IplImage *image)
+{
+  assert(integralImage != 0 && image != 0);
+
+  if (image->nChannels != 1 || image->depth != IPL_DEPTH_8U)
+  {
+    cvIntegral(image, integralImage);
+    return;
+  }
+
+  BeginIntegral(integralImage, image->width, image->height);
+  for (int y = 0; y < image->height; y++)
+    IntegrateLine(integralImage, y, reinterpret_cast<const uchar *>(image->imageData + y * image->widthStep), image->width);
+}
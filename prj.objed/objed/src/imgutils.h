@@ -36,10 +36,12 @@ either expressed or implied, of copyright holders.
 #include <objed/objedutils.h>
 #include <objed/objed.h>
 
+#include <vector>
+
 namespace objed
 {
-  // gray
-  void PrepareGrayImage(IplImage *grayImage, IplImage *image);
+  // gray, with its integral accumulated along when grayIntegral is not null
+  void PrepareGrayImage(IplImage *grayImage, IplImage *image, IplImage *grayIntegral = 0);
 
   // saturation
   void PrepareSaturationImage(IplImage *saturationImage, IplImage *image);
@@ -56,6 +58,35 @@ namespace objed
   // rawCanny
   void PrepareRawCannyImage(IplImage *rawCannyImage, IplImage *grayImage);
 
+  // Outputs of PrepareGradientImages indexed by direction; images and integrals not needed are null
+  struct GradientImages
+  {
+    GradientImages();
+
+    IplImage *gradient[3], *gradientIntegral[3];
+    IplImage *canny[3], *cannyIntegral[3];
+    IplImage *rawCanny, *rawCannyIntegral;
+  };
+
+  // Rolling line buffers of PrepareGradientImages, kept by callers preparing many images
+  struct GradientLines
+  {
+    void reset(int width);
+
+    std::vector<int> sqrMgLines;
+    std::vector<uchar> mgLine, dirLines;
+  };
+
+  // gradient<0..2>, canny<0..2> and rawCanny at once, computed in a single pass over the gray
+  // image; the integrals are accumulated from the lines just written. Line buffers are
+  // allocated per call when lines is null
+  void PrepareGradientImages(GradientImages &images, IplImage *grayImage, GradientLines *lines = 0);
+
+  // Integral of an 8-bit image into an IPL_DEPTH_32S one of size (width + 1) x (height + 1).
+  // Sums wrap around modulo 2^32 instead of overflowing, so differences of corners (see
+  // rectSum) stay exact for rects of any image, however large
+  void PrepareIntegralImage(IplImage *integralImage, IplImage *image);
+
   // filter<index>
   void PrepareFilterImage(IplImage *filterImage, IplImage *grayImage, int index);
 
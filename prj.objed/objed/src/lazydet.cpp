@@ -30,6 +30,7 @@ either expressed or implied, of copyright holders.
 */
 
 #include "lazydet.h"
+#include "detutils.h"
 
 #include <opencv/cv.h>
 
@@ -38,29 +39,24 @@ either expressed or implied, of copyright holders.
 #include <map>
 
 objed::LazyDetector::LazyDetector() : 
-imagePool(0), isImagePoolOwn(false), classifier(0),
+classifier(0), context(0),
 minScale(1.0), maxScale(1.0), stpScale(1.1), leftMargin(0), 
 rightMargin(0), topMargin(0), bottomMargin(0), 
 xRawStep(0), yRawStep(0), xStep(0), yStep(0), 
-mergeIncluded(true), overlap(0.5)
+mergeIncluded(true), overlap(0.5), threadCount(1), exactClustering(true), pyramidFromPrevious(false)
 {
-  imagePool = ImagePool::create();
-  isImagePoolOwn = true;
+  return;
 }
 
 objed::LazyDetector::LazyDetector(const Json::Value &data, const std::string &workDir) : 
-imagePool(0), isImagePoolOwn(false), classifier(0), minScale(1.0), maxScale(1.0), stpScale(1.1), leftMargin(0), rightMargin(0),
-topMargin(0), bottomMargin(0), xRawStep(0), yRawStep(0), xStep(0), yStep(0), mergeIncluded(true), overlap(0.5)
+classifier(0), context(0), minScale(1.0), maxScale(1.0), stpScale(1.1), leftMargin(0), rightMargin(0),
+topMargin(0), bottomMargin(0), xRawStep(0), yRawStep(0), xStep(0), yStep(0), mergeIncluded(true), overlap(0.5), threadCount(1), exactClustering(true), pyramidFromPrevious(false)
 {
-  imagePool = ImagePool::create();
-  isImagePoolOwn = true;
-
-  classifier = Classifier::create(data["classifier"], workDir);
+  classifier = createSharedClassifier(data["classifier"], workDir);
+  context = new ScanContext(classifier, false, 0);
   if (classifier == 0)
     return;
 
-  classifier->prepare(imagePool);
-
   leftMargin = round(data["leftMargin"].asDouble() * classifier->width());
   rightMargin = round(data["rightMargin"].asDouble() * classifier->width());
   topMargin = round(data["topMargin"].asDouble() * classifier->height());
@@ -78,21 +74,72 @@ topMargin(0), bottomMargin(0), xRawStep(0), yRawStep(0), xStep(0), yStep(0), mer
 
   mergeIncluded = data.get("mergeIncluded", true).asBool();
   overlap = data.get("overlap", 0.5).asDouble();
+  threadCount = scanThreadCount(data);
+  exactClustering = data.get("exactClustering", true).asBool();
+  pyramidFromPrevious = data.get("pyramidFromPrevious", false).asBool();
 }
 
 objed::LazyDetector::~LazyDetector()
 {
-  if (isImagePoolOwn == true)
-    ImagePool::destroy(imagePool);
-
+  DetectionContext::destroy(context);
   Classifier::destroy(classifier);
 }
 
 objed::DetectionList objed::LazyDetector::detect(IplImage *image, DebugInfo *debugInfo)
 {
-  if (imagePool == 0 || classifier == 0 || image == 0)
+  return detectInContext(context, image, debugInfo);
+}
+
+objed::DetectionList objed::LazyDetector::detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo) const
+{
+  ScanContext *scanContext = dynamic_cast<ScanContext *>(context);
+  if (scanContext == 0 || scanContext->classifier == 0 || image == 0)
     return DetectionList();
 
+  std::vector<Rect<int> > &rawDetectionList = scanContext->rawDetectionList;
+  const Classifier *boundClassifier = scanContext->classifier;
+
+  rawDetectionList.clear();
+  const int clWd2 = classifier->width() / 2, clHt2 = classifier->height() / 2;
+  const int imageWd = image->width, imageHt = image->height;
+
+  IplImage *scaledImage = 0;
+  size_t level = 0;
+
+  for (double scale = minScale; scale <= maxScale; scale *= stpScale, level++)
+  {
+    int scaledImageWd = round(std::max(1.0, imageWd / scale));
+    int scaledImageHt = round(std::max(1.0, imageHt / scale));
+
+    const IplImage *levelSource = (pyramidFromPrevious == true && scaledImage != 0) ? scaledImage : image;
+    scaledImage = scanContext->prepareLevel(level, levelSource, scaledImageWd, scaledImageHt);
+    const bool parallel = threadCount > 1 && debugInfo == nullptr;
+
+    // Windows of the raw grid only, refinements around raw hits are not counted
+    StageTimer scanTimer(StageProfile::STAGE_SCAN);
+    StageProfile::addWindows(gridCount(clWd2, scaledImageWd - clWd2, xRawStep) * gridCount(clHt2, scaledImageHt - clHt2, yRawStep));
+
+    if (parallel == true)
+    {
+      scanRowsParallel(rawDetectionList, scanContext->blockDetectionLists, clHt2, scaledImageHt - clHt2, yRawStep, threadCount,
+        [&](std::vector<Rect<int> > &blockDetectionList, int yBegin, int yEnd)
+        {
+          scan(boundClassifier, blockDetectionList, scaledImageWd, scaledImageHt, scale, yBegin, yEnd, 0);
+        });
+    }
+    else
+    {
+      scan(boundClassifier, rawDetectionList, scaledImageWd, scaledImageHt, scale, clHt2, scaledImageHt - clHt2, debugInfo);
+    }
+  }
+
+  DetectionList clusteredDetectionList = clusterDetections(rawDetectionList, overlap, exactClustering, threadCount);
+  return mergeIncluded == true ? objed::mergeIncluded(clusteredDetectionList) : clusteredDetectionList;
+}
+
+void objed::LazyDetector::scan(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList, int scaledImageWd,
+  int scaledImageHt, double scale, int yBegin, int yEnd, DebugInfo *debugInfo) const
+{
   DebugInfo *clDebugInfo0 = 0, *clDebugInfo1 = 0;
   if (debugInfo != nullptr)
   {
@@ -100,121 +147,90 @@ objed::DetectionList objed::LazyDetector::detect(IplImage *image, DebugInfo *deb
     clDebugInfo1 = new DebugInfo();
   }
 
-  std::vector<Rect<int> > rawDetectionList;
   const int clWd = classifier->width(), clWd2 = clWd / 2;
   const int clHt = classifier->height(), clHt2 = clHt / 2;
-  const int imageWd = image->width, imageHt = image->height;
 
-  for (double scale = minScale; scale <= maxScale; scale *= stpScale)
+  for (int y = yBegin; y < yEnd; y += yRawStep)
   {
-    int scaledImageWd = round(std::max(1.0, imageWd / scale));
-    int scaledImageHt = round(std::max(1.0, imageHt / scale));
-
-    IplImage *scaledImage = cvCreateImage(cvSize(
-      scaledImageWd, scaledImageHt), image->depth, image->nChannels);
-    cvResize(image, scaledImage);
-    imagePool->update(scaledImage);
-
-    for (int y = clHt2; y < scaledImageHt - clHt2; y += yRawStep)
+    for (int x = clWd2; x < scaledImageWd - clWd2; x += xRawStep)
     {
-      for (int x = clWd2; x < scaledImageWd - clWd2; x += xRawStep)
-      {
+      if (clDebugInfo0 != nullptr)
+        clDebugInfo0->int_data.clear();
 
-        if (clDebugInfo0 != nullptr)
-          clDebugInfo0->int_data.clear();
+      float result = 0.0;
+      if (boundClassifier->evaluate(&result, x, y, clDebugInfo0) && result > 0)
+      {
+        int yMin = std::max(clHt2, y - yRawStep / 2), yMax = std::min(y + yRawStep / 2, scaledImageHt - clHt2);
+        int xMin = std::max(clWd2, x - xRawStep / 2), xMax = std::min(x + xRawStep / 2, scaledImageWd - clWd2);
 
-        float result = 0.0;
-        if (classifier->evaluate(&result, x, y, clDebugInfo0) && result > 0)
+        for (int y0 = yMin; y0 < yMax; y0 += yStep)
         {
-          int yMin = std::max(clHt2, y - yRawStep / 2), yMax = std::min(y + yRawStep / 2, scaledImageHt - clHt2);
-          int xMin = std::max(clWd2, x - xRawStep / 2), xMax = std::min(x + xRawStep / 2, scaledImageWd - clWd2);
-
-          for (int y0 = yMin; y0 < yMax; y0 += yStep)
+          for (int x0 = xMin; x0 < xMax; x0 += xStep)
           {
-            for (int x0 = xMin; x0 < xMax; x0 += xStep)
+            if (clDebugInfo1 != nullptr)
+              clDebugInfo1->int_data.clear();
+
+            if (boundClassifier->evaluate(&result, x0, y0, clDebugInfo1) && result > 0)
             {
-              if (clDebugInfo1 != nullptr)
-                clDebugInfo1->int_data.clear();
-
-              if (classifier->evaluate(&result, x0, y0, clDebugInfo1) && result > 0)
-              {
-                Detection rawDetection;
-                rawDetection.power = 1;
-                rawDetection.x = round((x0 - clWd2 + leftMargin) * scale);
-                rawDetection.y = round((y0 - clHt2 + topMargin) * scale);
-                rawDetection.width = round((clWd - leftMargin - rightMargin) * scale);
-                rawDetection.height = round((clHt - topMargin - bottomMargin) * scale);
-                rawDetectionList.push_back(rawDetection);
-              }
-
-              if (debugInfo != nullptr)
-              {
-                int outputLevel = clDebugInfo1->int_data[Classifier::DBG_SC_COUNT];
-                if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
-                  debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
-                else
-                  debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
-                if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
-                  debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
-                else
-                  debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
-                debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
-                debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
-              }
+              Detection rawDetection;
+              rawDetection.power = 1;
+              rawDetection.x = round((x0 - clWd2 + leftMargin) * scale);
+              rawDetection.y = round((y0 - clHt2 + topMargin) * scale);
+              rawDetection.width = round((clWd - leftMargin - rightMargin) * scale);
+              rawDetection.height = round((clHt - topMargin - bottomMargin) * scale);
+              rawDetectionList.push_back(rawDetection);
+            }
+
+            if (debugInfo != nullptr)
+            {
+              int outputLevel = clDebugInfo1->int_data[Classifier::DBG_SC_COUNT];
+              if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
+                debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
+              else
+                debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
+              if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
+                debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
+              else
+                debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
+              debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
+              debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
             }
           }
         }
+      }
 
-        if (debugInfo != nullptr)
-        {
-          int outputLevel = clDebugInfo0->int_data[Classifier::DBG_SC_COUNT];
-          if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
-            debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
-          else
-            debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
-          if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
-            debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
-          else
-            debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
-          debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
-          debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
-        }
+      if (debugInfo != nullptr)
+      {
+        int outputLevel = clDebugInfo0->int_data[Classifier::DBG_SC_COUNT];
+        if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
+          debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
+        else
+          debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
+        if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
+          debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
+        else
+          debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
+        debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
+        debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
       }
     }
-
-    cvReleaseImage(&scaledImage);
   }
 
   if (clDebugInfo0 != nullptr)
     delete clDebugInfo0;
   if (clDebugInfo1 != nullptr)
-    delete clDebugInfo0;
-
-
-  DetectionList clusteredDetectionList = objed::cluster(rawDetectionList, overlap);
-  return mergeIncluded == true ? objed::mergeIncluded(clusteredDetectionList) : clusteredDetectionList;
+    delete clDebugInfo1;
 }
 
 objed::Detector * objed::LazyDetector::clone() const
 {
   LazyDetector *newLazyDet = new LazyDetector();
 
-  if (isImagePoolOwn == true)
-  {
-    newLazyDet->imagePool = ImagePool::create();
-    newLazyDet->isImagePoolOwn = isImagePoolOwn;
-  }
-  else
-  {
-    newLazyDet->imagePool = imagePool;
-    newLazyDet->isImagePoolOwn = isImagePoolOwn;
-  }
+  const ScanContext *scanContext = static_cast<const ScanContext *>(context);
 
   if (classifier != 0)
-  {
     newLazyDet->classifier = classifier->clone();
-    newLazyDet->classifier->prepare(newLazyDet->imagePool);
-  }
+  newLazyDet->context = new ScanContext(newLazyDet->classifier, false, scanContext->isImagePoolOwn ? 0 : scanContext->imagePool);
 
   newLazyDet->minScale = minScale;
   newLazyDet->maxScale = maxScale;
@@ -232,30 +248,26 @@ objed::Detector * objed::LazyDetector::clone() const
 
   newLazyDet->overlap = overlap;
   newLazyDet->mergeIncluded = mergeIncluded;
+  newLazyDet->threadCount = threadCount;
+  newLazyDet->exactClustering = exactClustering;
+  newLazyDet->pyramidFromPrevious = pyramidFromPrevious;
 
   return newLazyDet;
 }
 
-void objed::LazyDetector::setImagePool(objed::ImagePool *extImagePool)
+objed::DetectionContext * objed::LazyDetector::createContext(ImagePool *extImagePool) const
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
-
-  isImagePoolOwn = false;
-  imagePool = extImagePool;
+  return new ScanContext(classifier != 0 ? classifier->clone() : 0, true, extImagePool);
+}
 
-  if (classifier != 0)
-    classifier->prepare(imagePool);
+void objed::LazyDetector::setImagePool(objed::ImagePool *extImagePool)
+{
+  DetectionContext::destroy(context);
+  context = new ScanContext(classifier, false, extImagePool);
 }
 
 void objed::LazyDetector::resetImagePool()
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
-
-  isImagePoolOwn = true;
-  imagePool = objed::ImagePool::create();
-
-  if (classifier != 0)
-    classifier->prepare(imagePool);
+  DetectionContext::destroy(context);
+  context = new ScanContext(classifier, false, 0);
 }
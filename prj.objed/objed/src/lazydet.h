@@ -36,6 +36,8 @@ either expressed or implied, of copyright holders.
 #include <objed/objed.h>
 #include <objed/objedutils.h>
 
+#include "detector.h"
+
 #include <utility>
 #include <vector>
 
@@ -53,6 +55,8 @@ namespace objed
 
   public:
     virtual DetectionList detect(IplImage *image, DebugInfo *debugInfo);
+    virtual DetectionList detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo = 0) const;
+    virtual DetectionContext * createContext(ImagePool *extImagePool = 0) const;
 
     virtual Detector * clone() const;
 
@@ -60,11 +64,12 @@ namespace objed
     virtual void resetImagePool();
 
   private:
-    ImagePool *imagePool;
-    bool isImagePoolOwn;
+    void scan(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList, int scaledImageWd,
+      int scaledImageHt, double scale, int yBegin, int yEnd, DebugInfo *debugInfo) const;
 
   private:
     Classifier *classifier;
+    DetectionContext *context;
 
   private:
     double minScale, maxScale, stpScale;
@@ -74,6 +79,9 @@ namespace objed
     int xStep, yStep;
     bool mergeIncluded;
     double overlap;
+    int threadCount;
+    bool exactClustering;
+    bool pyramidFromPrevious;
   };
 }
 
@@ -30,7 +30,9 @@ either expressed or implied, of copyright holders.
 */
 
 #include "linearcl.h"
+#include "batchutils.h"
 
+#include <algorithm>
 #include <cassert>
 
 objed::LinearClassifier::LinearClassifier(int width, int height) :
@@ -118,6 +120,39 @@ bool objed::LinearClassifier::evaluate(float *result, int x, int y, DebugInfo *d
   return ok;
 }
 
+bool objed::LinearClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  bool ok = true;
+  float clResults[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+    float *totalResults = results + i;
+    uint8_t *chunkAlive = alive + i;
+
+    for (int j = 0; j < count; j++)
+    {
+      if (chunkAlive[j] != 0)
+        totalResults[j] = 0.0;
+    }
+
+    for (size_t k = 0; k < clList.size(); k++)
+    {
+      assert(clList[k] != 0);
+      ok &= clList[k]->evaluateBatch(xs + i, ys + i, count, clResults, chunkAlive);
+
+      for (int j = 0; j < count; j++)
+      {
+        if (chunkAlive[j] != 0)
+          totalResults[j] += alphaList[k] * clResults[j];
+      }
+    }
+  }
+
+  return ok;
+}
+
 Json::Value objed::LinearClassifier::serialize() const
 {
   Json::Value data;
@@ -55,6 +55,7 @@ namespace objed
     virtual int height() const;
     virtual bool prepare(ImagePool *imagePool);
     virtual bool evaluate(float *result, int x, int y, DebugInfo *debugInfo) const;
+    virtual bool evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const;
     virtual Json::Value serialize() const;
     virtual Classifier * clone() const;
 
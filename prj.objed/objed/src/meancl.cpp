@@ -30,7 +30,9 @@ either expressed or implied, of copyright holders.
 */
 
 #include "meancl.h"
+#include "batchutils.h"
 
+#include <algorithm>
 #include <cassert>
 
 template<class T>
@@ -115,6 +117,44 @@ bool objed::MeanClassifier::evaluate(float *result, int x, int y, DebugInfo *deb
   return true;
 }
 
+bool objed::MeanClassifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  assert(intervalList.size() == preprocList.size());
+  assert(integralList.size() == preprocList.size());
+
+  const int wd = clWidth, wd2 = clWidth / 2;
+  const int ht = clHeight, ht2 = clHeight / 2;
+  const int area = wd * ht;
+
+  int offsets[4] = {0};
+  int averValues[BATCH_CHUNK_SIZE];
+
+  for (int i = 0; i < n; i += BATCH_CHUNK_SIZE)
+  {
+    const int count = std::min(n - i, BATCH_CHUNK_SIZE);
+
+    for (int j = 0; j < count; j++)
+    {
+      if (alive[i + j] != 0)
+        results[i + j] = 1.0;
+    }
+
+    for (size_t k = 0; k < integralList.size(); k++)
+    {
+      rectOffsets(offsets, integralList[k], -wd2, -ht2, wd, ht);
+      haarBatch(averValues, integralList[k], offsets, &area, 1, false, xs + i, ys + i, count);
+
+      for (int j = 0; j < count; j++)
+      {
+        if (alive[i + j] != 0 && intervalContains(intervalList[k], averValues[j]) == false)
+          results[i + j] = -1.0;
+      }
+    }
+  }
+
+  return true;
+}
+
 Json::Value objed::MeanClassifier::serialize() const
 {
   Json::Value data;
@@ -30,19 +30,36 @@ either expressed or implied, of copyright holders.
 */
 
 #include "multidet.h"
+#include "imagepool.h"
+
+objed::MultiContext::MultiContext(const std::vector<Detector *> &detectorList, ImagePool *extImagePool) :
+imagePool(0), isImagePoolOwn(false)
+{
+  imagePool = extImagePool != 0 ? extImagePool : new MultiScaleImagePool();
+  isImagePoolOwn = extImagePool == 0;
+
+  for (size_t i = 0; i < detectorList.size(); i++)
+    contextList.push_back(detectorList[i]->createContext(imagePool));
+}
+
+objed::MultiContext::~MultiContext()
+{
+  for (size_t i = 0; i < contextList.size(); i++)
+    DetectionContext::destroy(contextList[i]);
+
+  if (isImagePoolOwn == true)
+    objed::ImagePool::destroy(imagePool);
+}
 
 objed::MultiDetector::MultiDetector() : 
-imagePool(0), isImagePoolOwn(false), mergeIncluded(false), overlap(0.5)
+context(0), mergeIncluded(false), overlap(0.5)
 {
   return;
 }
 
 objed::MultiDetector::MultiDetector(const Json::Value &data, const std::string &workDir) : 
-imagePool(0), isImagePoolOwn(false), mergeIncluded(false), overlap(0.5)
+context(0), mergeIncluded(false), overlap(0.5)
 {
-  imagePool = ImagePool::create();
-  isImagePoolOwn = true;
-
   Json::Value detectorListData = data["detectorList"];
   if (detectorListData.isArray() && detectorListData.size() > 0)
   {
@@ -55,21 +72,19 @@ imagePool(0), isImagePoolOwn(false), mergeIncluded(false), overlap(0.5)
         detector = objed::Detector::create(detectorListData[i], workDir);
 
       if (detector != 0)
-      {
-        detector->setImagePool(imagePool);
         detectorList.push_back(detector);
-      }
     }
   }
 
+  context = new MultiContext(detectorList, 0);
+
   mergeIncluded = data.get("mergeIncluded", true).asBool();
   overlap = data.get("overlap", 0.5).asDouble();
 }
 
 objed::MultiDetector::~MultiDetector()
 {
-  if (isImagePoolOwn == true)
-    objed::ImagePool::destroy(imagePool);
+  DetectionContext::destroy(context);
 
   for (size_t i = 0; i < detectorList.size(); i++)
     objed::Detector::destroy(detectorList[i]);
@@ -77,15 +92,31 @@ objed::MultiDetector::~MultiDetector()
 
 objed::DetectionList objed::MultiDetector::detect(IplImage *image, DebugInfo *debugInfo)
 {
+  return detectInContext(context, image, debugInfo);
+}
+
+objed::DetectionList objed::MultiDetector::detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo) const
+{
+  MultiContext *multiContext = dynamic_cast<MultiContext *>(context);
+  if (multiContext == 0)
+    return DetectionList();
+
   DetectionList rawDetectionList;
 
+  MultiScaleImagePool *scaledPools = dynamic_cast<MultiScaleImagePool *>(multiContext->imagePool);
+  if (scaledPools != 0)
+    scaledPools->beginFrame();
+
   for (size_t i = 0; i < detectorList.size(); i++)
   {
-    DetectionList d = detectorList[i]->detect(image, debugInfo);
+    DetectionList d = detectorList[i]->detectInContext(multiContext->contextList[i], image, debugInfo);
     for (size_t j = 0; j < d.size(); j++)
       rawDetectionList.push_back(d[j]);
   }
 
+  if (scaledPools != 0)
+    scaledPools->endFrame();
+
   DetectionList clusteredDetectionList = objed::cluster(rawDetectionList, overlap);
   return mergeIncluded == true ? objed::mergeIncluded(clusteredDetectionList) : clusteredDetectionList;
 }
@@ -93,48 +124,31 @@ objed::DetectionList objed::MultiDetector::detect(IplImage *image, DebugInfo *de
 objed::Detector * objed::MultiDetector::clone() const
 {
   MultiDetector *newMultiDet = new MultiDetector();
-
-  if (isImagePoolOwn == true)
-  {
-    newMultiDet->imagePool = ImagePool::create();
-    newMultiDet->isImagePoolOwn = isImagePoolOwn;
-  }
-  else
-  {
-    newMultiDet->imagePool = imagePool;
-    newMultiDet->isImagePoolOwn = isImagePoolOwn;
-  }
+  const MultiContext *multiContext = static_cast<const MultiContext *>(context);
 
   for (size_t i = 0; i < detectorList.size(); i++)
-  {
-    Detector *newDetector = detectorList[i]->clone();
-    newDetector->setImagePool(imagePool);
-    newMultiDet->detectorList.push_back(newDetector);
-  }
+    newMultiDet->detectorList.push_back(detectorList[i]->clone());
+  newMultiDet->context = new MultiContext(newMultiDet->detectorList, multiContext->isImagePoolOwn ? 0 : multiContext->imagePool);
+
+  newMultiDet->overlap = overlap;
+  newMultiDet->mergeIncluded = mergeIncluded;
 
   return newMultiDet;
 }
 
-void objed::MultiDetector::setImagePool(objed::ImagePool *extImagePool)
+objed::DetectionContext * objed::MultiDetector::createContext(ImagePool *extImagePool) const
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
-
-  isImagePoolOwn = false;
-  imagePool = extImagePool;
+  return new MultiContext(detectorList, extImagePool);
+}
 
-  for (size_t i = 0; i < detectorList.size(); i++)
-    detectorList[i]->setImagePool(imagePool);
+void objed::MultiDetector::setImagePool(objed::ImagePool *extImagePool)
+{
+  DetectionContext::destroy(context);
+  context = new MultiContext(detectorList, extImagePool);
 }
 
 void objed::MultiDetector::resetImagePool()
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
-
-  isImagePoolOwn = true;
-  imagePool = objed::ImagePool::create();
-
-  for (size_t i = 0; i < detectorList.size(); i++)
-    detectorList[i]->setImagePool(imagePool);
+  DetectionContext::destroy(context);
+  context = new MultiContext(detectorList, 0);
 }
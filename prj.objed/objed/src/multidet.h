@@ -41,6 +41,21 @@ either expressed or implied, of copyright holders.
 
 namespace objed
 {
+  // Context of MultiDetector: the contexts of its detectors bound to one shared image pool
+  class MultiContext : public DetectionContext
+  {
+    OBJED_DISABLE_COPY(MultiContext)
+
+  public:
+    MultiContext(const std::vector<Detector *> &detectorList, ImagePool *extImagePool);
+    virtual ~MultiContext();
+
+  public:
+    ImagePool *imagePool;
+    bool isImagePoolOwn;
+    std::vector<DetectionContext *> contextList;
+  };
+
   class MultiDetector : public Detector
   {
     OBJED_TYPE("multiDetector")
@@ -53,18 +68,17 @@ namespace objed
 
   public:
     virtual DetectionList detect(IplImage *image, DebugInfo *debugInfo);
+    virtual DetectionList detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo = 0) const;
+    virtual DetectionContext * createContext(ImagePool *extImagePool = 0) const;
 
     virtual Detector * clone() const;
 
     virtual void setImagePool(objed::ImagePool *extImagePool);
     virtual void resetImagePool();
 
-  private:
-    ImagePool *imagePool;
-    bool isImagePoolOwn;
-
   private:
     std::vector<objed::Detector *> detectorList;
+    DetectionContext *context;
 
   private:
     bool mergeIncluded;
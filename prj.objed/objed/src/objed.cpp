@@ -34,6 +34,7 @@ either expressed or implied, of copyright holders.
 #include <algorithm>
 #include <fstream>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 #include <string>
 
@@ -135,11 +136,18 @@ static void * resolveFunction(const std::string &libraryName, const std::string
 #include "haar3pwcl.h"
 #include "meancl.h"
 #include "roicl.h"
+#include "binarycl.h"
 
 #include "simpledet.h"
 #include "yscaledet.h"
 #include "lazydet.h"
 #include "multidet.h"
+#include "videodet.h"
+#include "detector.h"
+
+// Type of the former flat classifier wrapper: its classifier is lowered into a
+// BinaryClassifier the same way detector classifiers are (see createSharedClassifier)
+static const std::string COMPILED_CLASSIFIER_TYPE = "compiledClassifier";
 
 objed::ImagePool * objed::ImagePool::create()
 {
@@ -158,6 +166,9 @@ objed::Classifier * objed::Classifier::create(const std::string &path, const std
   Json::Value valueData;
 
   std::string absPath = absolutePath(path, workDir);
+  if (BinaryClassifier::isBinary(absPath) == true)
+    return BinaryClassifier::load(absPath);
+
   std::ifstream ifs(absPath.c_str(), std::ios_base::in);
   if (ifs.is_open() == false)
     return 0;
@@ -204,6 +215,8 @@ objed::Classifier * objed::Classifier::create(const Json::Value &data, const std
     return new MeanClassifier(data);
   else if (clType == RoiClassifier::typeStatic())
     return new RoiClassifier(data);
+  else if (clType == COMPILED_CLASSIFIER_TYPE)
+    return createSharedClassifier(data["classifier"], workDir);
   else
   {
     std::transform(clType.begin(), clType.end(), clType.begin(), ::tolower);
@@ -249,6 +262,8 @@ void objed::Classifier::destroy(Classifier *&classifier)
     delete_ptr(classifier);
   else if (clType == RoiClassifier::typeStatic())
     delete_ptr(classifier);
+  else if (clType == BinaryClassifier::typeStatic())
+    delete_ptr(classifier);
   else 
   {
     std::transform(clType.begin(), clType.end(), clType.begin(), ::tolower);
@@ -257,6 +272,77 @@ void objed::Classifier::destroy(Classifier *&classifier)
   }
 }
 
+// Evaluates alive lanes one by one; lanes whose evaluation fails are cleared from alive
+bool objed::Classifier::evaluateBatch(const int *xs, const int *ys, int n, float *results, uint8_t *alive) const
+{
+  bool ok = true;
+
+  for (int i = 0; i < n; i++)
+  {
+    if (alive[i] == 0)
+      continue;
+
+    if (evaluate(&results[i], xs[i], ys[i]) == false)
+    {
+      alive[i] = 0;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+// Context of detectors that do not create their own: the detector is cloned into it
+class CloneContext : public objed::DetectionContext
+{
+public:
+  CloneContext(objed::Detector *detector) : detector(detector) {};
+  virtual ~CloneContext() { objed::Detector::destroy(detector); };
+
+public:
+  objed::Detector *detector;
+};
+
+void objed::DetectionContext::destroy(DetectionContext *&context)
+{
+  delete_ptr(context);
+}
+
+objed::DetectionList objed::Detector::detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo) const
+{
+  CloneContext *cloneContext = dynamic_cast<CloneContext *>(context);
+  if (cloneContext == 0 || cloneContext->detector == 0)
+    return DetectionList();
+
+  return cloneContext->detector->detect(image, debugInfo);
+}
+
+objed::DetectionContext * objed::Detector::createContext(ImagePool *extImagePool) const
+{
+  // Detectors without contexts of their own are deep-copied for every context
+  fprintf(stderr, "objed: %s has no detection contexts, cloning it for a new context\n", type().c_str());
+
+  Detector *detector = clone();
+  if (detector != 0 && extImagePool != 0)
+    detector->setImagePool(extImagePool);
+
+  return new CloneContext(detector);
+}
+
+void objed::Detector::setBudget(const DetectionBudget &budget)
+{
+  return;
+}
+
+objed::DetectionCoverage objed::Detector::coverage(const DetectionContext *context) const
+{
+  const CloneContext *cloneContext = dynamic_cast<const CloneContext *>(context);
+  if (cloneContext == 0 || cloneContext->detector == 0)
+    return DetectionCoverage();
+
+  return cloneContext->detector->coverage();
+}
+
 objed::Detector * objed::Detector::create(const std::string &path, const std::string &workDir)
 {
   Json::Reader reader;
@@ -289,6 +375,8 @@ objed::Detector * objed::Detector::create(const Json::Value &data, const std::st
     return new LazyDetector(data, workDir);
   else if (detType == MultiDetector::typeStatic())
     return new MultiDetector(data, workDir);
+  else if (detType == VideoDetector::typeStatic())
+    return new VideoDetector(data, workDir);
   else
   {
     std::transform(detType.begin(), detType.end(), detType.begin(), ::tolower);
@@ -312,6 +400,8 @@ void objed::Detector::destroy(Detector *&detector)
     delete_ptr(detector);
   else if (detType == MultiDetector::typeStatic())
     delete_ptr(detector);
+  else if (detType == VideoDetector::typeStatic())
+    delete_ptr(detector);
   else
   {
     std::transform(detType.begin(), detType.end(), detType.begin(), ::tolower);
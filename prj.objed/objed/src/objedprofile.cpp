@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <objed/objedprofile.h>
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+
+static thread_local objed::StageProfile *currentProfile = 0;
+static thread_local objed::StageTimer *currentTimer = 0;
+static thread_local bool isWorkerProfile = false;
+static std::mutex workerMutex;
+
+objed::StageProfile::StageProfile()
+{
+  reset();
+}
+
+void objed::StageProfile::reset()
+{
+  std::fill(seconds, seconds + STAGE_COUNT, 0.0);
+  windowCount = 0;
+}
+
+objed::StageProfile * objed::StageProfile::current()
+{
+  return currentProfile;
+}
+
+void objed::StageProfile::setCurrent(StageProfile *profile)
+{
+  currentProfile = profile;
+}
+
+void objed::StageProfile::addWindows(long long count)
+{
+  if (currentProfile != 0)
+    currentProfile->windowCount += count;
+}
+
+const char * objed::StageProfile::stageName(int stage)
+{
+  static const char *names[STAGE_COUNT] = {"resize", "update", "scan", "cluster", "merge"};
+  return (stage >= 0 && stage < STAGE_COUNT) ? names[stage] : "";
+}
+
+objed::StageTimer::StageTimer(StageProfile::Stage stage) : 
+profile(isWorkerProfile == true ? 0 : currentProfile), stage(stage), parent(0)
+{
+  if (profile == 0)
+    return;
+
+  start = std::chrono::steady_clock::now();
+
+  // The enclosing timer is paused until this one stops
+  parent = currentTimer;
+  if (parent != 0)
+  {
+    std::chrono::duration<double> elapsed = start - parent->start;
+    parent->profile->seconds[parent->stage] += elapsed.count();
+  }
+  currentTimer = this;
+}
+
+objed::StageTimer::~StageTimer()
+{
+  stop();
+}
+
+void objed::StageTimer::stop()
+{
+  if (profile == 0)
+    return;
+
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = now - start;
+  profile->seconds[stage] += elapsed.count();
+  profile = 0;
+
+  assert(currentTimer == this);
+  currentTimer = parent;
+  if (parent != 0)
+    parent->start = now;
+}
+
+objed::StageWorkerScope::StageWorkerScope(StageProfile *profile) : 
+profile(profile), previous(currentProfile), isPreviousWorker(isWorkerProfile)
+{
+  if (profile == 0 || profile == currentProfile)
+  {
+    this->profile = 0;
+    return;
+  }
+
+  currentProfile = &workerProfile;
+  isWorkerProfile = true;
+}
+
+objed::StageWorkerScope::~StageWorkerScope()
+{
+  if (profile == 0)
+    return;
+
+  currentProfile = previous;
+  isWorkerProfile = isPreviousWorker;
+
+  std::lock_guard<std::mutex> lock(workerMutex);
+  profile->windowCount += workerProfile.windowCount;
+}
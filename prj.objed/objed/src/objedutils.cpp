@@ -30,10 +30,18 @@ either expressed or implied, of copyright holders.
 */
 
 #include <objed/objedutils.h>
+#include <objed/objedprofile.h>
+
+#include "rectgrid.h"
 
 #include <algorithm>
+#include <climits>
+#include <cmath>
 #include <cstring>
 
+// Smallest number of rects per strip of clusterParallel()
+static const size_t MIN_STRIP_RECT_COUNT = 256;
+
 namespace objed
 {
   template<class T> bool compareRectsLess(const Rect<T> &r1, const Rect<T> &r2)
@@ -104,121 +112,245 @@ namespace objed
     return Interval<double>(data["min"].asDouble(), data["max"].asDouble());
   }
 
-  template<class T> std::vector<Cluster<T> > cluster(const std::vector<Rect<T> > &rectList, double overlap)
+  template<class T> static inline int clusterPower(const Rect<T> &)
+  {
+    return 1;
+  }
+
+  template<class T> static inline int clusterPower(const Cluster<T> &cluster)
+  {
+    return cluster.power;
+  }
+
+  template<class T> static inline bool isOverlapped(const Rect<T> &cluster, const Rect<T> &rect, double overlap)
+  {
+    Rect<T> intersection = intersected(cluster, rect);
+    T intersectionArea = intersection.width * intersection.height;
+    T maxArea = std::max(cluster.width * cluster.height, rect.width * rect.height);
+    return intersectionArea > maxArea * overlap;
+  }
+
+  // Each item (a rect or a weighted cluster) joins the latest created cluster it overlaps or
+  // starts a new one. The grid only narrows down the clusters compared with an item, so the result
+  // is the same as of comparing it with all clusters from the latest one back. Irregular rects
+  // (see RectGrid) are rare and always compared with everything
+  template<class T, class Item> static std::vector<Cluster<T> > clusterGreedy(const std::vector<Item> &itemList, double overlap)
   {
     std::vector<Cluster<T> > clusterList;
     std::vector<Rect<T> > intClusterList;
 
     if (overlap >= 1.0)
     {
-      for (size_t iRect = 0; iRect < rectList.size(); iRect++)
-        clusterList.push_back(Cluster<T>(rectList[iRect], 1));
+      for (size_t iItem = 0; iItem < itemList.size(); iItem++)
+        clusterList.push_back(Cluster<T>(itemList[iItem], clusterPower(itemList[iItem])));
       return clusterList;
     }
 
-    DetectionList::const_iterator itDet;
-    for (size_t iRect = 0; iRect < rectList.size(); iRect++)
+    // Grid candidates intersect the item, with a negative overlap disjoint clusters merge too
+    const bool useGrid = overlap >= 0;
+
+    RectGrid<T> grid;
+    std::vector<int> irregularList, candidateList;
+
+    for (size_t iItem = 0; iItem < itemList.size(); iItem++)
     {
-      const Rect<T> &rect = rectList[iRect];
-      bool rectClustered = false;
+      const Rect<T> &rect = itemList[iItem];
+      const int power = clusterPower(itemList[iItem]);
+      int match = -1;
 
-      for (int iClust = clusterList.size() - 1; iClust >= 0 && rectClustered == false; iClust--)
+      if (useGrid == true && RectGrid<T>::isRegular(rect) == true)
       {
-        Cluster<T> &cluster = clusterList[iClust];
-        Rect<T> &intCluster = intClusterList[iClust];
-
-        Rect<T> intersection = intersected(cluster, rect);
-        T intersectionArea = intersection.width * intersection.height;
-        T maxArea = std::max(cluster.width * cluster.height, rect.width * rect.height);
-        
-        if (intersectionArea > maxArea * overlap)
+        // The intersection is not larger than the smaller area, so with a positive overlap only 
+        // clusters of areas within a factor of 1 / overlap of the item area can match it
+        const double area = static_cast<double>(rect.width) * static_cast<double>(rect.height);
+        const int minBand = overlap > 0 ? RectGrid<T>::areaBand(area * overlap) - 1 : INT_MIN;
+        const int maxBand = overlap > 0 ? RectGrid<T>::areaBand(area / overlap) + 1 : INT_MAX;
+
+        grid.query(candidateList, rect, minBand, maxBand);
+        candidateList.insert(candidateList.end(), irregularList.begin(), irregularList.end());
+
+        for (size_t iCandidate = 0; iCandidate < candidateList.size(); iCandidate++)
+        {
+          const int candidate = candidateList[iCandidate];
+          if (candidate > match && isOverlapped(clusterList[candidate], rect, overlap) == true)
+            match = candidate;
+        }
+      }
+      else
+      {
+        for (int iClust = clusterList.size() - 1; iClust >= 0 && match < 0; iClust--)
         {
-          cluster.power++;
-          cluster.x = (intCluster.x += rect.x) / cluster.power;
-          cluster.y = (intCluster.y += rect.y) / cluster.power;
-          cluster.width = (intCluster.width += rect.width) / cluster.power;
-          cluster.height = (intCluster.height += rect.height) / cluster.power;
-          rectClustered = true;
+          if (isOverlapped(clusterList[iClust], rect, overlap) == true)
+            match = iClust;
         }
       }
 
-      if (rectClustered == false)
+      if (match >= 0)
+      {
+        Cluster<T> &cluster = clusterList[match];
+        Rect<T> &intCluster = intClusterList[match];
+
+        if (RectGrid<T>::isRegular(cluster) == true)
+          grid.remove(match);
+        else
+          irregularList.erase(std::find(irregularList.begin(), irregularList.end(), match));
+
+        cluster.power += power;
+        cluster.x = (intCluster.x += rect.x * power) / cluster.power;
+        cluster.y = (intCluster.y += rect.y * power) / cluster.power;
+        cluster.width = (intCluster.width += rect.width * power) / cluster.power;
+        cluster.height = (intCluster.height += rect.height * power) / cluster.power;
+      }
+      else
       {
-        clusterList.push_back(Cluster<T>(rect, 1));
-        intClusterList.push_back(rect);
+        match = clusterList.size();
+        clusterList.push_back(Cluster<T>(rect, power));
+        intClusterList.push_back(Rect<T>(rect.x * power, rect.y * power, rect.width * power, rect.height * power));
       }
+
+      if (RectGrid<T>::isRegular(clusterList[match]) == true)
+        grid.insert(match, clusterList[match]);
+      else
+        irregularList.push_back(match);
     }
 
     return clusterList;
   }
 
-  template std::vector<Cluster<int> > cluster(const std::vector<Rect<int> > &rectList, double maxDistance);
+  template<class T> std::vector<Cluster<T> > cluster(const std::vector<Rect<T> > &rectList, double overlap)
+  {
+    StageTimer timer(StageProfile::STAGE_CLUSTER);
+    return clusterGreedy<T>(rectList, overlap);
+  }
 
-  template std::vector<Cluster<double> > cluster(const std::vector<Rect<double> > &rectList, double maxDistance);
+  template std::vector<Cluster<int> > cluster(const std::vector<Rect<int> > &rectList, double overlap);
+
+  template std::vector<Cluster<double> > cluster(const std::vector<Rect<double> > &rectList, double overlap);
 
   template<class T> std::vector<Cluster<T> > cluster(const std::vector<Cluster<T> > &clusterList, double overlap)
   {
-    std::vector<Cluster<T> > outClusterList;
-    std::vector<Rect<T> > intOutClusterList;
+    StageTimer timer(StageProfile::STAGE_CLUSTER);
+    return clusterGreedy<T>(clusterList, overlap);
+  }
 
-    if (overlap >= 1.0)
-      return clusterList;
+  template std::vector<Cluster<int> > cluster(const std::vector<Cluster<int> > &clusterList, double overlap);
+
+  template std::vector<Cluster<double> > cluster(const std::vector<Cluster<double> > &clusterList, double overlap);
+
+  template<class T> std::vector<Cluster<T> > clusterParallel(const std::vector<Rect<T> > &rectList, 
+    double overlap, int threadCount)
+  {
+    StageTimer timer(StageProfile::STAGE_CLUSTER);
 
-    DetectionList::const_iterator itDet;
-    for (size_t iClust = 0; iClust < clusterList.size(); iClust++)
+    // Horizontal strips by rect centers, each clustered by its own thread
+    double minY = 0, maxY = 0, maxHeight = 0;
+    bool isEmpty = true;
+    for (size_t iRect = 0; iRect < rectList.size(); iRect++)
     {
-      const Cluster<T> &cluster = clusterList[iClust];
-      bool clusterClustered = false;
+      const Rect<T> &rect = rectList[iRect];
+      if (RectGrid<T>::isRegular(rect) == false)
+        continue;
+
+      const double cy = rect.y + static_cast<double>(rect.height) / 2;
+      minY = isEmpty == true ? cy : std::min(minY, cy);
+      maxY = isEmpty == true ? cy : std::max(maxY, cy);
+      maxHeight = std::max(maxHeight, static_cast<double>(rect.height));
+      isEmpty = false;
+    }
 
-      for (int iOutClust = outClusterList.size() - 1; iOutClust >= 0 && clusterClustered == false; iOutClust--)
-      {
-        Cluster<T> &outCluster = outClusterList[iOutClust];
-        Rect<T> &intOutCluster = intOutClusterList[iOutClust];
+    const int stripCount = std::min(threadCount, static_cast<int>(rectList.size() / MIN_STRIP_RECT_COUNT));
+    if (overlap < 0 || overlap >= 1.0 || stripCount <= 1 || maxY - minY <= 2 * maxHeight)
+      return clusterGreedy<T>(rectList, overlap);
 
-        Rect<T> intersection = intersected(outCluster, cluster);
-        T intersectionArea = intersection.width * intersection.height;
-        T maxArea = std::max(outCluster.width * outCluster.height, cluster.width * cluster.height);
+    const double stripHeight = (maxY - minY) / stripCount;
+    std::vector<std::vector<Rect<T> > > stripRectLists(stripCount);
+    for (size_t iRect = 0; iRect < rectList.size(); iRect++)
+    {
+      const Rect<T> &rect = rectList[iRect];
+      const double cy = rect.y + static_cast<double>(rect.height) / 2;
+      const double strip = std::floor((cy - minY) / stripHeight);
+      const int iStrip = strip >= 0 ? static_cast<int>(std::min(strip, stripCount - 1.0)) : 0;
+      stripRectLists[iStrip].push_back(rect);
+    }
 
-        if (intersectionArea > maxArea * overlap)
-        {
-          outCluster.power += cluster.power;
-          outCluster.x = (intOutCluster.x += cluster.x * cluster.power) / outCluster.power;
-          outCluster.y = (intOutCluster.y += cluster.y * cluster.power) / outCluster.power;
-          outCluster.width = (intOutCluster.width += cluster.width * cluster.power) / outCluster.power;
-          outCluster.height = (intOutCluster.height += cluster.height * cluster.power) / outCluster.power;
-          clusterClustered = true;
-        }
-      }
+    std::vector<std::vector<Cluster<T> > > stripClusterLists(stripCount);
 
-      if (clusterClustered == false)
+    StageProfile *profile = StageProfile::current();
+
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+    for (int iStrip = 0; iStrip < stripCount; iStrip++)
+    {
+      StageWorkerScope workerScope(profile);
+      stripClusterLists[iStrip] = clusterGreedy<T>(stripRectLists[iStrip], overlap);
+    }
+
+    // Only clusters close to the strip borders can overlap clusters of other strips
+    // (clusters are never higher than the highest rect), they are clustered again
+    std::vector<Cluster<T> > outClusterList, borderClusterList;
+    for (int iStrip = 0; iStrip < stripCount; iStrip++)
+    {
+      const double stripTop = minY + iStrip * stripHeight, stripBottom = stripTop + stripHeight;
+      const std::vector<Cluster<T> > &stripClusterList = stripClusterLists[iStrip];
+
+      for (size_t iClust = 0; iClust < stripClusterList.size(); iClust++)
       {
-        outClusterList.push_back(cluster);
-        intOutClusterList.push_back(Rect<T>(cluster.x * cluster.power, cluster.y * cluster.power,
-          cluster.width * cluster.power, cluster.height * cluster.power));
+        const Cluster<T> &cluster = stripClusterList[iClust];
+        const double top = cluster.y, bottom = cluster.y + static_cast<double>(cluster.height);
+        const bool nearTop = iStrip > 0 && top < stripTop + maxHeight;
+        const bool nearBottom = iStrip < stripCount - 1 && bottom > stripBottom - maxHeight;
+        if (nearTop == true || nearBottom == true || RectGrid<T>::isRegular(cluster) == false)
+          borderClusterList.push_back(cluster);
+        else
+          outClusterList.push_back(cluster);
       }
     }
 
+    std::vector<Cluster<T> > borderOutClusterList = clusterGreedy<T>(borderClusterList, overlap);
+    outClusterList.insert(outClusterList.end(), borderOutClusterList.begin(), borderOutClusterList.end());
     return outClusterList;
   }
 
-  template std::vector<Cluster<int> > cluster(const std::vector<Cluster<int> > &clusterList, double maxDistance);
+  template std::vector<Cluster<int> > clusterParallel(const std::vector<Rect<int> > &rectList, 
+    double overlap, int threadCount);
 
-  template std::vector<Cluster<double> > cluster(const std::vector<Cluster<double> > &clusterList, double maxDistance);
+  template std::vector<Cluster<double> > clusterParallel(const std::vector<Rect<double> > &rectList, 
+    double overlap, int threadCount);
 
   template<class T> std::vector<Cluster<T> > mergeIncluded(const std::vector<Cluster<T> > &clusterList)
   {
+    StageTimer timer(StageProfile::STAGE_MERGE);
+
     std::vector<Cluster<T> > oldClusterList = clusterList;
     std::sort(oldClusterList.begin(), oldClusterList.end(), compareRectsGreater<T>);
 
+    // A cluster includes the regular ones it intersects, which are found by the grid; the rest
+    // is compared with all clusters
+    RectGrid<T> grid;
+    std::vector<int> irregularList, candidateList;
+
     std::vector<Cluster<T> > newClusterList;
     for (typename std::vector<Cluster<T> >::iterator itOld = oldClusterList.begin(); itOld != oldClusterList.end(); ++itOld)
     {
       bool isIncluded = false;
       const Cluster<T> &oldCluster = *itOld;
+      const bool isRegular = RectGrid<T>::isRegular(oldCluster);
 
-      for (typename std::vector<Cluster<T> >::iterator itNew = newClusterList.begin(); itNew != newClusterList.end(); ++itNew)
+      candidateList.clear();
+      if (isRegular == true)
       {
-        Cluster<T> &newCluster = *itNew;
+        // Clusters are sorted by area, and ones including the old cluster are not smaller
+        grid.query(candidateList, oldCluster, RectGrid<T>::band(oldCluster) - 1, INT_MAX);
+        candidateList.insert(candidateList.end(), irregularList.begin(), irregularList.end());
+      }
+      else
+      {
+        for (size_t iNew = 0; iNew < newClusterList.size(); iNew++)
+          candidateList.push_back(iNew);
+      }
+
+      for (size_t iCandidate = 0; iCandidate < candidateList.size(); iCandidate++)
+      {
+        Cluster<T> &newCluster = newClusterList[candidateList[iCandidate]];
         Rect<T> intersectedRect = intersected(newCluster, oldCluster);
         if (memcmp(&intersectedRect, &oldCluster, sizeof(intersectedRect)) == 0)
         {
@@ -228,7 +360,13 @@ namespace objed
       }
 
       if (isIncluded == false)
+      {
+        if (isRegular == true)
+          grid.insert(newClusterList.size(), oldCluster);
+        else
+          irregularList.push_back(newClusterList.size());
         newClusterList.push_back(oldCluster);
+      }
     }
 
     return newClusterList;
@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include "rectgrid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+// Cell coordinates are clamped to [-CELL_COORD_LIMIT, CELL_COORD_LIMIT) so that keys are unique
+static const long long CELL_COORD_LIMIT = 1LL << 30;
+
+// Bands of areas out of the range of positive doubles (see RectGrid::areaBand)
+static const int MIN_BAND = -1100, MAX_BAND = 1100;
+
+template<class T> objed::RectGrid<T>::RectGrid()
+{
+  return;
+}
+
+template<class T> bool objed::RectGrid<T>::isRegular(const Rect<T> &rect)
+{
+  const double x = rect.x, y = rect.y, width = rect.width, height = rect.height;
+  const double area = width * height;
+  return width > 0 && height > 0 && area > 0 && std::isfinite(area) && 
+    std::isfinite(x) && std::isfinite(y) && std::isfinite(x + width) && std::isfinite(y + height);
+}
+
+template<class T> int objed::RectGrid<T>::band(const Rect<T> &rect)
+{
+  return areaBand(static_cast<double>(rect.width) * static_cast<double>(rect.height));
+}
+
+template<class T> int objed::RectGrid<T>::areaBand(double area)
+{
+  if (area > 0 && std::isfinite(area))
+    return std::ilogb(area);
+  return area > 0 ? MAX_BAND : MIN_BAND;
+}
+
+template<class T> void objed::RectGrid<T>::clear()
+{
+  bandMap.clear();
+  bandList.clear();
+  keyList.clear();
+}
+
+template<class T> void objed::RectGrid<T>::insert(int index, const Rect<T> &rect)
+{
+  assert(index >= 0 && isRegular(rect) == true);
+
+  if (bandList.size() <= static_cast<size_t>(index))
+  {
+    bandList.resize(index + 1, INT_MIN);
+    keyList.resize(index + 1, 0);
+  }
+
+  assert(bandList[index] == INT_MIN);
+
+  const int rectBand = band(rect);
+  typename std::map<int, Band>::iterator itBand = bandMap.find(rectBand);
+  if (itBand == bandMap.end())
+  {
+    Band newBand;
+    newBand.cellSize = std::sqrt(std::ldexp(1.0, rectBand + 1));
+    newBand.maxWidth = 0;
+    newBand.maxHeight = 0;
+    itBand = bandMap.insert(std::make_pair(rectBand, newBand)).first;
+  }
+
+  Band &bandData = itBand->second;
+  const double width = rect.width, height = rect.height;
+  bandData.maxWidth = std::max(bandData.maxWidth, width);
+  bandData.maxHeight = std::max(bandData.maxHeight, height);
+
+  const double cx = rect.x + width / 2, cy = rect.y + height / 2;
+  const long long key = cellKey(cellCoord(cx, bandData.cellSize), cellCoord(cy, bandData.cellSize));
+  bandData.cellMap[key].push_back(index);
+
+  bandList[index] = rectBand;
+  keyList[index] = key;
+}
+
+template<class T> void objed::RectGrid<T>::remove(int index)
+{
+  if (index < 0 || static_cast<size_t>(index) >= bandList.size() || bandList[index] == INT_MIN)
+    return;
+
+  std::vector<int> &cell = bandMap[bandList[index]].cellMap[keyList[index]];
+  std::vector<int>::iterator itIndex = std::find(cell.begin(), cell.end(), index);
+  assert(itIndex != cell.end());
+
+  *itIndex = cell.back();
+  cell.pop_back();
+
+  bandList[index] = INT_MIN;
+}
+
+template<class T> void objed::RectGrid<T>::query(std::vector<int> &indexList, 
+  const Rect<T> &rect, int minBand, int maxBand) const
+{
+  assert(isRegular(rect) == true);
+
+  indexList.clear();
+
+  const double width = rect.width, height = rect.height;
+  const double cx = rect.x + width / 2, cy = rect.y + height / 2;
+
+  typename std::map<int, Band>::const_iterator itBand = bandMap.lower_bound(minBand);
+  for (; itBand != bandMap.end() && itBand->first <= maxBand; ++itBand)
+  {
+    const Band &bandData = itBand->second;
+
+    // Centers of intersecting rects are closer than the half sum of their sizes (the slack 
+    // covers the rounding of centers, cell coordinates are monotonic in them)
+    const double xExtent = (width + bandData.maxWidth) / 2, yExtent = (height + bandData.maxHeight) / 2;
+    const double xSlack = 8 * DBL_EPSILON * (std::fabs(cx) + xExtent);
+    const double ySlack = 8 * DBL_EPSILON * (std::fabs(cy) + yExtent);
+
+    const long long minCol = cellCoord(cx - xExtent - xSlack, bandData.cellSize);
+    const long long maxCol = cellCoord(cx + xExtent + xSlack, bandData.cellSize);
+    const long long minRow = cellCoord(cy - yExtent - ySlack, bandData.cellSize);
+    const long long maxRow = cellCoord(cy + yExtent + ySlack, bandData.cellSize);
+
+    const double cellCount = static_cast<double>(maxCol - minCol + 1) * static_cast<double>(maxRow - minRow + 1);
+    if (cellCount > static_cast<double>(bandData.cellMap.size()))
+    {
+      typename std::unordered_map<long long, std::vector<int> >::const_iterator itCell = bandData.cellMap.begin();
+      for (; itCell != bandData.cellMap.end(); ++itCell)
+        indexList.insert(indexList.end(), itCell->second.begin(), itCell->second.end());
+      continue;
+    }
+
+    for (long long row = minRow; row <= maxRow; row++)
+    {
+      for (long long col = minCol; col <= maxCol; col++)
+      {
+        typename std::unordered_map<long long, std::vector<int> >::const_iterator itCell = 
+          bandData.cellMap.find(cellKey(col, row));
+        if (itCell != bandData.cellMap.end())
+          indexList.insert(indexList.end(), itCell->second.begin(), itCell->second.end());
+      }
+    }
+  }
+}
+
+template<class T> long long objed::RectGrid<T>::cellCoord(double coord, double cellSize)
+{
+  const double cell = std::floor(coord / cellSize);
+  if (!(cell >= static_cast<double>(-CELL_COORD_LIMIT)))
+    return -CELL_COORD_LIMIT;
+  if (cell >= static_cast<double>(CELL_COORD_LIMIT))
+    return CELL_COORD_LIMIT - 1;
+  return static_cast<long long>(cell);
+}
+
+template<class T> long long objed::RectGrid<T>::cellKey(long long col, long long row)
+{
+  return ((col + CELL_COORD_LIMIT) << 32) | (row + CELL_COORD_LIMIT);
+}
+
+template class objed::RectGrid<int>;
+
+template class objed::RectGrid<double>;
@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef RECTGRID_H_INCLUDED
+#define RECTGRID_H_INCLUDED
+
+#include <objed/simplest.h>
+
+#include <climits>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace objed
+{
+  // Index of rects bucketed by scale band (power of two range of the area) and by the cell of
+  // their center in a uniform grid of the band. query() returns a superset of the indexed rects
+  // that intersect a given one, so clustering only compares neighbors instead of all pairs.
+  // Rects with a non-positive or non-finite size are not regular and can't be indexed
+  template<class T> class RectGrid
+  {
+  public:
+    RectGrid();
+
+  public:
+    static bool isRegular(const Rect<T> &rect);
+    static int band(const Rect<T> &rect);
+    static int areaBand(double area);
+
+  public:
+    void clear();
+    void insert(int index, const Rect<T> &rect);
+    void remove(int index);
+    void query(std::vector<int> &indexList, const Rect<T> &rect, int minBand, int maxBand) const;
+
+  private:
+    struct Band
+    {
+      double cellSize;
+      double maxWidth, maxHeight;
+      std::unordered_map<long long, std::vector<int> > cellMap;
+    };
+
+  private:
+    static long long cellCoord(double coord, double cellSize);
+    static long long cellKey(long long col, long long row);
+
+  private:
+    std::map<int, Band> bandMap;
+    std::vector<int> bandList;
+    std::vector<long long> keyList;
+  };
+}
+
+#endif  // RECTGRID_H_INCLUDED
@@ -30,35 +30,56 @@ either expressed or implied, of copyright holders.
 */
 
 #include "simpledet.h"
+#include "batchutils.h"
+#include "detutils.h"
 
 #include <opencv/cv.h>
 
 #include <cstring>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+
+// Pyramid level of a budgeted scan
+struct BudgetLevel
+{
+  double scale;
+  int width, height;
+  double score;
+  long long scannedWindowCount;
+  size_t hitCount;
+};
+
+// Pass of a budgeted scan over the rows yOffset, yOffset + yStride, ... and the columns 
+// xOffset, xOffset + xStride, ... of the window grid of a level (in steps)
+struct BudgetPass
+{
+  BudgetPass(size_t level, int yOffset, int yStride, int xOffset, int xStride) :
+  level(level), yOffset(yOffset), yStride(yStride), xOffset(xOffset), xStride(xStride) {}
+
+  size_t level;
+  int yOffset, yStride;
+  int xOffset, xStride;
+};
 
 objed::SimpleDetector::SimpleDetector() : 
-imagePool(0), isImagePoolOwn(false), classifier(0),
+classifier(0), context(0),
 minScale(1.0), maxScale(1.0), stpScale(1.1), leftMargin(0), 
 rightMargin(0), topMargin(0), bottomMargin(0), 
-xStep(0), yStep(0), mergeIncluded(true), overlap(0.5)
+xStep(0), yStep(0), mergeIncluded(true), overlap(0.5), threadCount(1), exactClustering(true), pyramidFromPrevious(false), levelScoreDecay(0.5)
 {
-  imagePool = ImagePool::create();
-  isImagePoolOwn = true;
+  return;
 }
 
 objed::SimpleDetector::SimpleDetector(const Json::Value &data, const std::string &workDir) :
-imagePool(0), isImagePoolOwn(false), classifier(0), minScale(1.0), maxScale(1.0), stpScale(1.1), leftMargin(0), rightMargin(0),
-topMargin(0), bottomMargin(0), xStep(0), yStep(0), mergeIncluded(true), overlap(0.5)
+classifier(0), context(0), minScale(1.0), maxScale(1.0), stpScale(1.1), leftMargin(0), rightMargin(0),
+topMargin(0), bottomMargin(0), xStep(0), yStep(0), mergeIncluded(true), overlap(0.5), threadCount(1), exactClustering(true), pyramidFromPrevious(false), levelScoreDecay(0.5)
 {
-  imagePool = ImagePool::create();
-  isImagePoolOwn = true;
-
-  classifier = Classifier::create(data["classifier"], workDir);
+  classifier = createSharedClassifier(data["classifier"], workDir);
+  context = new ScanContext(classifier, false, 0);
   if (classifier == 0)
     return;
 
-  classifier->prepare(imagePool);
-
   leftMargin = round(data["leftMargin"].asDouble() * classifier->width());
   rightMargin = round(data["rightMargin"].asDouble() * classifier->width());
   topMargin = round(data["topMargin"].asDouble() * classifier->height());
@@ -73,107 +94,332 @@ topMargin(0), bottomMargin(0), xStep(0), yStep(0), mergeIncluded(true), overlap(
 
   mergeIncluded = data.get("mergeIncluded", true).asBool();
   overlap = data.get("overlap", 0.5).asDouble();
+  threadCount = scanThreadCount(data);
+  exactClustering = data.get("exactClustering", true).asBool();
+  budget.milliseconds = data.get("timeBudget", 0.0).asDouble();
+  budget.windowCount = static_cast<long long>(data.get("windowBudget", 0.0).asDouble());
+  pyramidFromPrevious = data.get("pyramidFromPrevious", false).asBool();
+  levelScoreDecay = std::min(1.0, std::max(0.0, data.get("levelScoreDecay", 0.5).asDouble()));
 }
 
 objed::SimpleDetector::~SimpleDetector()
 {
-  if (isImagePoolOwn == true)
-    ImagePool::destroy(imagePool);
-
+  DetectionContext::destroy(context);
   Classifier::destroy(classifier);
 }
 
 objed::DetectionList objed::SimpleDetector::detect(IplImage *image, DebugInfo *debugInfo)
 {
-  if (imagePool == 0 || classifier == 0 || image == 0)
+  return detectInContext(context, image, debugInfo);
+}
+
+objed::DetectionList objed::SimpleDetector::detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo) const
+{
+  ScanContext *scanContext = dynamic_cast<ScanContext *>(context);
+  if (scanContext == 0 || scanContext->classifier == 0 || image == 0)
     return DetectionList();
 
-  DebugInfo *clDebugInfo = 0;
-  if (debugInfo != nullptr)
-    clDebugInfo = new DebugInfo();
+  std::vector<Rect<int> > &rawDetectionList = scanContext->rawDetectionList;
+  rawDetectionList.clear();
 
-  std::vector<Rect<int> > rawDetectionList;
-  const int clWd = classifier->width(), clWd2 = clWd / 2;
-  const int clHt = classifier->height(), clHt2 = clHt / 2;
+  if (budget.milliseconds > 0 || budget.windowCount > 0)
+    scanBudgeted(scanContext, image, debugInfo);
+  else
+    scanPyramid(scanContext, image, debugInfo);
+
+  DetectionList clusteredDetectionList = clusterDetections(rawDetectionList, overlap, exactClustering, threadCount);
+  return mergeIncluded == true ? objed::mergeIncluded(clusteredDetectionList) : clusteredDetectionList;
+}
+
+void objed::SimpleDetector::scanPyramid(ScanContext *scanContext, IplImage *image, DebugInfo *debugInfo) const
+{
+  std::vector<Rect<int> > &rawDetectionList = scanContext->rawDetectionList;
+  const Classifier *boundClassifier = scanContext->classifier;
+
+  const int clWd2 = classifier->width() / 2, clHt2 = classifier->height() / 2;
   const int imageWd = image->width, imageHt = image->height;
 
-  for (double scale = minScale; scale <= maxScale; scale *= stpScale)
+  IplImage *scaledImage = 0;
+  size_t level = 0;
+  long long windowCount = 0;
+
+  for (double scale = minScale; scale <= maxScale; scale *= stpScale, level++)
   {
     int scaledImageWd = round(std::max(1.0, imageWd / scale));
     int scaledImageHt = round(std::max(1.0, imageHt / scale));
 
-    IplImage *scaledImage = cvCreateImage(cvSize(
-      scaledImageWd, scaledImageHt), image->depth, image->nChannels);
-    cvResize(image, scaledImage);
-    imagePool->update(scaledImage);
+    const IplImage *levelSource = (pyramidFromPrevious == true && scaledImage != 0) ? scaledImage : image;
+    scaledImage = scanContext->prepareLevel(level, levelSource, scaledImageWd, scaledImageHt);
+    const bool parallel = threadCount > 1 && debugInfo == nullptr;
+
+    StageTimer scanTimer(StageProfile::STAGE_SCAN);
+    const long long levelWindowCount = gridCount(clWd2, scaledImageWd - clWd2, xStep) * gridCount(clHt2, scaledImageHt - clHt2, yStep);
+    StageProfile::addWindows(levelWindowCount);
+    windowCount += levelWindowCount;
 
-    for (int y = clHt2; y < scaledImageHt - clHt2; y += yStep)
+    if (parallel == true)
     {
-      for (int x = clWd2; x < scaledImageWd - clWd2; x += xStep)
-      {
-        float result = 0.0;
+      scanRowsParallel(rawDetectionList, scanContext->blockDetectionLists, clHt2, scaledImageHt - clHt2, yStep, threadCount,
+        [&](std::vector<Rect<int> > &blockDetectionList, int yBegin, int yEnd)
+        {
+          scan(boundClassifier, blockDetectionList, scaledImageWd, scale, yBegin, yEnd, 0);
+        });
+    }
+    else
+    {
+      scan(boundClassifier, rawDetectionList, scaledImageWd, scale, clHt2, scaledImageHt - clHt2, debugInfo);
+    }
+  }
 
-        if (clDebugInfo != nullptr)
-          clDebugInfo->int_data.clear();
+  scanContext->coverage.scannedWindowCount = windowCount;
+  scanContext->coverage.totalWindowCount = windowCount;
+}
 
-        if (classifier->evaluate(&result, x, y, clDebugInfo) && result > 0)
-        {
-          Detection rawDetection;
-          rawDetection.power = 1;
-          rawDetection.x = round((x - clWd2 + leftMargin) * scale);
-          rawDetection.y = round((y - clHt2 + topMargin) * scale);
-          rawDetection.width = round((clWd - leftMargin - rightMargin) * scale);
-          rawDetection.height = round((clHt - topMargin - bottomMargin) * scale);
-          rawDetectionList.push_back(rawDetection);
-        }
-
-        if (debugInfo != nullptr)
-        {
-          int outputLevel = clDebugInfo->int_data[Classifier::DBG_SC_COUNT];
-          if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
-            debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
-          else
-            debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
-          if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
-            debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
-          else
-            debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
-          debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
-          debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
-        }
+void objed::SimpleDetector::scanBudgeted(ScanContext *scanContext, IplImage *image, DebugInfo *debugInfo) const
+{
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point deadline = Clock::now() + 
+    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(budget.milliseconds));
+
+  std::vector<Rect<int> > &rawDetectionList = scanContext->rawDetectionList;
+  const Classifier *boundClassifier = scanContext->classifier;
+  std::vector<double> &levelScores = scanContext->levelScores;
+
+  const int clWd2 = classifier->width() / 2, clHt2 = classifier->height() / 2;
+  const int imageWd = image->width, imageHt = image->height;
+
+  std::vector<BudgetLevel> levelList;
+  long long totalWindowCount = 0;
+
+  for (double scale = minScale; scale <= maxScale; scale *= stpScale)
+  {
+    BudgetLevel level;
+    level.scale = scale;
+    level.width = round(std::max(1.0, imageWd / scale));
+    level.height = round(std::max(1.0, imageHt / scale));
+    level.score = levelList.size() < levelScores.size() ? levelScores[levelList.size()] : 0.0;
+    level.scannedWindowCount = 0;
+    level.hitCount = 0;
+    levelList.push_back(level);
+
+    totalWindowCount += gridCount(clWd2, level.width - clWd2, xStep) * gridCount(clHt2, level.height - clHt2, yStep);
+  }
+
+  // Coarse passes of all levels go first, then the rest of the levels by their scores. 
+  // Levels with equal scores (all of them in the first frame) keep the order of scales
+  std::vector<size_t> levelOrder(levelList.size());
+  for (size_t iLevel = 0; iLevel < levelList.size(); iLevel++)
+    levelOrder[iLevel] = iLevel;
+  std::stable_sort(levelOrder.begin(), levelOrder.end(), [&](size_t level1, size_t level2)
+    {
+      return levelList[level1].score > levelList[level2].score;
+    });
+
+  std::vector<BudgetPass> passList;
+  for (size_t iLevel = 0; iLevel < levelOrder.size(); iLevel++)
+    passList.push_back(BudgetPass(levelOrder[iLevel], 0, 2, 0, 2));
+  for (size_t iLevel = 0; iLevel < levelOrder.size(); iLevel++)
+  {
+    passList.push_back(BudgetPass(levelOrder[iLevel], 0, 2, 1, 2));
+    passList.push_back(BudgetPass(levelOrder[iLevel], 1, 2, 0, 1));
+  }
+
+  std::atomic<long long> scannedWindowCount(0);
+  std::atomic<bool> isExpired(false);
+
+  // Rows are claimed before they are scanned, so the scan stops at the first row over the budget
+  auto claimRow = [&](long long rowWindowCount) -> bool
+  {
+    if (isExpired == true)
+      return false;
+
+    if (budget.milliseconds > 0 && Clock::now() >= deadline)
+    {
+      isExpired = true;
+      return false;
+    }
+
+    const long long windowCount = scannedWindowCount.fetch_add(rowWindowCount) + rowWindowCount;
+    if (budget.windowCount > 0 && windowCount > budget.windowCount)
+    {
+      scannedWindowCount.fetch_sub(rowWindowCount);
+      isExpired = true;
+      return false;
+    }
+
+    return true;
+  };
+
+  scanContext->startCachedFrame();
+  std::vector<const IplImage *> levelImages(levelList.size(), 0);
+  size_t preparedLevel = levelList.size();
+  for (size_t iPass = 0; iPass < passList.size() && claimRow(0) == true; iPass++)
+  {
+    const BudgetPass &pass = passList[iPass];
+    BudgetLevel &level = levelList[pass.level];
+
+    // Levels are not visited in order: with pyramidFromPrevious the finer levels a level is
+    // scaled from are cached for the frame without binding the classifier to them
+    if (preparedLevel != pass.level)
+    {
+      const IplImage *levelSource = image;
+      for (size_t iLevel = 0; pyramidFromPrevious == true && iLevel < pass.level; iLevel++)
+      {
+        if (levelImages[iLevel] == 0)
+          levelImages[iLevel] = scanContext->cachedLevel(levelSource, levelList[iLevel].width, levelList[iLevel].height);
+        levelSource = levelImages[iLevel];
       }
+
+      levelImages[pass.level] = scanContext->prepareCachedLevel(levelSource, level.width, level.height);
+      preparedLevel = pass.level;
     }
 
-    cvReleaseImage(&scaledImage);
+    const int xBegin = clWd2 + pass.xOffset * xStep, xEnd = level.width - clWd2, xStride = pass.xStride * xStep;
+    const int yBegin = clHt2 + pass.yOffset * yStep, yEnd = level.height - clHt2, yStride = pass.yStride * yStep;
+    const long long rowWindowCount = gridCount(xBegin, xEnd, xStride);
+    const long long passWindowCount = scannedWindowCount;
+    const size_t passHitCount = rawDetectionList.size();
+
+    StageTimer scanTimer(StageProfile::STAGE_SCAN);
+    auto scanRows = [&](std::vector<Rect<int> > &blockDetectionList, int rowBegin, int rowEnd)
+    {
+      for (int y = rowBegin; y < rowEnd; y += yStride)
+      {
+        if (claimRow(rowWindowCount) == false)
+          break;
+        if (debugInfo == nullptr)
+          scanRow(boundClassifier, blockDetectionList, y, xBegin, xEnd, xStride, level.scale);
+        else
+          scanRowDebug(boundClassifier, blockDetectionList, y, xBegin, xEnd, xStride, level.scale, debugInfo);
+      }
+    };
+
+    if (threadCount > 1 && debugInfo == nullptr)
+      scanRowsParallel(rawDetectionList, scanContext->blockDetectionLists, yBegin, yEnd, yStride, threadCount, scanRows);
+    else
+      scanRows(rawDetectionList, yBegin, yEnd);
+
+    level.scannedWindowCount += scannedWindowCount - passWindowCount;
+    level.hitCount += rawDetectionList.size() - passHitCount;
   }
 
-  if (clDebugInfo != nullptr)
-    delete clDebugInfo;
+  levelScores.resize(levelList.size(), 0.0);
+  for (size_t iLevel = 0; iLevel < levelList.size(); iLevel++)
+  {
+    const BudgetLevel &level = levelList[iLevel];
+    if (level.scannedWindowCount > 0)
+    {
+      const double hitRate = static_cast<double>(level.hitCount) / level.scannedWindowCount;
+      levelScores[iLevel] = levelScoreDecay * levelScores[iLevel] + (1.0 - levelScoreDecay) * hitRate;
+    }
+  }
 
-  DetectionList clusteredDetectionList = objed::cluster(rawDetectionList, overlap);
-  return mergeIncluded == true ? objed::mergeIncluded(clusteredDetectionList) : clusteredDetectionList;
+  StageProfile::addWindows(scannedWindowCount);
+  scanContext->coverage.scannedWindowCount = scannedWindowCount;
+  scanContext->coverage.totalWindowCount = totalWindowCount;
 }
 
-objed::Detector * objed::SimpleDetector::clone() const
+void objed::SimpleDetector::scan(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList,
+  int scaledImageWd, double scale, int yBegin, int yEnd, DebugInfo *debugInfo) const
 {
-  SimpleDetector *newSimpleDet = new SimpleDetector();
-  
-  if (isImagePoolOwn == true)
+  const int clWd2 = classifier->width() / 2;
+
+  for (int y = yBegin; y < yEnd; y += yStep)
   {
-    newSimpleDet->imagePool = ImagePool::create();
-    newSimpleDet->isImagePoolOwn = isImagePoolOwn;
+    if (debugInfo == nullptr)
+      scanRow(boundClassifier, rawDetectionList, y, clWd2, scaledImageWd - clWd2, xStep, scale);
+    else
+      scanRowDebug(boundClassifier, rawDetectionList, y, clWd2, scaledImageWd - clWd2, xStep, scale, debugInfo);
   }
-  else
+}
+
+// With debug info windows are evaluated one by one to count the stages each of them passed
+void objed::SimpleDetector::scanRowDebug(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList,
+  int y, int xBegin, int xEnd, int xStride, double scale, DebugInfo *debugInfo) const
+{
+  DebugInfo clDebugInfo;
+
+  const int clWd = classifier->width(), clWd2 = clWd / 2;
+  const int clHt = classifier->height(), clHt2 = clHt / 2;
+
+  for (int x = xBegin; x < xEnd; x += xStride)
   {
-    newSimpleDet->imagePool = imagePool;
-    newSimpleDet->isImagePoolOwn = isImagePoolOwn;
+    float result = 0.0;
+    clDebugInfo.int_data.clear();
+
+    if (boundClassifier->evaluate(&result, x, y, &clDebugInfo) && result > 0)
+    {
+      Detection rawDetection;
+      rawDetection.power = 1;
+      rawDetection.x = round((x - clWd2 + leftMargin) * scale);
+      rawDetection.y = round((y - clHt2 + topMargin) * scale);
+      rawDetection.width = round((clWd - leftMargin - rightMargin) * scale);
+      rawDetection.height = round((clHt - topMargin - bottomMargin) * scale);
+      rawDetectionList.push_back(rawDetection);
+    }
+
+    int outputLevel = clDebugInfo.int_data[Classifier::DBG_SC_COUNT];
+    if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
+      debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
+    else
+      debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
+    if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
+      debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
+    else
+      debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
+    debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
+    debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
   }
+}
 
-  if (classifier != 0)
+// Without debug info rows are evaluated by batch calls of BATCH_CHUNK_SIZE windows
+void objed::SimpleDetector::scanRow(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList,
+  int y, int xBegin, int xEnd, int xStride, double scale) const
+{
+  int rowXs[BATCH_CHUNK_SIZE], rowYs[BATCH_CHUNK_SIZE];
+  float rowResults[BATCH_CHUNK_SIZE];
+  uint8_t rowAlive[BATCH_CHUNK_SIZE];
+
+  const int clWd = classifier->width(), clWd2 = clWd / 2;
+  const int clHt = classifier->height(), clHt2 = clHt / 2;
+
+  std::fill(rowYs, rowYs + BATCH_CHUNK_SIZE, y);
+
+  for (int x = xBegin; x < xEnd;)
   {
-    newSimpleDet->classifier = classifier->clone();
-    newSimpleDet->classifier->prepare(newSimpleDet->imagePool);
+    int count = 0;
+    for (; count < BATCH_CHUNK_SIZE && x < xEnd; count++, x += xStride)
+    {
+      rowXs[count] = x;
+      rowAlive[count] = 1;
+    }
+
+    boundClassifier->evaluateBatch(rowXs, rowYs, count, rowResults, rowAlive);
+
+    for (int i = 0; i < count; i++)
+    {
+      if (rowAlive[i] != 0 && rowResults[i] > 0)
+      {
+        Detection rawDetection;
+        rawDetection.power = 1;
+        rawDetection.x = round((rowXs[i] - clWd2 + leftMargin) * scale);
+        rawDetection.y = round((y - clHt2 + topMargin) * scale);
+        rawDetection.width = round((clWd - leftMargin - rightMargin) * scale);
+        rawDetection.height = round((clHt - topMargin - bottomMargin) * scale);
+        rawDetectionList.push_back(rawDetection);
+      }
+    }
   }
+}
+
+objed::Detector * objed::SimpleDetector::clone() const
+{
+  SimpleDetector *newSimpleDet = new SimpleDetector();
+  const ScanContext *scanContext = static_cast<const ScanContext *>(context);
+
+  if (classifier != 0)
+    newSimpleDet->classifier = classifier->clone();
+  newSimpleDet->context = new ScanContext(newSimpleDet->classifier, false, scanContext->isImagePoolOwn ? 0 : scanContext->imagePool);
 
   newSimpleDet->minScale = minScale;
   newSimpleDet->maxScale = maxScale;
@@ -189,30 +435,39 @@ objed::Detector * objed::SimpleDetector::clone() const
 
   newSimpleDet->overlap = overlap;
   newSimpleDet->mergeIncluded = mergeIncluded;
+  newSimpleDet->threadCount = threadCount;
+  newSimpleDet->exactClustering = exactClustering;
+  newSimpleDet->budget = budget;
+  newSimpleDet->pyramidFromPrevious = pyramidFromPrevious;
+  newSimpleDet->levelScoreDecay = levelScoreDecay;
 
   return newSimpleDet;
 }
 
-void objed::SimpleDetector::setImagePool(objed::ImagePool *extImagePool)
+objed::DetectionContext * objed::SimpleDetector::createContext(ImagePool *extImagePool) const
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
+  return new ScanContext(classifier != 0 ? classifier->clone() : 0, true, extImagePool);
+}
 
-  isImagePoolOwn = false;
-  imagePool = extImagePool;
+void objed::SimpleDetector::setBudget(const DetectionBudget &budget)
+{
+  this->budget = budget;
+}
 
-  if (classifier != 0)
-    classifier->prepare(imagePool);
+objed::DetectionCoverage objed::SimpleDetector::coverage(const DetectionContext *context) const
+{
+  const ScanContext *scanContext = dynamic_cast<const ScanContext *>(context != 0 ? context : this->context);
+  return scanContext != 0 ? scanContext->coverage : DetectionCoverage();
 }
 
-void objed::SimpleDetector::resetImagePool()
+void objed::SimpleDetector::setImagePool(objed::ImagePool *extImagePool)
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
-  
-  isImagePoolOwn = true;
-  imagePool = objed::ImagePool::create();
+  DetectionContext::destroy(context);
+  context = new ScanContext(classifier, false, extImagePool);
+}
 
-  if (classifier != 0)
-    classifier->prepare(imagePool);
+void objed::SimpleDetector::resetImagePool()
+{
+  DetectionContext::destroy(context);
+  context = new ScanContext(classifier, false, 0);
 }
@@ -36,6 +36,8 @@ either expressed or implied, of copyright holders.
 #include <objed/objed.h>
 #include <objed/objedutils.h>
 
+#include "detector.h"
+
 #include <utility>
 #include <vector>
 
@@ -53,6 +55,11 @@ namespace objed
 
   public:
     virtual DetectionList detect(IplImage *image, DebugInfo *debugInfo);
+    virtual DetectionList detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo = 0) const;
+    virtual DetectionContext * createContext(ImagePool *extImagePool = 0) const;
+
+    virtual void setBudget(const DetectionBudget &budget);
+    virtual DetectionCoverage coverage(const DetectionContext *context) const;
 
     virtual Detector * clone() const;
 
@@ -60,11 +67,26 @@ namespace objed
     virtual void resetImagePool();
 
   private:
-    ImagePool *imagePool;
-    bool isImagePoolOwn;
+    // Scans all levels of the pyramid in order
+    void scanPyramid(ScanContext *scanContext, IplImage *image, DebugInfo *debugInfo) const;
+
+    // Scans within the budget: first the coarse grid of every other row and column of all levels, 
+    // then the rest of the levels by their rates of raw detections in the previous frames of the
+    // context (smoothed by levelScoreDecay), so the windows most likely to give detections are 
+    // scanned before the budget runs out. Levels are prepared when their first pass starts, and
+    // the time budget counts their preparation as well as the scan
+    void scanBudgeted(ScanContext *scanContext, IplImage *image, DebugInfo *debugInfo) const;
+
+    void scan(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList, int scaledImageWd,
+      double scale, int yBegin, int yEnd, DebugInfo *debugInfo) const;
+    void scanRow(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList,
+      int y, int xBegin, int xEnd, int xStride, double scale) const;
+    void scanRowDebug(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList,
+      int y, int xBegin, int xEnd, int xStride, double scale, DebugInfo *debugInfo) const;
 
   private:
     Classifier *classifier;
+    DetectionContext *context;
 
   private:
     double minScale, maxScale, stpScale;
@@ -73,6 +95,11 @@ namespace objed
     int xStep, yStep;
     bool mergeIncluded;
     double overlap;
+    int threadCount;
+    bool exactClustering;
+    DetectionBudget budget;
+    bool pyramidFromPrevious;
+    double levelScoreDecay;
   };
 }
 
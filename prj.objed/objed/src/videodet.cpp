@@ -0,0 +1,371 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include "videodet.h"
+#include "imagepool.h"
+
+#include <opencv/cv.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+// Mean absolute difference of the bytes of a block of two 8-bit images of the same format
+static double blockDifference(const IplImage *image1, const IplImage *image2, int x, int y, int width, int height)
+{
+  const int lineSize = width * image1->nChannels;
+  long long sum = 0;
+
+  for (int row = y; row < y + height; row++)
+  {
+    const unsigned char *line1 = reinterpret_cast<const unsigned char *>(image1->imageData + row * image1->widthStep) + x * image1->nChannels;
+    const unsigned char *line2 = reinterpret_cast<const unsigned char *>(image2->imageData + row * image2->widthStep) + x * image2->nChannels;
+    for (int i = 0; i < lineSize; i++)
+      sum += std::abs(line1[i] - line2[i]);
+  }
+
+  return static_cast<double>(sum) / (static_cast<double>(lineSize) * height);
+}
+
+objed::VideoContext::VideoContext(const Detector *detector, ImagePool *extImagePool) :
+context(0), extImagePool(extImagePool), regionPools(0), regionContext(0), 
+previousFrame(0), framesSinceFullScan(0), fullScanWindowCount(0)
+{
+  if (detector != 0)
+  {
+    context = detector->createContext(extImagePool);
+    regionPools = new MultiScaleImagePool();
+    regionContext = detector->createContext(regionPools);
+  }
+}
+
+objed::VideoContext::~VideoContext()
+{
+  DetectionContext::destroy(regionContext);
+  DetectionContext::destroy(context);
+  delete regionPools;
+
+  if (previousFrame != 0)
+    cvReleaseImage(&previousFrame);
+}
+
+objed::VideoDetector::VideoDetector() :
+detector(0), context(0), fullScanInterval(10), blockSize(16), diffThreshold(10.0), 
+sceneCutRatio(0.5), changeMargin(32), roiMargin(0.5), fullScanAreaRatio(0.7)
+{
+  return;
+}
+
+objed::VideoDetector::VideoDetector(const Json::Value &data, const std::string &workDir) :
+detector(0), context(0), fullScanInterval(10), blockSize(16), diffThreshold(10.0), 
+sceneCutRatio(0.5), changeMargin(32), roiMargin(0.5), fullScanAreaRatio(0.7)
+{
+  Json::Value detectorData = data["detector"];
+  if (detectorData.isString() == true)
+    detector = objed::Detector::create(detectorData.asString(), workDir);
+  else
+    detector = objed::Detector::create(detectorData, workDir);
+
+  context = new VideoContext(detector, 0);
+
+  fullScanInterval = data.get("fullScanInterval", 10).asInt();
+  blockSize = std::max(1, data.get("blockSize", 16).asInt());
+  diffThreshold = data.get("diffThreshold", 10.0).asDouble();
+  sceneCutRatio = data.get("sceneCutRatio", 0.5).asDouble();
+  changeMargin = std::max(0, data.get("changeMargin", 32).asInt());
+  roiMargin = std::max(0.0, data.get("roiMargin", 0.5).asDouble());
+  fullScanAreaRatio = std::max(0.0, data.get("fullScanAreaRatio", 0.7).asDouble());
+}
+
+objed::VideoDetector::~VideoDetector()
+{
+  DetectionContext::destroy(context);
+  objed::Detector::destroy(detector);
+}
+
+objed::DetectionList objed::VideoDetector::detect(IplImage *image, DebugInfo *debugInfo)
+{
+  return detectInContext(context, image, debugInfo);
+}
+
+objed::DetectionList objed::VideoDetector::detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo) const
+{
+  VideoContext *videoContext = dynamic_cast<VideoContext *>(context);
+  if (videoContext == 0 || videoContext->context == 0 || videoContext->regionContext == 0 || image == 0)
+    return DetectionList();
+
+  DetectionList detectionList;
+  DetectionCoverage &coverage = videoContext->coverage;
+  std::vector<Rect<int> > regionList;
+
+  if (selectRegions(videoContext, image, regionList) == false)
+  {
+    detectionList = detector->detectInContext(videoContext->context, image, debugInfo);
+
+    coverage = detector->coverage(videoContext->context);
+    videoContext->fullScanWindowCount = coverage.totalWindowCount;
+    videoContext->framesSinceFullScan = 0;
+  }
+  else
+  {
+    coverage = DetectionCoverage();
+    coverage.totalWindowCount = videoContext->fullScanWindowCount;
+
+    const int pixelSize = image->nChannels * ((image->depth & 255) / 8);
+
+    for (size_t iRegion = 0; iRegion < regionList.size(); iRegion++)
+    {
+      const Rect<int> &region = regionList[iRegion];
+
+      // Levels are cached by source and size for a frame, while regions share the source header
+      videoContext->regionPools->beginFrame();
+
+      IplImage regionImage;
+      cvInitImageHeader(&regionImage, cvSize(region.width, region.height), image->depth, image->nChannels, image->origin);
+      regionImage.imageData = image->imageData + region.y * image->widthStep + region.x * pixelSize;
+      regionImage.widthStep = image->widthStep;
+
+      DetectionList regionDetectionList = detector->detectInContext(videoContext->regionContext, &regionImage, debugInfo);
+      coverage.scannedWindowCount += detector->coverage(videoContext->regionContext).scannedWindowCount;
+      videoContext->regionPools->endFrame();
+
+      for (size_t iDet = 0; iDet < regionDetectionList.size(); iDet++)
+      {
+        Detection detection = regionDetectionList[iDet];
+        detection.x += region.x;
+        detection.y += region.y;
+        detectionList.push_back(detection);
+      }
+    }
+
+    videoContext->framesSinceFullScan++;
+  }
+
+  videoContext->previousDetectionList = detectionList;
+  return detectionList;
+}
+
+bool objed::VideoDetector::selectRegions(VideoContext *videoContext, const IplImage *image, std::vector<Rect<int> > &regionList) const
+{
+  regionList.clear();
+  IplImage *&previousFrame = videoContext->previousFrame;
+
+  const bool isComparable = previousFrame != 0 && image->depth == IPL_DEPTH_8U && 
+    previousFrame->width == image->width && previousFrame->height == image->height && 
+    previousFrame->nChannels == image->nChannels && previousFrame->depth == image->depth;
+
+  bool isFullScan = isComparable == false || videoContext->framesSinceFullScan + 1 >= fullScanInterval;
+
+  if (isFullScan == false)
+  {
+    const int colCount = (image->width + blockSize - 1) / blockSize;
+    const int rowCount = (image->height + blockSize - 1) / blockSize;
+
+    std::vector<unsigned char> changeMask(colCount * rowCount, 0);
+    int changedBlockCount = 0;
+
+    for (int row = 0; row < rowCount; row++)
+    {
+      for (int col = 0; col < colCount; col++)
+      {
+        const int x = col * blockSize, y = row * blockSize;
+        const int width = std::min(blockSize, image->width - x), height = std::min(blockSize, image->height - y);
+        if (blockDifference(image, previousFrame, x, y, width, height) > diffThreshold)
+        {
+          changeMask[row * colCount + col] = 1;
+          changedBlockCount++;
+        }
+      }
+    }
+
+    isFullScan = changedBlockCount > sceneCutRatio * colCount * rowCount;
+
+    if (isFullScan == false)
+    {
+      // Blocks to scan: changed blocks with changeMargin around them and blocks covered 
+      // by the previous detections with roiMargin of their size around them
+      std::vector<unsigned char> regionMask(colCount * rowCount, 0);
+      const int marginBlockCount = (changeMargin + blockSize - 1) / blockSize;
+
+      for (int row = 0; row < rowCount; row++)
+      {
+        for (int col = 0; col < colCount; col++)
+        {
+          if (changeMask[row * colCount + col] == 0)
+            continue;
+
+          for (int mRow = std::max(0, row - marginBlockCount); mRow <= std::min(rowCount - 1, row + marginBlockCount); mRow++)
+            for (int mCol = std::max(0, col - marginBlockCount); mCol <= std::min(colCount - 1, col + marginBlockCount); mCol++)
+              regionMask[mRow * colCount + mCol] = 1;
+        }
+      }
+
+      const DetectionList &previousDetectionList = videoContext->previousDetectionList;
+      for (size_t iDet = 0; iDet < previousDetectionList.size(); iDet++)
+      {
+        const Detection &detection = previousDetectionList[iDet];
+        const int xMargin = round(roiMargin * detection.width), yMargin = round(roiMargin * detection.height);
+        const int minCol = std::max(0, (detection.x - xMargin) / blockSize);
+        const int maxCol = std::min(colCount - 1, (detection.x + detection.width + xMargin) / blockSize);
+        const int minRow = std::max(0, (detection.y - yMargin) / blockSize);
+        const int maxRow = std::min(rowCount - 1, (detection.y + detection.height + yMargin) / blockSize);
+
+        for (int row = minRow; row <= maxRow; row++)
+          for (int col = minCol; col <= maxCol; col++)
+            regionMask[row * colCount + col] = 1;
+      }
+
+      // Regions are bounding rects of 8-connected components of the blocks to scan,
+      // overlapping regions are united
+      std::vector<int> blockStack;
+      for (int block = 0; block < colCount * rowCount; block++)
+      {
+        if (regionMask[block] == 0)
+          continue;
+
+        int minCol = block % colCount, maxCol = minCol, minRow = block / colCount, maxRow = minRow;
+        regionMask[block] = 0;
+        blockStack.push_back(block);
+
+        while (blockStack.empty() == false)
+        {
+          const int row = blockStack.back() / colCount, col = blockStack.back() % colCount;
+          blockStack.pop_back();
+
+          minCol = std::min(minCol, col);
+          maxCol = std::max(maxCol, col);
+          minRow = std::min(minRow, row);
+          maxRow = std::max(maxRow, row);
+
+          for (int nRow = std::max(0, row - 1); nRow <= std::min(rowCount - 1, row + 1); nRow++)
+          {
+            for (int nCol = std::max(0, col - 1); nCol <= std::min(colCount - 1, col + 1); nCol++)
+            {
+              if (regionMask[nRow * colCount + nCol] != 0)
+              {
+                regionMask[nRow * colCount + nCol] = 0;
+                blockStack.push_back(nRow * colCount + nCol);
+              }
+            }
+          }
+        }
+
+        const int x = minCol * blockSize, y = minRow * blockSize;
+        regionList.push_back(Rect<int>(x, y, std::min(image->width, (maxCol + 1) * blockSize) - x, 
+          std::min(image->height, (maxRow + 1) * blockSize) - y));
+      }
+
+      for (bool isUnited = true; isUnited == true;)
+      {
+        isUnited = false;
+        for (size_t i = 0; i < regionList.size() && isUnited == false; i++)
+        {
+          for (size_t j = i + 1; j < regionList.size() && isUnited == false; j++)
+          {
+            if (intersected(regionList[i], regionList[j]).width > 0)
+            {
+              regionList[i] = united(regionList[i], regionList[j]);
+              regionList.erase(regionList.begin() + j);
+              isUnited = true;
+            }
+          }
+        }
+      }
+
+      long long regionArea = 0;
+      for (size_t iRegion = 0; iRegion < regionList.size(); iRegion++)
+        regionArea += static_cast<long long>(regionList[iRegion].width) * regionList[iRegion].height;
+      isFullScan = regionArea > fullScanAreaRatio * image->width * image->height;
+    }
+  }
+
+  if (previousFrame == 0 || previousFrame->width != image->width || previousFrame->height != image->height ||
+    previousFrame->nChannels != image->nChannels || previousFrame->depth != image->depth)
+  {
+    if (previousFrame != 0)
+      cvReleaseImage(&previousFrame);
+    previousFrame = cvCreateImage(cvSize(image->width, image->height), image->depth, image->nChannels);
+  }
+  cvCopy(image, previousFrame);
+
+  if (isFullScan == true)
+    regionList.clear();
+
+  return isFullScan == false;
+}
+
+objed::DetectionContext * objed::VideoDetector::createContext(ImagePool *extImagePool) const
+{
+  return new VideoContext(detector, extImagePool);
+}
+
+void objed::VideoDetector::setBudget(const DetectionBudget &budget)
+{
+  if (detector != 0)
+    detector->setBudget(budget);
+}
+
+objed::DetectionCoverage objed::VideoDetector::coverage(const DetectionContext *context) const
+{
+  const VideoContext *videoContext = dynamic_cast<const VideoContext *>(context != 0 ? context : this->context);
+  return videoContext != 0 ? videoContext->coverage : DetectionCoverage();
+}
+
+objed::Detector * objed::VideoDetector::clone() const
+{
+  VideoDetector *newVideoDet = new VideoDetector();
+  const VideoContext *videoContext = static_cast<const VideoContext *>(context);
+
+  if (detector != 0)
+    newVideoDet->detector = detector->clone();
+  newVideoDet->context = new VideoContext(newVideoDet->detector, videoContext != 0 ? videoContext->extImagePool : 0);
+
+  newVideoDet->fullScanInterval = fullScanInterval;
+  newVideoDet->blockSize = blockSize;
+  newVideoDet->diffThreshold = diffThreshold;
+  newVideoDet->sceneCutRatio = sceneCutRatio;
+  newVideoDet->changeMargin = changeMargin;
+  newVideoDet->roiMargin = roiMargin;
+  newVideoDet->fullScanAreaRatio = fullScanAreaRatio;
+
+  return newVideoDet;
+}
+
+void objed::VideoDetector::setImagePool(objed::ImagePool *extImagePool)
+{
+  DetectionContext::destroy(context);
+  context = new VideoContext(detector, extImagePool);
+}
+
+void objed::VideoDetector::resetImagePool()
+{
+  DetectionContext::destroy(context);
+  context = new VideoContext(detector, 0);
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef VIDEODET_H_INCLUDED
+#define VIDEODET_H_INCLUDED
+
+#include <objed/objed.h>
+#include <objed/objedutils.h>
+
+#include "imagepool.h"
+
+#include <vector>
+
+namespace objed
+{
+  // Context of VideoDetector: the contexts of its detector and the state of the video stream.
+  // Full scans run in the context bound to the external pool, region scans in regionContext 
+  // bound to the private regionPools, so they never restart the frame of a shared pool
+  class VideoContext : public DetectionContext
+  {
+    OBJED_DISABLE_COPY(VideoContext)
+
+  public:
+    VideoContext(const Detector *detector, ImagePool *extImagePool);
+    virtual ~VideoContext();
+
+  public:
+    DetectionContext *context;
+    ImagePool *extImagePool;
+    MultiScaleImagePool *regionPools;
+    DetectionContext *regionContext;
+
+  public:
+    IplImage *previousFrame;
+    DetectionList previousDetectionList;
+    int framesSinceFullScan;
+    long long fullScanWindowCount;
+    DetectionCoverage coverage;
+  };
+
+  // Detector of video frames: it runs its detector on the whole frame every fullScanInterval frames
+  // and on scene cuts, and on the other frames only in regions around the detections of the previous
+  // frame and around blocks whose mean absolute difference from the previous frame exceeds diffThreshold.
+  // Frames whose regions cover more than fullScanAreaRatio of the frame are scanned whole. The budget 
+  // (see setBudget) limits a full scan as a whole and a partial scan region by region
+  class VideoDetector : public Detector
+  {
+    OBJED_TYPE("videoDetector")
+    OBJED_DISABLE_COPY(VideoDetector)
+
+  public:
+    VideoDetector();
+    VideoDetector(const Json::Value &data, const std::string &workDir);
+    virtual ~VideoDetector();
+
+  public:
+    virtual DetectionList detect(IplImage *image, DebugInfo *debugInfo);
+    virtual DetectionList detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo = 0) const;
+    virtual DetectionContext * createContext(ImagePool *extImagePool = 0) const;
+
+    virtual void setBudget(const DetectionBudget &budget);
+    virtual DetectionCoverage coverage(const DetectionContext *context) const;
+
+    virtual Detector * clone() const;
+
+    virtual void setImagePool(objed::ImagePool *extImagePool);
+    virtual void resetImagePool();
+
+  private:
+    // Returns false if the frame should be scanned whole, otherwise the regions to scan
+    bool selectRegions(VideoContext *videoContext, const IplImage *image, std::vector<Rect<int> > &regionList) const;
+
+  private:
+    Detector *detector;
+    DetectionContext *context;
+
+  private:
+    int fullScanInterval;
+    int blockSize;
+    double diffThreshold;
+    double sceneCutRatio;
+    int changeMargin;
+    double roiMargin;
+    double fullScanAreaRatio;
+  };
+}
+
+#endif  // VIDEODET_H_INCLUDED
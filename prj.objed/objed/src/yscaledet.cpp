@@ -30,6 +30,7 @@ either expressed or implied, of copyright holders.
 */
 
 #include "yscaledet.h"
+#include "detutils.h"
 
 #include <opencv/cv.h>
 
@@ -39,29 +40,24 @@ either expressed or implied, of copyright holders.
 #include <limits>
 
 
-objed::YScaleDetector::YScaleDetector() : imagePool(0), isImagePoolOwn(false), 
-classifier(0), y0(0.0), y1(0.0), yStp(1.0), y0Scale(1.0), y1Scale(1.0), leftMargin(0), 
+objed::YScaleDetector::YScaleDetector() : 
+classifier(0), context(0), y0(0.0), y1(0.0), yStp(1.0), y0Scale(1.0), y1Scale(1.0), leftMargin(0), 
 rightMargin(0), topMargin(0), bottomMargin(0), xStep(0), yStep(0), 
-mergeIncluded(false), overlap(0.5)
+mergeIncluded(false), overlap(0.5), threadCount(1), exactClustering(true)
 {
-  imagePool = ImagePool::create();
-  isImagePoolOwn = true;
+  return;
 }
 
 objed::YScaleDetector::YScaleDetector(const Json::Value &data, const std::string &workDir) : 
-imagePool(0), isImagePoolOwn(false), classifier(0),  y0(0.0), y1(0.0), yStp(1.0), y0Scale(1.0), y1Scale(1.0), 
+classifier(0), context(0), y0(0.0), y1(0.0), yStp(1.0), y0Scale(1.0), y1Scale(1.0), 
 leftMargin(0), rightMargin(0), topMargin(0), bottomMargin(0), xStep(0), yStep(0), 
-mergeIncluded(false), overlap(0.5)
+mergeIncluded(false), overlap(0.5), threadCount(1), exactClustering(true)
 {
-  imagePool = ImagePool::create();
-  isImagePoolOwn = true;
-
-  classifier = Classifier::create(data["classifier"], workDir);
+  classifier = createSharedClassifier(data["classifier"], workDir);
+  context = new ScanContext(classifier, false, 0);
   if (classifier == 0)
     return;
 
-  classifier->prepare(imagePool);
-
   leftMargin = round(data["leftMargin"].asDouble() * classifier->width());
   rightMargin = round(data["rightMargin"].asDouble() * classifier->width());
   topMargin = round(data["topMargin"].asDouble() * classifier->height());
@@ -79,32 +75,39 @@ mergeIncluded(false), overlap(0.5)
 
   mergeIncluded = data.get("mergeIncluded", true).asBool();
   overlap = data.get("overlap", 0.5).asDouble();
+  threadCount = scanThreadCount(data);
+  exactClustering = data.get("exactClustering", true).asBool();
 }
 
 objed::YScaleDetector::~YScaleDetector()
 {
-  if (isImagePoolOwn == true)
-    objed::ImagePool::destroy(imagePool);
-
-  objed::Classifier::destroy(classifier);
+  DetectionContext::destroy(context);
+  Classifier::destroy(classifier);
 }
 
 objed::DetectionList objed::YScaleDetector::detect(IplImage *image, DebugInfo *debugInfo)
 {
-  if (imagePool == 0 || classifier == 0 || image == 0)
+  return detectInContext(context, image, debugInfo);
+}
+
+objed::DetectionList objed::YScaleDetector::detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo) const
+{
+  ScanContext *scanContext = dynamic_cast<ScanContext *>(context);
+  if (scanContext == 0 || scanContext->classifier == 0 || image == 0)
     return DetectionList();
 
-  DebugInfo *clDebugInfo = 0;
-  if (debugInfo != nullptr)
-    clDebugInfo = new DebugInfo();
+  std::vector<Rect<int> > &rawDetectionList = scanContext->rawDetectionList;
+  const Classifier *boundClassifier = scanContext->classifier;
 
   // scale = k * y + b
   assert(std::abs(y1 - y0) > std::numeric_limits<double>::epsilon());
   double b = (y1 * y0Scale - y0 * y1Scale) / (y1 - y0);
   double k = (y1Scale - y0Scale) / (y1 - y0);
 
-  std::vector<Rect<int> > rawDetectionList;
-  for (double y = y0; y < y1; y *= yStp)
+  rawDetectionList.clear();
+  size_t level = 0;
+
+  for (double y = y0; y < y1; y *= yStp, level++)
   {
     int yInt = round(image->height * y);
     assert(yInt >= 0 && yInt < image->height);
@@ -113,98 +116,101 @@ objed::DetectionList objed::YScaleDetector::detect(IplImage *image, DebugInfo *d
     assert(scale >= std::min(y0Scale, y1Scale));
     assert(scale <= std::max(y0Scale, y1Scale));
 
-    const int clWd = classifier->width(), clWd2 = clWd / 2;
+    const int clWd2 = classifier->width() / 2;
     const int clHt = classifier->height(), clHt2 = clHt / 2;
 
     int prevYInt = std::max(0, round(yInt / yStp - scale * clHt));
     int nextYInt = std::min(image->height - 1, round(yInt * yStp + scale * clHt));
 
-    IplImage *region = cvCreateImageHeader(
-      cvSize(image->width, nextYInt - prevYInt + 1), image->depth, image->nChannels);
-    region->imageData = image->imageData + prevYInt * image->widthStep;
-    region->widthStep = image->widthStep;
-    region->origin = image->origin;
+    Rect<int> region(0, prevYInt, image->width, nextYInt - prevYInt + 1);
 
-    int scaledRegionWidth = round(region->width / scale);
-    int scaledRegionHeight = round(region->height / scale);
+    int scaledRegionWidth = round(region.width / scale);
+    int scaledRegionHeight = round(region.height / scale);
     if (scaledRegionWidth < classifier->width() || scaledRegionHeight < classifier->height())
-    {
-      cvReleaseImageHeader(&region);
       continue;
+
+    scanContext->prepareLevel(level, image, region, scaledRegionWidth, scaledRegionHeight);
+
+    StageTimer scanTimer(StageProfile::STAGE_SCAN);
+    StageProfile::addWindows(gridCount(clWd2, scaledRegionWidth - clWd2, xStep) * gridCount(clHt2, scaledRegionHeight - clHt2, yStep));
+
+    if (threadCount > 1 && debugInfo == nullptr)
+    {
+      scanRowsParallel(rawDetectionList, scanContext->blockDetectionLists, clHt2, scaledRegionHeight - clHt2, yStep, threadCount,
+        [&](std::vector<Rect<int> > &blockDetectionList, int yBegin, int yEnd)
+        {
+          scan(boundClassifier, blockDetectionList, scaledRegionWidth, scale, prevYInt, yBegin, yEnd, 0);
+        });
     }
-    
-    IplImage *scaledRegion = cvCreateImage(cvSize(
-      scaledRegionWidth, scaledRegionHeight), region->depth, region->nChannels);
-    cvResize(region, scaledRegion);
-    imagePool->update(scaledRegion);
+    else
+    {
+      scan(boundClassifier, rawDetectionList, scaledRegionWidth, scale, prevYInt, clHt2, scaledRegionHeight - clHt2, debugInfo);
+    }
+  }
+
+  DetectionList clusteredDetectionList = clusterDetections(rawDetectionList, overlap, exactClustering, threadCount);
+  return mergeIncluded == true ? objed::mergeIncluded(clusteredDetectionList) : clusteredDetectionList;
+}
+
+void objed::YScaleDetector::scan(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList, int scaledRegionWd,
+  double scale, int yOffset, int yBegin, int yEnd, DebugInfo *debugInfo) const
+{
+  DebugInfo *clDebugInfo = 0;
+  if (debugInfo != nullptr)
+    clDebugInfo = new DebugInfo();
+
+  const int clWd = classifier->width(), clWd2 = clWd / 2;
+  const int clHt = classifier->height(), clHt2 = clHt / 2;
 
-    for (int y = clHt2; y < scaledRegionHeight - clHt2; y += yStep)
+  for (int y = yBegin; y < yEnd; y += yStep)
+  {
+    for (int x = clWd2; x < scaledRegionWd - clWd2; x += xStep)
     {
-      for (int x = clWd2; x < scaledRegionWidth - clWd2; x += xStep)
+      if (clDebugInfo != nullptr)
+        clDebugInfo->int_data.clear();
+
+      float result = 0.0;
+      if (boundClassifier->evaluate(&result, x, y, clDebugInfo) && result > 0)
       {
-        if (clDebugInfo != nullptr)
-          clDebugInfo->int_data.clear();
+        Detection rawDetection;
+        rawDetection.power = 1;
+        rawDetection.x = round((x - clWd2 + leftMargin) * scale);
+        rawDetection.y = round((y - clHt2 + topMargin) * scale + yOffset);
+        rawDetection.width = round((clWd - leftMargin - rightMargin) * scale);
+        rawDetection.height = round((clHt - topMargin - bottomMargin) * scale);
+        rawDetectionList.push_back(rawDetection);
+      }
 
-        float result = 0.0;
-        if (classifier->evaluate(&result, x, y, clDebugInfo) && result > 0)
-        {
-          Detection rawDetection;
-          rawDetection.power = 1;
-          rawDetection.x = round((x - clWd2 + leftMargin) * scale);
-          rawDetection.y = round((y - clHt2 + topMargin) * scale + prevYInt);
-          rawDetection.width = round((clWd - leftMargin - rightMargin) * scale);
-          rawDetection.height = round((clHt - topMargin - bottomMargin) * scale);
-          rawDetectionList.push_back(rawDetection);
-        }
-
-        if (debugInfo != nullptr)
-        {
-          int outputLevel = clDebugInfo->int_data[Classifier::DBG_SC_COUNT];
-          if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
-            debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
-          else
-            debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
-          if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
-            debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
-          else
-            debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
-          debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
-          debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
-        }
+      if (debugInfo != nullptr)
+      {
+        int outputLevel = clDebugInfo->int_data[Classifier::DBG_SC_COUNT];
+        if (debugInfo->int_data.find(Detector::DBG_MIN_SC_COUNT) != debugInfo->int_data.end())
+          debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = std::min(outputLevel, debugInfo->int_data[Detector::DBG_MIN_SC_COUNT]);
+        else
+          debugInfo->int_data[Detector::DBG_MIN_SC_COUNT] = outputLevel;
+        if (debugInfo->int_data.find(Detector::DBG_MAX_SC_COUNT) != debugInfo->int_data.end())
+          debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = std::max(outputLevel, debugInfo->int_data[Detector::DBG_MAX_SC_COUNT]);
+        else
+          debugInfo->int_data[Detector::DBG_MAX_SC_COUNT] = outputLevel;
+        debugInfo->int_data[Detector::DBG_TOTAL_SC_COUNT] += outputLevel;
+        debugInfo->int_data[Detector::DBG_EVALUATION_COUNT]++;
       }
     }
-
-    cvReleaseImage(&scaledRegion);
-    cvReleaseImageHeader(&region);
   }
 
   if (clDebugInfo != nullptr)
     delete clDebugInfo;
-
-  DetectionList clusteredDetectionList = objed::cluster(rawDetectionList, overlap);
-  return mergeIncluded == true ? objed::mergeIncluded(clusteredDetectionList) : clusteredDetectionList;
 }
 
 objed::Detector * objed::YScaleDetector::clone() const
 {
   YScaleDetector *newYScaleDet = new YScaleDetector();
 
-  if (isImagePoolOwn == true)
-  {
-    newYScaleDet->imagePool = ImagePool::create();
-    newYScaleDet->isImagePoolOwn = isImagePoolOwn;
-  }
-  else
-  {
-    newYScaleDet->imagePool = imagePool;
-    newYScaleDet->isImagePoolOwn = isImagePoolOwn;
-  }
+  const ScanContext *scanContext = static_cast<const ScanContext *>(context);
 
   if (classifier != 0)
-  {
     newYScaleDet->classifier = classifier->clone();
-    newYScaleDet->classifier->prepare(newYScaleDet->imagePool);
-  }
+  newYScaleDet->context = new ScanContext(newYScaleDet->classifier, false, scanContext->isImagePoolOwn ? 0 : scanContext->imagePool);
 
   newYScaleDet->y0 = y0;
   newYScaleDet->y1 = y1;
@@ -223,30 +229,25 @@ objed::Detector * objed::YScaleDetector::clone() const
 
   newYScaleDet->overlap = overlap;
   newYScaleDet->mergeIncluded = mergeIncluded;
+  newYScaleDet->threadCount = threadCount;
+  newYScaleDet->exactClustering = exactClustering;
 
   return newYScaleDet;
 }
 
-void objed::YScaleDetector::setImagePool(objed::ImagePool *extImagePool)
+objed::DetectionContext * objed::YScaleDetector::createContext(ImagePool *extImagePool) const
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
-
-  isImagePoolOwn = false;
-  imagePool = extImagePool;
+  return new ScanContext(classifier != 0 ? classifier->clone() : 0, true, extImagePool);
+}
 
-  if (classifier != 0)
-    classifier->prepare(imagePool);
+void objed::YScaleDetector::setImagePool(objed::ImagePool *extImagePool)
+{
+  DetectionContext::destroy(context);
+  context = new ScanContext(classifier, false, extImagePool);
 }
 
 void objed::YScaleDetector::resetImagePool()
 {
-  if (isImagePoolOwn = true)
-    objed::ImagePool::destroy(imagePool);
-
-  isImagePoolOwn = true;
-  imagePool = objed::ImagePool::create();
-
-  if (classifier != 0)
-    classifier->prepare(imagePool);
+  DetectionContext::destroy(context);
+  context = new ScanContext(classifier, false, 0);
 }
@@ -36,6 +36,8 @@ either expressed or implied, of copyright holders.
 #include <objed/objed.h>
 #include <objed/objedutils.h>
 
+#include "detector.h"
+
 namespace objed
 {
   class YScaleDetector : public Detector
@@ -50,6 +52,8 @@ namespace objed
 
   public:
     virtual DetectionList detect(IplImage *image, DebugInfo *debugInfo);
+    virtual DetectionList detectInContext(DetectionContext *context, IplImage *image, DebugInfo *debugInfo = 0) const;
+    virtual DetectionContext * createContext(ImagePool *extImagePool = 0) const;
 
     virtual Detector * clone() const;
 
@@ -57,11 +61,12 @@ namespace objed
     virtual void resetImagePool();
 
   private:
-    ImagePool *imagePool;
-    bool isImagePoolOwn;
+    void scan(const Classifier *boundClassifier, std::vector<Rect<int> > &rawDetectionList, int scaledRegionWd,
+      double scale, int yOffset, int yBegin, int yEnd, DebugInfo *debugInfo) const;
 
   private:
     Classifier *classifier;
+    DetectionContext *context;
 
   private:
     double y0, y1, yStp;
@@ -71,6 +76,8 @@ namespace objed
     int xStep, yStep;
     bool mergeIncluded;
     double overlap;
+    int threadCount;
+    bool exactClustering;
   };
 }
 
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QStringList>
+
+#include <objedutils/objedconfig.h>
+#include <objedutils/objedsys.h>
+
+#include "objedbench.h"
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+  app.setOrganizationName("Objed");
+  app.setApplicationName("ObjedBench");
+  app.setApplicationVersion(ObjedSys::version());
+
+  QTextStream out(stdout);
+  out << QString("%0 (ver. %1)").arg(app.applicationName()).arg(app.applicationVersion()) << endl;
+  out << "Command-line interface application for benchmarking objed detectors" << endl << endl;
+
+  ObjedConfig config;
+  config.registerValue("DetectorPath", "Specifies detector path in canonized form (e.g. C:/detector.json)",            QVariant());
+  config.registerValue("DatasetPath", "Specifies the directory of images (if empty synthetic noise frames are used)",  QVariant());
+  config.registerValue("SyntheticWidth", "Specifies the width of synthetic frames",                                    QVariant(640));
+  config.registerValue("SyntheticHeight", "Specifies the height of synthetic frames",                                  QVariant(480));
+  config.registerValue("SyntheticFrameCount", "Specifies the number of synthetic frames",                              QVariant(8));
+  config.registerValue("WarmupIterations", "Specifies the number of untimed detections before measuring",              QVariant(10));
+  config.registerValue("Iterations", "Specifies the number of timed detections (frames are taken in turn)",            QVariant(100));
+  config.registerValue("ReportPath", "Specifies the path of JSON report in canonized form (if empty it is only printed)", QVariant());
+  config.registerValue("LogPath", "Specifies the log path in canonized form (if empty log is not saved)",              QVariant());
+
+  if (app.arguments().count() == 2)
+  {
+    if (config.parseConfig(app.arguments().last()) == false)
+    {
+      out << "Cannot parse configuration file" << endl;
+      return -1;
+    }
+  }
+  else if (app.arguments().count() == 3 && app.arguments().value(1).toLower() == "-g")
+  {
+    if (config.saveTemplate(app.arguments().last()) == false)
+    {
+      out << "Cannot save template configuration file" << endl;
+      return -1;
+    }
+
+    out << "Template configuration file has been generated" << endl;
+    return 0;
+  }
+  else
+  {
+    QString appName = QFileInfo(app.arguments().first()).fileName();
+    out << "The application can be used in a number of ways:" << endl << endl;
+    out << "1. Use objedbench to benchmark objed detector using configuration file:" << endl;
+    out << "   " << appName << " <configName>" << endl << endl;
+    out << "2. Use objedbench to generate a template configuration file:" << endl;
+    out << "   " << appName << " -g <configName>" << endl <<endl;
+    return 0;
+  }
+
+  ObjedBench objedBench;
+  return objedBench.main(&config);
+}
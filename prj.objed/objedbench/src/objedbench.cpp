@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+
+#include <objedutils/objedconsole.h>
+#include <objedutils/objedconfig.h>
+#include <objedutils/objedimage.h>
+#include <objedutils/objedexp.h>
+#include <objedutils/objedsys.h>
+#include <objedutils/objedio.h>
+
+#include <objed/objedprofile.h>
+#include <objed/objed.h>
+
+#include <opencv/cv.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "objedbench.h"
+
+// Every operator new of the process is counted to report allocations per frame
+// (images allocated by OpenCV itself are not included)
+static std::atomic<long long> allocationCount(0);
+
+void * operator new(std::size_t size)
+{
+  allocationCount++;
+  if (void *ptr = std::malloc(size == 0 ? 1 : size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+static void releaseFrame(IplImage *frame)
+{
+  cvReleaseImage(&frame);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> &sortedValues, double fraction)
+{
+  const int count = static_cast<int>(sortedValues.size());
+  const int rank = static_cast<int>(std::ceil(fraction * count));
+  return sortedValues[std::min(count - 1, std::max(0, rank - 1))];
+}
+
+int ObjedBench::main(ObjedConfig *config)
+{
+  QString logPath = config->value("LogPath").toString();
+  if (logPath.isEmpty() == false) ObjedConsole::setLogPath(logPath);
+
+  try
+  {
+    QString detectorPath = config->value("DetectorPath").toString();
+    QSharedPointer<objed::Detector> detector = ObjedIO::loadDetector(detectorPath);
+    if (detector.isNull() == true) throw ObjedException("Cannot load detector");
+
+    QList<QSharedPointer<ObjedImage> > images;
+    QList<QSharedPointer<IplImage> > syntheticFrames;
+    std::vector<IplImage *> frames;
+
+    QString datasetPath = config->value("DatasetPath").toString();
+    if (datasetPath.isEmpty() == false)
+    {
+      QDir datasetDir(datasetPath);
+      foreach (QString imageName, datasetDir.entryList(ObjedSys::imageFilters()))
+      {
+        images.append(ObjedImage::create(datasetDir.absoluteFilePath(imageName)));
+        frames.push_back(images.last()->image());
+      }
+    }
+    else
+    {
+      const int width = config->value("SyntheticWidth").toInt();
+      const int height = config->value("SyntheticHeight").toInt();
+      if (width <= 0 || height <= 0) throw ObjedException("Invalid synthetic frame size");
+
+      CvRNG rng = cvRNG(0x0BCED);
+      for (int i = 0; i < config->value("SyntheticFrameCount").toInt(); i++)
+      {
+        IplImage *frame = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+        cvRandArr(&rng, frame, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256));
+        syntheticFrames.append(QSharedPointer<IplImage>(frame, releaseFrame));
+        frames.push_back(frame);
+      }
+    }
+
+    if (frames.empty() == true)
+      throw ObjedException("There are no frames to process");
+
+    const int warmupCount = std::max(0, config->value("WarmupIterations").toInt());
+    const int iterationCount = std::max(1, config->value("Iterations").toInt());
+
+    ObjedConsole::printInfo(QString("Warming up on %0 frames").arg(frames.size()));
+    for (int i = 0; i < warmupCount; i++)
+      detector->detect(frames[i % frames.size()]);
+
+    objed::StageProfile profile;
+    std::vector<double> latencies(iterationCount, 0.0);
+    long long allocations = 0, detections = 0;
+
+    ObjedConsole::printInfo(QString("Running %0 timed iterations").arg(iterationCount));
+    objed::StageProfile::setCurrent(&profile);
+
+    for (int i = 0; i < iterationCount; i++)
+    {
+      const long long startAllocationCount = allocationCount;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      objed::DetectionList detectionList = detector->detect(frames[i % frames.size()]);
+
+      std::chrono::duration<double> latency = std::chrono::steady_clock::now() - start;
+      latencies[i] = latency.count();
+      allocations += allocationCount - startAllocationCount;
+      detections += detectionList.size();
+    }
+
+    objed::StageProfile::setCurrent(0);
+
+    double totalSeconds = 0.0;
+    for (int i = 0; i < iterationCount; i++)
+      totalSeconds += latencies[i];
+    totalSeconds = std::max(totalSeconds, std::numeric_limits<double>::min());
+
+    std::vector<double> sortedLatencies = latencies;
+    std::sort(sortedLatencies.begin(), sortedLatencies.end());
+
+    // Times are in milliseconds per frame
+    Json::Value report;
+    report["detector"] = qPrintable(detectorPath);
+    report["frameCount"] = static_cast<int>(frames.size());
+    report["warmupIterations"] = warmupCount;
+    report["iterations"] = iterationCount;
+
+    Json::Value stages;
+    for (int stage = 0; stage < objed::StageProfile::STAGE_COUNT; stage++)
+      stages[objed::StageProfile::stageName(stage)] = 1000.0 * profile.seconds[stage] / iterationCount;
+    report["stages"] = stages;
+
+    Json::Value latency;
+    latency["mean"] = 1000.0 * totalSeconds / iterationCount;
+    latency["p50"] = 1000.0 * percentile(sortedLatencies, 0.50);
+    latency["p99"] = 1000.0 * percentile(sortedLatencies, 0.99);
+    latency["max"] = 1000.0 * sortedLatencies.back();
+    report["latency"] = latency;
+
+    report["framesPerSecond"] = iterationCount / totalSeconds;
+    report["windowsPerSecond"] = profile.windowCount / totalSeconds;
+    report["windowsPerFrame"] = static_cast<double>(profile.windowCount) / iterationCount;
+    report["allocationsPerFrame"] = static_cast<double>(allocations) / iterationCount;
+    report["detectionsPerFrame"] = static_cast<double>(detections) / iterationCount;
+
+    Json::StyledWriter writer;
+    std::string reportText = writer.write(report);
+
+    QTextStream out(stdout);
+    out << reportText.c_str() << flush;
+
+    QString reportPath = config->value("ReportPath").toString();
+    if (reportPath.isEmpty() == false)
+    {
+      QFile reportFile(reportPath);
+      if (reportFile.open(QIODevice::WriteOnly) == false)
+        throw ObjedException("Cannot save report");
+      reportFile.write(reportText.c_str());
+    }
+  }
+  catch (ObjedException ex)
+  {
+    ObjedConsole::printError(ex.details());
+  }
+
+  return 0;
+}
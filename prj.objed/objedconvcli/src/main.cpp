@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QStringList>
+#include <QFileInfo>
+
+#include <objedutils/objedconsole.h>
+#include <objedutils/objedexp.h>
+#include <objedutils/objedio.h>
+#include <objedutils/objedsys.h>
+
+#include <objed/objed.h>
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+  app.setOrganizationName("Objed");
+  app.setApplicationName("ObjedConvCLI");
+  app.setApplicationVersion(ObjedSys::version());
+
+  QTextStream out(stdout);
+  out << QString("%0 (ver. %1)").arg(app.applicationName()).arg(app.applicationVersion()) << endl;
+  out << "Command-line interface application for converting objed classifiers" << endl << endl;
+
+  if (app.arguments().count() != 3)
+  {
+    QString appName = QFileInfo(app.arguments().first()).fileName();
+    out << "The application can be used in a number of ways:" << endl << endl;
+    out << "1. Use objedconvcli to convert a JSON classifier to the binary format:" << endl;
+    out << "   " << appName << " <classifierName>.json <classifierName>.objedb" << endl << endl;
+    out << "2. Use objedconvcli to convert a binary classifier back to JSON:" << endl;
+    out << "   " << appName << " <classifierName>.objedb <classifierName>.json" << endl << endl;
+    return 0;
+  }
+
+  try
+  {
+    // The input format is detected from the file contents, the output one from the extension
+    QSharedPointer<objed::Classifier> classifier = ObjedIO::loadClassifier(app.arguments().value(1));
+    ObjedIO::saveClassifier(classifier.data(), app.arguments().value(2));
+    ObjedConsole::printInfo(QString("Classifier has been saved to %0").arg(app.arguments().value(2)));
+  }
+  catch (ObjedException ex)
+  {
+    ObjedConsole::printError(ex.details());
+    return -1;
+  }
+
+  return 0;
+}
@@ -83,7 +83,7 @@ void ObjedRunProcessor::processDataset(const QString &datasetPath)
 
   ObjedCompare::Result result;
   QVector<ObjedCompare::Result> resultList(ObjedOpenMP::maxThreadCount());
-  ObjedOpenMP::DetectorList detectorList = ObjedOpenMP::multiplyDetector(detector.data());
+  ObjedOpenMP::ContextList contextList = ObjedOpenMP::createContexts(detector.data());
 
   int processedImageCount = 0;
 
@@ -105,8 +105,8 @@ void ObjedRunProcessor::processDataset(const QString &datasetPath)
       objed::DebugInfo *debugInfo = nullptr;
       if (saveDebugInfo) debugInfo = new objed::DebugInfo();
 
-      objed::Detector *detector = detectorList[ObjedOpenMP::threadId()].data();
-      objed::DetectionList detectionList = detector->detect(image->image(), debugInfo);
+      objed::DetectionContext *context = contextList[ObjedOpenMP::threadId()].data();
+      objed::DetectionList detectionList = detector->detectInContext(context, image->image(), debugInfo);
 
       ObjedMarkup idealMarkup(idealMarkupDir.absoluteFilePath(imageName + ".json"));
       ObjedMarkup realMarkup(realMarkupDir.absoluteFilePath(imageName + ".json"), saveRealMarkup);
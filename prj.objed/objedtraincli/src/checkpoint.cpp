@@ -0,0 +1,392 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QSettings>
+#include <QFile>
+#include <QDir>
+
+#include <objedutils/objedconsole.h>
+#include <objedutils/objedconfig.h>
+#include <objedutils/objedconf.h>
+#include <objedutils/objedexp.h>
+#include <objedutils/objedio.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "checkpoint.h"
+
+static const quint32 SAMPLE_CACHE_MAGIC = 0x4F424A53;
+static const quint32 BOOSTING_STATE_MAGIC = 0x4F424A42;
+static const qint32 CHECKPOINT_VERSION = 1;
+// Version 2 caches hold 8-bit channel windows instead of integral tiles
+static const qint32 SAMPLE_CACHE_VERSION = 2;
+
+// Tiles start at a page boundary, so the cache is mapped as is
+static const qint64 TILE_ALIGNMENT = 4096;
+
+static const char *INI_FILE_NAME = "checkpoint.ini";
+static const char *SAMPLE_FILE_NAME = "samples.cache";
+static const char *CLASSIFIER_FILE_NAME = "boosting.json";
+static const char *SCORE_FILE_NAME = "boosting.scores";
+
+static QByteArray sampleCacheHeader(int width, int height, const QStringList &channelList, 
+  int posCount, int negCount, qint64 tileOffset, qint64 pathOffset)
+{
+  QByteArray header;
+  QDataStream stream(&header, QIODevice::WriteOnly);
+  stream << SAMPLE_CACHE_MAGIC << SAMPLE_CACHE_VERSION << qint32(width) << qint32(height) << channelList;
+  stream << qint32(posCount) << qint32(negCount) << tileOffset << pathOffset;
+  return header;
+}
+
+// Files are written under a temporary name and then renamed, so a crash never leaves
+// a partially written checkpoint file in place
+static void replaceFile(const QString &tempPath, const QString &path)
+{
+  QFile::remove(path);
+  if (QFile::rename(tempPath, path) == false)
+    throw ObjedException(QString("Cannot write checkpoint file %0").arg(QFileInfo(path).fileName()));
+}
+
+TrainingCheckpoint::TrainingCheckpoint(ObjedConfig *config) : checkpointPeriod(0)
+{
+  checkpointPath = config->value("CheckpointPath").toString();
+  checkpointPeriod = config->value("CheckpointPeriod").toInt();
+  if (checkpointPeriod < 0)
+    throw ObjedException("Invalid CheckpointPeriod value");
+  if (checkpointPath.isEmpty() == false && QDir().mkpath(checkpointPath) == false)
+    throw ObjedException(QString("Cannot create checkpoint directory %0").arg(checkpointPath));
+}
+
+TrainingCheckpoint::~TrainingCheckpoint()
+{
+  return;
+}
+
+bool TrainingCheckpoint::isEnabled() const
+{
+  return checkpointPath.isEmpty() == false;
+}
+
+QString TrainingCheckpoint::filePath(const QString &fileName) const
+{
+  return QDir(checkpointPath).absoluteFilePath(fileName);
+}
+
+QString TrainingCheckpoint::fingerprint(const objed::Classifier *classifier, const QString &label)
+{
+  Q_ASSERT(classifier != 0);
+
+  Json::FastWriter writer;
+  std::string data = label.toStdString() + writer.write(classifier->serialize());
+  QByteArray hash = QCryptographicHash::hash(QByteArray(data.c_str(), 
+    static_cast<int>(data.size())), QCryptographicHash::Md5);
+  return QString(hash.toHex());
+}
+
+bool TrainingCheckpoint::loadSamples(const objed::Classifier *classifier, const QString &label, 
+  SampleList &positiveSamples, SampleList &negativeSamples)
+{
+  if (isEnabled() == false)
+    return false;
+
+  levelFingerprint = fingerprint(classifier, label);
+
+  QSettings settings(filePath(INI_FILE_NAME), QSettings::IniFormat);
+  if (settings.value("Level/Fingerprint").toString() != levelFingerprint || 
+      settings.value("Level/Samples").toBool() == false)
+    return false;
+
+  QFile *file = new QFile(filePath(SAMPLE_FILE_NAME));
+  if (file->open(QIODevice::ReadOnly) == false)
+  {
+    delete file;
+    return false;
+  }
+
+  quint32 magic = 0;
+  qint32 version = 0, width = 0, height = 0, posCount = 0, negCount = 0;
+  qint64 tileOffset = 0, pathOffset = 0;
+  QStringList channelList, pathList;
+
+  QDataStream stream(file);
+  stream >> magic >> version >> width >> height >> channelList;
+  stream >> posCount >> negCount >> tileOffset >> pathOffset;
+  if (magic == SAMPLE_CACHE_MAGIC && version == SAMPLE_CACHE_VERSION && file->seek(pathOffset) == true)
+    stream >> pathList;
+
+  const int sampleCount = posCount + negCount;
+  const qint64 tileBytes = static_cast<qint64>(width) * height * channelList.count() * sampleCount;
+  uchar *data = 0;
+
+  if (stream.status() == QDataStream::Ok && pathList.count() == sampleCount && sampleCount > 0)
+    data = file->map(tileOffset, tileBytes);
+
+  if (data == 0)
+  {
+    ObjedConsole::printWarning("Checkpoint sample cache is invalid, samples are collected again");
+    delete file;
+    return false;
+  }
+
+  QSharedPointer<SampleStore> store(new SampleStore(width, height, channelList, file, data, sampleCount));
+  
+  positiveSamples.clear();
+  for (int i = 0; i < posCount; i++)
+    positiveSamples.append(QSharedPointer<Sample>(new Sample(store, i, pathList[i])));
+
+  negativeSamples.clear();
+  for (int i = 0; i < negCount; i++)
+    negativeSamples.append(QSharedPointer<Sample>(new Sample(store, posCount + i, pathList[posCount + i])));
+
+  ObjedConsole::printInfo(QString("Checkpoint: %0 positive and %1 negative samples have been loaded").
+    arg(posCount).arg(negCount));
+  return true;
+}
+
+void TrainingCheckpoint::saveSamples(const objed::Classifier *classifier, const QString &label, 
+  const SampleList &positiveSamples, const SampleList &negativeSamples)
+{
+  if (isEnabled() == false)
+    return;
+
+  levelFingerprint = fingerprint(classifier, label);
+
+  SampleList sampleList = positiveSamples + negativeSamples;
+  if (sampleList.isEmpty() == true)
+    return;
+
+  QSettings settings(filePath(INI_FILE_NAME), QSettings::IniFormat);
+  settings.remove("Level");
+  settings.remove("Boosting");
+  settings.sync();
+
+  // Samples may come from several stores, the cache takes the channel order of the first one
+  const SampleStore *firstStore = sampleList.first()->store.data();
+  const int width = firstStore->width(), height = firstStore->height();
+  QStringList channelList;
+  for (size_t i = 0; i < firstStore->channelNames().size(); i++)
+    channelList.append(QString::fromStdString(firstStore->channelNames()[i]));
+
+  QStringList pathList;
+  for (int i = 0; i < sampleList.count(); i++)
+    pathList.append(sampleList[i]->sourceImagePath);
+
+  const int tileSize = width * height;
+  const qint64 tileBytes = static_cast<qint64>(tileSize) * channelList.count() * sampleList.count();
+
+  // Header size does not depend on the offset values, so it is measured with zero offsets
+  QByteArray header = sampleCacheHeader(width, height, channelList, 
+    positiveSamples.count(), negativeSamples.count(), 0, 0);
+  const qint64 tileOffset = (header.size() + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+  header = sampleCacheHeader(width, height, channelList, 
+    positiveSamples.count(), negativeSamples.count(), tileOffset, tileOffset + tileBytes);
+  header.append(QByteArray(static_cast<int>(tileOffset - header.size()), '\0'));
+
+  const QString tempPath = filePath(SAMPLE_FILE_NAME) + ".tmp";
+  QFile file(tempPath);
+  if (file.open(QIODevice::WriteOnly) == false)
+    throw ObjedException(QString("Cannot open checkpoint file %0").arg(QFileInfo(tempPath).fileName()));
+
+  bool ok = writeDevice(&file, header.constData(), header.size());
+  for (int i = 0; i < sampleList.count() && ok == true; i++)
+  {
+    const Sample *sample = sampleList[i].data();
+    for (int j = 0; j < channelList.count() && ok == true; j++)
+    {
+      int channel = sample->store->channelIndex(channelList[j].toStdString());
+      if (channel < 0 || sample->store->width() != width || sample->store->height() != height)
+        throw ObjedException("Samples of the level have different layouts");
+
+      const char *tile = reinterpret_cast<const char *>(sample->store->tile(sample->index, channel));
+      ok = writeDevice(&file, tile, tileSize);
+    }
+  }
+
+  QDataStream stream(&file);
+  stream << pathList;
+  if (ok == false || stream.status() != QDataStream::Ok || file.flush() == false)
+    throw ObjedException("Cannot write checkpoint sample cache");
+  file.close();
+
+  replaceFile(tempPath, filePath(SAMPLE_FILE_NAME));
+  settings.setValue("Level/Fingerprint", levelFingerprint);
+  settings.setValue("Level/Samples", true);
+  settings.setValue("Level/PositiveCount", positiveSamples.count());
+  settings.setValue("Level/NegativeCount", negativeSamples.count());
+  settings.sync();
+}
+
+bool TrainingCheckpoint::loadBoosting(objed::Classifier **classifier, int *iterationCount, int *searchIteration, 
+  SampleList &positiveSamples, SampleList &negativeSamples)
+{
+  Q_ASSERT(classifier != 0 && iterationCount != 0 && searchIteration != 0);
+  if (isEnabled() == false || levelFingerprint.isEmpty() == true)
+    return false;
+
+  QSettings settings(filePath(INI_FILE_NAME), QSettings::IniFormat);
+  if (settings.value("Level/Fingerprint").toString() != levelFingerprint || 
+      settings.contains("Boosting/IterationCount") == false)
+    return false;
+
+  SampleList sampleList = positiveSamples + negativeSamples;
+  if (sampleList.isEmpty() == true)
+    return false;
+
+  QFile file(filePath(SCORE_FILE_NAME));
+  if (file.open(QIODevice::ReadOnly) == false)
+    return false;
+
+  quint32 magic = 0;
+  qint32 version = 0, savedIterationCount = 0, savedSearchIteration = 0;
+  qint32 posCount = 0, negCount = 0, scCount = 0;
+
+  QDataStream stream(&file);
+  stream >> magic >> version >> savedIterationCount >> savedSearchIteration >> posCount >> negCount >> scCount;
+
+  const int expectedScCount = static_cast<int>(sampleList.first()->scoreList.size());
+  if (stream.status() != QDataStream::Ok || magic != BOOSTING_STATE_MAGIC || version != CHECKPOINT_VERSION ||
+      savedIterationCount != settings.value("Boosting/IterationCount").toInt() ||
+      posCount != positiveSamples.count() || negCount != negativeSamples.count() || scCount != expectedScCount)
+  {
+    ObjedConsole::printWarning("Checkpoint boosting state does not match the samples, boosting is started again");
+    return false;
+  }
+
+  std::vector<float> scoreList(static_cast<size_t>(sampleList.count()) * scCount);
+  const int scoreBytes = static_cast<int>(scoreList.size() * sizeof(float));
+  if (stream.readRawData(reinterpret_cast<char *>(&scoreList[0]), scoreBytes) != scoreBytes)
+    return false;
+
+  QSharedPointer<objed::Classifier> savedClassifier;
+  try
+  {
+    savedClassifier = ObjedIO::loadClassifier(filePath(CLASSIFIER_FILE_NAME));
+  }
+  catch (ObjedException ex)
+  {
+    ObjedConsole::printWarning(ex.details());
+    return false;
+  }
+
+  for (int i = 0; i < sampleList.count(); i++)
+  {
+    Sample *sample = sampleList[i].data();
+    sample->scoreList.assign(scoreList.begin() + i * scCount, scoreList.begin() + (i + 1) * scCount);
+
+    sample->score = -std::numeric_limits<float>::max();
+    for (size_t j = 0; j < sample->scoreList.size(); j++)
+      sample->score = std::max(sample->score, sample->scoreList[j]);
+  }
+
+  *classifier = savedClassifier->clone();
+  *iterationCount = savedIterationCount;
+  *searchIteration = savedSearchIteration;
+
+  ObjedConsole::printInfo(QString("Checkpoint: boosting is resumed after %0 iterations").arg(savedIterationCount));
+  return true;
+}
+
+void TrainingCheckpoint::saveBoosting(const objed::Classifier *classifier, int iterationCount, int searchIteration, 
+  const SampleList &positiveSamples, const SampleList &negativeSamples)
+{
+  Q_ASSERT(classifier != 0);
+  if (isEnabled() == false || levelFingerprint.isEmpty() == true)
+    return;
+
+  // Boosting state is only useful together with the sample cache of the same level
+  QSettings settings(filePath(INI_FILE_NAME), QSettings::IniFormat);
+  if (settings.value("Level/Fingerprint").toString() != levelFingerprint)
+    return;
+
+  settings.remove("Boosting");
+  settings.sync();
+
+  SampleList sampleList = positiveSamples + negativeSamples;
+  const int scCount = sampleList.isEmpty() ? 0 : static_cast<int>(sampleList.first()->scoreList.size());
+
+  std::vector<float> scoreList;
+  scoreList.reserve(static_cast<size_t>(sampleList.count()) * scCount);
+  for (int i = 0; i < sampleList.count(); i++)
+  {
+    Q_ASSERT(static_cast<int>(sampleList[i]->scoreList.size()) == scCount);
+    scoreList.insert(scoreList.end(), sampleList[i]->scoreList.begin(), sampleList[i]->scoreList.end());
+  }
+
+  const QString tempScorePath = filePath(SCORE_FILE_NAME) + ".tmp";
+  QFile file(tempScorePath);
+  if (file.open(QIODevice::WriteOnly) == false)
+    throw ObjedException(QString("Cannot open checkpoint file %0").arg(QFileInfo(tempScorePath).fileName()));
+
+  QDataStream stream(&file);
+  stream << BOOSTING_STATE_MAGIC << CHECKPOINT_VERSION << qint32(iterationCount) << qint32(searchIteration);
+  stream << qint32(positiveSamples.count()) << qint32(negativeSamples.count()) << qint32(scCount);
+  if (scoreList.empty() == false)
+    stream.writeRawData(reinterpret_cast<const char *>(&scoreList[0]), static_cast<int>(scoreList.size() * sizeof(float)));
+  if (stream.status() != QDataStream::Ok || file.flush() == false)
+    throw ObjedException("Cannot write checkpoint boosting state");
+  file.close();
+
+  const QString tempClassifierPath = filePath(CLASSIFIER_FILE_NAME) + ".tmp";
+  ObjedIO::saveClassifier(classifier, tempClassifierPath);
+
+  replaceFile(tempScorePath, filePath(SCORE_FILE_NAME));
+  replaceFile(tempClassifierPath, filePath(CLASSIFIER_FILE_NAME));
+  settings.setValue("Boosting/IterationCount", iterationCount);
+  settings.setValue("Boosting/SearchIteration", searchIteration);
+  settings.sync();
+
+  ObjedConsole::printInfo(QString("Checkpoint: boosting state after %0 iterations has been saved").arg(iterationCount));
+}
+
+bool TrainingCheckpoint::isBoostingDue(int iterationCount) const
+{
+  return isEnabled() == true && checkpointPeriod > 0 && iterationCount % checkpointPeriod == 0;
+}
+
+void TrainingCheckpoint::clear()
+{
+  if (isEnabled() == false)
+    return;
+
+  QSettings settings(filePath(INI_FILE_NAME), QSettings::IniFormat);
+  settings.remove("Level");
+  settings.remove("Boosting");
+  settings.sync();
+
+  QFile::remove(filePath(SAMPLE_FILE_NAME));
+  QFile::remove(filePath(CLASSIFIER_FILE_NAME));
+  QFile::remove(filePath(SCORE_FILE_NAME));
+  levelFingerprint.clear();
+}
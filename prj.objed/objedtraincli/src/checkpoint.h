@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+#include <QString>
+
+#include "objedtrainutils.h"
+
+class ObjedConfig;
+
+// Resumable state of the level being trained, kept in CheckpointPath: the samples of the
+// level in a cache file mapped back on load, and the boosting state (strong classifier
+// trained so far and the cumulative sample scores, which give the sample weights) saved
+// every CheckpointPeriod iterations. checkpoint.ini records the level the files belong to
+// by a fingerprint of the classifier the samples were collected with
+class TrainingCheckpoint
+{
+  Q_DISABLE_COPY(TrainingCheckpoint)
+
+public:
+  TrainingCheckpoint(ObjedConfig *config);
+  virtual ~TrainingCheckpoint();
+
+public:
+  bool isEnabled() const;
+
+  // Both methods select the level (label and classifier passing the samples), loading
+  // returns false if there is no cache for it
+  bool loadSamples(const objed::Classifier *classifier, const QString &label, 
+    SampleList &positiveSamples, SampleList &negativeSamples);
+  void saveSamples(const objed::Classifier *classifier, const QString &label, 
+    const SampleList &positiveSamples, const SampleList &negativeSamples);
+
+  bool loadBoosting(objed::Classifier **classifier, int *iterationCount, int *searchIteration, 
+    SampleList &positiveSamples, SampleList &negativeSamples);
+  void saveBoosting(const objed::Classifier *classifier, int iterationCount, int searchIteration, 
+    const SampleList &positiveSamples, const SampleList &negativeSamples);
+  bool isBoostingDue(int iterationCount) const;
+
+  // Removes the state of the level once it is trained
+  void clear();
+
+private:
+  QString filePath(const QString &fileName) const;
+  static QString fingerprint(const objed::Classifier *classifier, const QString &label);
+
+private:
+  QString checkpointPath;
+  int checkpointPeriod;
+  QString levelFingerprint;
+};
+
+#endif  // CHECKPOINT_H_INCLUDED
@@ -29,6 +29,7 @@ of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of copyright holders.
 */
 
+#include <QElapsedTimer>
 #include <QSharedPointer>
 
 #include <objedutils/objedconsole.h>
@@ -38,6 +39,13 @@ either expressed or implied, of copyright holders.
 #include <objedutils/objedexp.h>
 #include <objedutils/objedsys.h>
 
+#include <objed/src/cascadecl.h>
+
+#include <opencv/cv.h>
+
+#include <queue>
+#include <vector>
+
 #include "objedtrainutils.h"
 #include "datasetproc.h"
 
@@ -58,9 +66,111 @@ static QStringList makeImagePathList(const QVariantList &datasetList)
   return imagePathList;
 }
 
+// Preprocesses the window of the image at (x, y) into the channels of the store the same way 
+// positive icons are: the window alone is preprocessed in windowPool, so channel borders of both
+// classes are computed alike
+static void prepareWindow(const SampleStore *store, objed::ImagePool *windowPool, 
+  const IplImage *image, int x, int y, int width, int height)
+{
+  IplImage window;
+  cvInitImageHeader(&window, cvSize(width, height), image->depth, image->nChannels, image->origin);
+  window.imageData = image->imageData + y * image->widthStep + x * image->nChannels * ((image->depth & 255) / 8);
+  window.widthStep = image->widthStep;
+
+  windowPool->update(&window);
+  for (size_t i = 0; i < store->channelNames().size(); i++)
+    windowPool->image(store->channelNames()[i]);
+}
+
+static int appendWindow(SampleStore *store, objed::ImagePool *windowPool, 
+  const IplImage *image, int x, int y, int width, int height)
+{
+  prepareWindow(store, windowPool, image, x, y, width, height);
+  return store->append(windowPool);
+}
+
+// Uniform sampling of negativeCount windows out of all false positives of the current
+// cascade: every window gets a pseudo-random key derived from its position only and the
+// reservoir keeps the windows with the smallest keys, so the result does not depend on
+// the order in which threads offer their windows. Kept windows occupy slots 0 .. capacity - 1
+// of the mining store, and the window evicted by a new one leaves its slot to it
+class NegativeReservoir
+{
+public:
+  NegativeReservoir(int capacity) : capacity(capacity)
+  {
+    return;
+  }
+
+public:
+  static quint64 key(int imageIndex, int level, int x, int y)
+  {
+    return mix(mix(mix(mix(0, imageIndex), level), y), x);
+  }
+
+  // Keys not less than the threshold are rejected, the threshold never grows
+  quint64 threshold() const
+  {
+    if (capacity <= 0)
+      return 0;
+    return static_cast<int>(heap.size()) < capacity ? ~0ULL : heap.top().key;
+  }
+
+  // Returns the slot the window is to be stored to or -1 if the window is rejected
+  int offer(quint64 key, const QString &imagePath)
+  {
+    if (key >= threshold())
+      return -1;
+
+    int slot = static_cast<int>(heap.size());
+    if (slot >= capacity)
+    {
+      slot = heap.top().slot;
+      heap.pop();
+    }
+
+    heap.push(Item(key, slot, imagePath));
+    return slot;
+  }
+
+  SampleList samples(const QSharedPointer<SampleStore> &store)
+  {
+    SampleList sampleList;
+    for (; heap.empty() == false; heap.pop())
+      sampleList.prepend(QSharedPointer<Sample>(new Sample(store, heap.top().slot, heap.top().imagePath)));
+    return sampleList;
+  }
+
+private:
+  // One SplitMix64 step per field, so distinct positions never share the hashed value
+  static quint64 mix(quint64 hash, int value)
+  {
+    quint64 z = hash + static_cast<quint32>(value) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+private:
+  struct Item
+  {
+    Item(quint64 key, int slot, const QString &imagePath) : 
+      key(key), slot(slot), imagePath(imagePath) {}
+    bool operator<(const Item &other) const { return key < other.key; }
+
+    quint64 key;
+    int slot;
+    QString imagePath;
+  };
+
+  int capacity;
+  std::priority_queue<Item> heap;
+};
+
 DatasetProcessor::DatasetProcessor(ObjedConfig *config) : 
 classifierWidth(0), classifierHeight(0), minScale(1.0), 
-maxScale(1.0), stpScale(0.1), negativeCount(0)
+maxScale(1.0), stpScale(0.1), negativeCount(0),
+positiveSampleSetLoaded(false), positiveStageCount(0)
 {
   classifierWidth = config->value("ClassifierWidth").toInt();
   classifierHeight = config->value("ClassifierHeight").toInt();
@@ -75,11 +185,23 @@ maxScale(1.0), stpScale(0.1), negativeCount(0)
   if (negativeCount <= 0)
     throw ObjedException("Invalid NegativeCount value");
 
+  negativeMining = config->value("NegativeMining").toString().toLower();
+  if (negativeMining != "period" && negativeMining != "reservoir")
+    throw ObjedException("Invalid NegativeMining value");
+
   positiveImagePathList = makeImagePathList(config->listValue("PositiveDatasetList"));
   if (positiveImagePathList.isEmpty() == true) throw ObjedException("There are no positive images");
 
   negativeImagePathList = makeImagePathList(config->listValue("NegativeDatasetList"));
   if (negativeImagePathList.isEmpty() == true) throw ObjedException("There are no negative images");
+
+  QVariantList wcLineList = config->listValue("WcLineList");
+  for (int i = 0; i < wcLineList.count(); i++)
+  {
+    QString preproc = WcMaker::preproc(wcLineList[i].toString());
+    if (wcPreprocList.contains(preproc) == false)
+      wcPreprocList.append(preproc);
+  }
 }
 
 DatasetProcessor::~DatasetProcessor()
@@ -94,10 +216,96 @@ SampleList DatasetProcessor::preparePositiveSamples(objed::Classifier *classifie
   if (classifier->width() != classifierWidth || classifier->height() != classifierHeight)
     throw ObjedException("Invalid classifier size");
 
+  return loadPositiveSamples(classifier, true);
+}
+
+// Positives are loaded once and then only evaluated by the stages added to the cascade since 
+// the previous call. The cascade rejects on negative results while it is short and also on zero 
+// results once it is long (see CascadeClassifier::rejects), so candidates only drop out on negative 
+// results until then, and the samples returned are those the whole cascade would accept
+SampleList DatasetProcessor::updatePositiveSamples(const objed::CascadeClassifier *cascade)
+{
+  if (cascade == 0)
+    throw ObjedException("Invalid passed classifier");
+  if (cascade->width() != classifierWidth || cascade->height() != classifierHeight)
+    throw ObjedException("Invalid classifier size");
+
+  if (positiveSampleSetLoaded == false)
+  {
+    positiveSampleSet = loadPositiveSamples(cascade, false);
+    positiveLastResults = QVector<float>(positiveSampleSet.count(), objed::epsilon);
+    positiveZeroResults = QVector<char>(positiveSampleSet.count(), 0);
+    positiveSampleSetLoaded = true;
+    positiveStageCount = 0;
+  }
+
+  const int stageCount = static_cast<int>(cascade->clList.size());
+  if (stageCount < positiveStageCount)
+    throw ObjedException("Cascade classifier has lost stages");
+
+  for (int stage = positiveStageCount; stage < stageCount; stage++)
+  {
+    ObjedOpenMP::ClassifierList stageList = ObjedOpenMP::multiplyClassifier(cascade->clList[stage]);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < positiveSampleSet.count(); i++)
+    {
+      objed::Classifier *classifier = stageList[ObjedOpenMP::threadId()].data();
+
+      float result = objed::epsilon;
+      classifier->prepare(positiveSampleSet[i]->imagePool);
+      classifier->evaluate(&result, classifierWidth / 2, classifierHeight / 2);
+      positiveLastResults[i] = result;
+      positiveZeroResults[i] |= result == 0.0;
+    }
+
+    // Candidates rejected by this stage would be rejected by every longer cascade as well
+    SampleList candidateSamples;
+    QVector<float> candidateLastResults;
+    QVector<char> candidateZeroResults;
+    for (int i = 0; i < positiveSampleSet.count(); i++)
+    {
+      const bool rejected = objed::CascadeClassifier::rejects(stageCount, positiveLastResults[i]) ||
+        (objed::CascadeClassifier::rejects(stageCount, 0.0) && positiveZeroResults[i] != 0);
+      if (rejected == true)
+        continue;
+
+      candidateSamples.append(positiveSampleSet[i]);
+      candidateLastResults.append(positiveLastResults[i]);
+      candidateZeroResults.append(positiveZeroResults[i]);
+    }
+
+    ObjedConsole::printInfo(QString("Stage %0 keeps %1 of %2 positive samples").
+      arg(stage + 1).arg(candidateSamples.count()).arg(positiveSampleSet.count()));
+    positiveSampleSet = candidateSamples;
+    positiveLastResults = candidateLastResults;
+    positiveZeroResults = candidateZeroResults;
+  }
+
+  positiveStageCount = stageCount;
+
+  // The last stage decides as in CascadeClassifier::evaluate: only positive results pass
+  SampleList passedSamples;
+  for (int i = 0; i < positiveSampleSet.count(); i++)
+  {
+    if (positiveLastResults[i] > 0.0)
+      passedSamples.append(positiveSampleSet[i]);
+  }
+
+  return passedSamples;
+}
+
+SampleList DatasetProcessor::loadPositiveSamples(const objed::Classifier *classifier, bool filter)
+{
   SampleList positiveSamples;
   ObjedOpenMP::ClassifierList clasifierList = ObjedOpenMP::multiplyClassifier(classifier);
   QVector<SampleList> positiveSamplesList(ObjedOpenMP::maxThreadCount());
+  QVector<QSharedPointer<objed::ImagePool> > imagePoolList(ObjedOpenMP::maxThreadCount());
 
+  for (int i = 0; i < ObjedOpenMP::maxThreadCount(); i++)
+    imagePoolList[i].reset(objed::ImagePool::create(), objed::ImagePool::destroy);
+
+  QSharedPointer<SampleStore> store = createSampleStore(classifier);
   int loadedSampleCount = 0;
 
   #pragma omp parallel for schedule(dynamic)
@@ -113,20 +321,25 @@ SampleList DatasetProcessor::preparePositiveSamples(objed::Classifier *classifie
     loadedSampleCount++;
 
     objed::Classifier *classifier = clasifierList[ObjedOpenMP::threadId()].data();
+    objed::ImagePool *imagePool = imagePoolList[ObjedOpenMP::threadId()].data();
     SampleList &positiveSamples = positiveSamplesList[ObjedOpenMP::threadId()];
 
     QSharedPointer<ObjedImage> image = ObjedImage::create(imagePath);
     image->resize(QSize(classifierWidth, classifierHeight));
-    QSharedPointer<Sample> sample(new Sample(image.data(), imagePath));
+    imagePool->update(image->image());
     
-    float result = objed::epsilon;
-    classifier->prepare(sample->imagePool);
-    classifier->evaluate(&result, classifierWidth / 2, classifierHeight / 2);
+    if (filter == true)
+    {
+      float result = objed::epsilon;
+      classifier->prepare(imagePool);
+      classifier->evaluate(&result, classifierWidth / 2, classifierHeight / 2);
 
-    if (result <= 0.0) 
-      continue;
+      if (result <= 0.0) 
+        continue;
+    }
 
-    positiveSamples.append(sample);
+    int index = store->append(imagePool);
+    positiveSamples.append(QSharedPointer<Sample>(new Sample(store, index, imagePath)));
   }
 
   for (int i = 0; i < positiveSamplesList.count(); i++)
@@ -143,15 +356,25 @@ SampleList DatasetProcessor::prepareNegativeSamples(objed::Classifier *classifie
   if (classifier->width() != classifierWidth || classifier->height() != classifierHeight)
     throw ObjedException("Invalid classifier size");
 
+  if (negativeMining == "reservoir")
+    return mineNegativeSamplesByReservoir(classifier);
+  return mineNegativeSamplesByPeriod(classifier);
+}
+
+SampleList DatasetProcessor::mineNegativeSamplesByPeriod(objed::Classifier *classifier)
+{
   ObjedOpenMP::ClassifierList clasifierList = ObjedOpenMP::multiplyClassifier(classifier);
   QVector<QSharedPointer<objed::ImagePool> > imagePoolList(ObjedOpenMP::maxThreadCount());
+  QVector<QSharedPointer<objed::ImagePool> > windowPoolList(ObjedOpenMP::maxThreadCount());
 
   for (int i = 0; i < ObjedOpenMP::maxThreadCount(); i++)
   {
     imagePoolList[i].reset(objed::ImagePool::create(), objed::ImagePool::destroy);
+    windowPoolList[i].reset(objed::ImagePool::create(), objed::ImagePool::destroy);
     clasifierList[i]->prepare(imagePoolList[i].data());
   }
 
+  QSharedPointer<SampleStore> store = createSampleStore(classifier);
   SampleList negativeSamples;
   for (int i = 0; i < negativeImagePathList.count() && negativeSamples.count() < negativeCount; i++)
   {
@@ -173,10 +396,12 @@ SampleList DatasetProcessor::prepareNegativeSamples(objed::Classifier *classifie
       {
         objed::Classifier *classifier = clasifierList[ObjedOpenMP::threadId()].data();
         objed::ImagePool *imagePool = imagePoolList[ObjedOpenMP::threadId()].data();
+        objed::ImagePool *windowPool = windowPoolList[ObjedOpenMP::threadId()].data();
         SampleList &negativeSamples = negativeSamplesList[ObjedOpenMP::threadId()];
 
         QSharedPointer<ObjedImage> image = imagePyramid[i];
         imagePool->update(image->image());
+        classifier->prepare(imagePool);
 
         qint64 subwindowNumber = 0;
         for (int y = classifierHeight / 2; y < image->height() - classifierHeight / 2; y++)
@@ -188,11 +413,9 @@ SampleList DatasetProcessor::prepareNegativeSamples(objed::Classifier *classifie
 
             if ((result > 0) && ((subwindowNumber % period) == shift))
             {
-              QSharedPointer<ObjedImage> imageRegion = ObjedImage::create(image.data(), 
-                QRect(x - classifierWidth / 2, y - classifierHeight / 2, classifierWidth, classifierHeight));
-
-              QSharedPointer<Sample> sample(new Sample(imageRegion.data(), imagePath));
-              negativeSamples.append(sample);
+              int index = appendWindow(store.data(), windowPool, image->image(), 
+                x - classifierWidth / 2, y - classifierHeight / 2, classifierWidth, classifierHeight);
+              negativeSamples.append(QSharedPointer<Sample>(new Sample(store, index, imagePath)));
             }
           }
         }
@@ -207,6 +430,114 @@ SampleList DatasetProcessor::prepareNegativeSamples(objed::Classifier *classifie
   return negativeSamples;
 }
 
+SampleList DatasetProcessor::mineNegativeSamplesByReservoir(objed::Classifier *classifier)
+{
+  ObjedOpenMP::ClassifierList clasifierList = ObjedOpenMP::multiplyClassifier(classifier);
+  QVector<QSharedPointer<objed::ImagePool> > imagePoolList(ObjedOpenMP::maxThreadCount());
+  QVector<QSharedPointer<objed::ImagePool> > windowPoolList(ObjedOpenMP::maxThreadCount());
+
+  for (int i = 0; i < ObjedOpenMP::maxThreadCount(); i++)
+  {
+    imagePoolList[i].reset(objed::ImagePool::create(), objed::ImagePool::destroy);
+    windowPoolList[i].reset(objed::ImagePool::create(), objed::ImagePool::destroy);
+  }
+
+  // The mining store never holds more windows than the reservoir keeps
+  QSharedPointer<SampleStore> miningStore = createSampleStore(classifier);
+  NegativeReservoir reservoir(negativeCount);
+  qint64 windowCount = 0, falsePositiveCount = 0;
+  int processedImageCount = 0;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < negativeImagePathList.count(); i++)
+  {
+    QString imagePath = negativeImagePathList[i];
+    QString imageName = QFileInfo(imagePath).fileName();
+
+    int progress = 100 * processedImageCount / negativeImagePathList.count();
+    ObjedConsole::printProgress(QString("Processing negative image %0").arg(imageName), progress);
+
+    objed::Classifier *classifier = clasifierList[ObjedOpenMP::threadId()].data();
+    objed::ImagePool *imagePool = imagePoolList[ObjedOpenMP::threadId()].data();
+    objed::ImagePool *windowPool = windowPoolList[ObjedOpenMP::threadId()].data();
+
+    // The shared threshold only decreases, so a stale local copy rejects conservatively
+    quint64 threshold = ~0ULL;
+    qint64 imageWindowCount = 0, imageFalsePositiveCount = 0;
+
+    QList<QSharedPointer<ObjedImage> > imagePyramid = prepareImagePyramid(imagePath);
+    for (int level = 0; level < imagePyramid.count(); level++)
+    {
+      QSharedPointer<ObjedImage> image = imagePyramid[level];
+      imagePool->update(image->image());
+      classifier->prepare(imagePool);
+
+      for (int y = classifierHeight / 2; y < image->height() - classifierHeight / 2; y++)
+      {
+        for (int x = classifierWidth / 2; x < image->width() - classifierWidth / 2; x++, imageWindowCount++)
+        {
+          float result = objed::epsilon;
+          classifier->evaluate(&result, x, y);
+          if (result <= 0)
+            continue;
+
+          imageFalsePositiveCount++;
+          quint64 key = NegativeReservoir::key(i, level, x, y);
+          if (key >= threshold)
+            continue;
+
+          // Channels are computed before the lock, so only the copy is serialized
+          prepareWindow(miningStore.data(), windowPool, image->image(), 
+            x - classifierWidth / 2, y - classifierHeight / 2, classifierWidth, classifierHeight);
+
+          #pragma omp critical(negativeReservoir)
+          {
+            const int slot = reservoir.offer(key, imagePath);
+            if (slot >= 0 && slot < miningStore->count())
+              miningStore->replace(slot, windowPool);
+            else if (slot >= 0)
+              miningStore->append(windowPool);
+            threshold = reservoir.threshold();
+          }
+        }
+      }
+    }
+
+    #pragma omp critical(negativeReservoir)
+    {
+      windowCount += imageWindowCount;
+      falsePositiveCount += imageFalsePositiveCount;
+      processedImageCount++;
+    }
+  }
+
+  SampleList negativeSamples = reservoir.samples(miningStore);
+  ObjedConsole::printProgress(QString("%0 negative sample were generated").arg(negativeSamples.count()), 100);
+
+  double falsePositiveRate = windowCount > 0 ? static_cast<double>(falsePositiveCount) / windowCount : 0.0;
+  ObjedConsole::printInfo(QString("Bootstrap: %0 images, %1 windows, %2 false positives (rate %3), %4 samples kept, %5 s").
+    arg(negativeImagePathList.count()).arg(windowCount).arg(falsePositiveCount).arg(falsePositiveRate, 0, 'g').
+    arg(negativeSamples.count()).arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+
+  return negativeSamples;
+}
+
+QSharedPointer<SampleStore> DatasetProcessor::createSampleStore(const objed::Classifier *classifier) const
+{
+  QStringList channelList = wcPreprocList;
+  QStringList classifierChannelList = classifierPreprocs(classifier);
+  for (int i = 0; i < classifierChannelList.count(); i++)
+  {
+    if (channelList.contains(classifierChannelList[i]) == false)
+      channelList.append(classifierChannelList[i]);
+  }
+
+  return QSharedPointer<SampleStore>(new SampleStore(classifierWidth, classifierHeight, channelList));
+}
+
 QList<QSharedPointer<ObjedImage> > DatasetProcessor::prepareImagePyramid(const QString &imagePath)
 {
   QList<QSharedPointer<ObjedImage> > imagePyramid;
@@ -34,6 +34,7 @@ either expressed or implied, of copyright holders.
 #define DATASETPROC_H_INCLUDED
 
 #include <QStringList>
+#include <QVector>
 #include <QString>
 #include <QObject>
 
@@ -42,6 +43,11 @@ either expressed or implied, of copyright holders.
 
 #include "objedtrainutils.h"
 
+namespace objed
+{
+  class CascadeClassifier;
+}
+
 class ObjedConfig;
 class ObjedImage;
 
@@ -55,9 +61,16 @@ public:
 
 public:
   SampleList preparePositiveSamples(objed::Classifier *classifier);
+  SampleList updatePositiveSamples(const objed::CascadeClassifier *cascade);
   SampleList prepareNegativeSamples(objed::Classifier *classifier);
 
 private:
+  SampleList loadPositiveSamples(const objed::Classifier *classifier, bool filter);
+  SampleList mineNegativeSamplesByPeriod(objed::Classifier *classifier);
+  SampleList mineNegativeSamplesByReservoir(objed::Classifier *classifier);
+
+private:
+  QSharedPointer<SampleStore> createSampleStore(const objed::Classifier *classifier) const;
   QList<QSharedPointer<ObjedImage> > prepareImagePyramid(const QString &imagePath);
   qint64 computePeriod(const QList<QSharedPointer<ObjedImage> > &imagePyramid);
 
@@ -67,6 +80,16 @@ private:
   int classifierWidth, classifierHeight;
   double minScale, maxScale, stpScale;
   int negativeCount;
+  QString negativeMining;
+  QStringList wcPreprocList;
+
+  // Candidates of updatePositiveSamples with the result of the last stage and
+  // whether any stage gave them a zero result
+  SampleList positiveSampleSet;
+  QVector<float> positiveLastResults;
+  QVector<char> positiveZeroResults;
+  bool positiveSampleSetLoaded;
+  int positiveStageCount;
 };
 
 #endif  // DATASETPROC_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,378 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <QTemporaryFile>
+#include <QIODevice>
+#include <QStringList>
+#include <QDir>
+
+#include <objedutils/objedconsole.h>
+#include <objedutils/objedopenmp.h>
+#include <objedutils/objedexp.h>
+
+#include <objed/src/haar1stumpcl.h>
+#include <objed/src/haar2stumpcl.h>
+#include <objed/src/haar3stumpcl.h>
+#include <objed/src/haar1pwcl.h>
+#include <objed/src/haar2pwcl.h>
+#include <objed/src/haar3pwcl.h>
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "featurematrix.h"
+
+// Samples are processed in blocks of SAMPLE_BLOCK: the integrals of a block are computed
+// for one preproc at a time and stay in cache for all candidates of that preproc
+static const int SAMPLE_BLOCK = 64;
+static const int ROW_ALIGNMENT = 16;
+
+// Consecutive samples often have equal feature values, so accumulating them into a single
+// histogram makes every addition wait for the previous store to the same bin. Each of the
+// SUBHISTOGRAM_COUNT interleaved histograms takes every fourth sample instead
+static const int SUBHISTOGRAM_COUNT = 4;
+
+typedef void (*FeatureFunction)(const objed::Classifier *wc, 
+  const IplImage * const *integrals, int count, uchar *values);
+
+template<class T>
+static void computeHaarFeatures(const objed::Classifier *wc, 
+  const IplImage * const *integrals, int count, uchar *values)
+{
+  const T *haarWc = static_cast<const T *>(wc);
+  const int clWidth2 = haarWc->width() / 2, clHeight2 = haarWc->height() / 2;
+
+  for (int i = 0; i < count; i++)
+  {
+    int value = haarWc->compute(integrals[i], clWidth2, clHeight2);
+    Q_ASSERT(value >= 0 && value <= 255);
+    values[i] = static_cast<uchar>(value);
+  }
+}
+
+template<class T>
+static FeatureFunction haarFeatureFunction(const objed::Classifier *wc, QString *preproc)
+{
+  const T *haarWc = dynamic_cast<const T *>(wc);
+  if (haarWc == 0)
+    return 0;
+
+  *preproc = QString::fromStdString(haarWc->preproc);
+  return computeHaarFeatures<T>;
+}
+
+static FeatureFunction featureFunction(const objed::Classifier *wc, QString *preproc)
+{
+  FeatureFunction function = 0;
+  if ((function = haarFeatureFunction<objed::Haar1StumpClassifier>(wc, preproc)) != 0)
+    return function;
+  if ((function = haarFeatureFunction<objed::Haar2StumpClassifier>(wc, preproc)) != 0)
+    return function;
+  if ((function = haarFeatureFunction<objed::Haar3StumpClassifier>(wc, preproc)) != 0)
+    return function;
+  if ((function = haarFeatureFunction<objed::Haar1PwClassifier>(wc, preproc)) != 0)
+    return function;
+  if ((function = haarFeatureFunction<objed::Haar2PwClassifier>(wc, preproc)) != 0)
+    return function;
+  if ((function = haarFeatureFunction<objed::Haar3PwClassifier>(wc, preproc)) != 0)
+    return function;
+
+  return 0;
+}
+
+static void mergeSubHistograms(double subHistograms[SUBHISTOGRAM_COUNT][FEATURE_VALUE_COUNT], double *histogram)
+{
+  const double *h0 = subHistograms[0], *h1 = subHistograms[1];
+  const double *h2 = subHistograms[2], *h3 = subHistograms[3];
+
+#if defined(__SSE2__)
+  for (int v = 0; v < FEATURE_VALUE_COUNT; v += 2)
+  {
+    __m128d sum01 = _mm_add_pd(_mm_loadu_pd(h0 + v), _mm_loadu_pd(h1 + v));
+    __m128d sum23 = _mm_add_pd(_mm_loadu_pd(h2 + v), _mm_loadu_pd(h3 + v));
+    _mm_storeu_pd(histogram + v, _mm_add_pd(sum01, sum23));
+  }
+#else
+  for (int v = 0; v < FEATURE_VALUE_COUNT; v++)
+    histogram[v] = (h0[v] + h1[v]) + (h2[v] + h3[v]);
+#endif
+}
+
+static void weightedHistogram(const uchar *values, const double *weights, int count, double *histogram)
+{
+  double subHistograms[SUBHISTOGRAM_COUNT][FEATURE_VALUE_COUNT];
+  std::memset(subHistograms, 0, sizeof(subHistograms));
+
+  double *h0 = subHistograms[0], *h1 = subHistograms[1];
+  double *h2 = subHistograms[2], *h3 = subHistograms[3];
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    h0[values[i + 0]] += weights[i + 0];
+    h1[values[i + 1]] += weights[i + 1];
+    h2[values[i + 2]] += weights[i + 2];
+    h3[values[i + 3]] += weights[i + 3];
+    h0[values[i + 4]] += weights[i + 4];
+    h1[values[i + 5]] += weights[i + 5];
+    h2[values[i + 6]] += weights[i + 6];
+    h3[values[i + 7]] += weights[i + 7];
+  }
+
+  for (; i < count; i++)
+    h0[values[i]] += weights[i];
+
+  mergeSubHistograms(subHistograms, histogram);
+}
+
+// Same as weightedHistogram, but for the samples listed in columns (weights are compact)
+static void gatheredHistogram(const uchar *values, const int *columns, const double *weights, 
+  int count, double *histogram)
+{
+  double subHistograms[SUBHISTOGRAM_COUNT][FEATURE_VALUE_COUNT];
+  std::memset(subHistograms, 0, sizeof(subHistograms));
+
+  double *h0 = subHistograms[0], *h1 = subHistograms[1];
+  double *h2 = subHistograms[2], *h3 = subHistograms[3];
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    h0[values[columns[i + 0]]] += weights[i + 0];
+    h1[values[columns[i + 1]]] += weights[i + 1];
+    h2[values[columns[i + 2]]] += weights[i + 2];
+    h3[values[columns[i + 3]]] += weights[i + 3];
+  }
+
+  for (; i < count; i++)
+    h0[values[columns[i]]] += weights[i];
+
+  mergeSubHistograms(subHistograms, histogram);
+}
+
+FeatureMatrix::FeatureMatrix() :
+rowCount(0), posCount(0), negCount(0), stride(0), data(0), memory(0), spillFile(0)
+{
+  return;
+}
+
+FeatureMatrix::~FeatureMatrix()
+{
+  clear();
+}
+
+void FeatureMatrix::clear()
+{
+  delete[] memory;
+  delete spillFile;
+
+  rowCount = posCount = negCount = stride = 0;
+  data = memory = 0;
+  spillFile = 0;
+}
+
+static int rowStrideFor(int sampleCount)
+{
+  return (sampleCount + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+}
+
+bool FeatureMatrix::allocate(qint64 size, qint64 memoryLimit, const QString &spillDir)
+{
+  if (memoryLimit <= 0 || size <= memoryLimit)
+  {
+    memory = new uchar[size];
+    data = memory;
+    return true;
+  }
+
+  QString dirPath = spillDir.isEmpty() == true ? QDir::tempPath() : spillDir;
+  spillFile = new QTemporaryFile(QDir(dirPath).filePath("objedfeatures.XXXXXX"));
+  if (spillFile->open() == false || spillFile->resize(size) == false)
+    return false;
+
+  data = spillFile->map(0, size);
+  return data != 0;
+}
+
+void FeatureMatrix::compute(const WcList &wcList, const SampleList &positiveSamples, 
+  const SampleList &negativeSamples, qint64 memoryLimit, const QString &spillDir)
+{
+  clear();
+
+  rowCount = wcList.count();
+  posCount = positiveSamples.count();
+  negCount = negativeSamples.count();
+  stride = rowStrideFor(posCount + negCount);
+
+  const int samplesCount = posCount + negCount;
+  if (rowCount == 0 || samplesCount == 0)
+    return;
+
+  // Samples keep 8-bit channel windows only, so integrals are computed here per
+  // sample block instead of being fetched through the image pools of the samples
+  QStringList preprocList;
+  QVector<FeatureFunction> functionList(rowCount);
+  QVector<QVector<int> > preprocRowList;
+  for (int i = 0; i < rowCount; i++)
+  {
+    QString preproc;
+    functionList[i] = featureFunction(wcList[i].data(), &preproc);
+    if (functionList[i] == 0)
+      throw ObjedException("Unsupported weak classifier type");
+
+    if (preprocList.contains(preproc) == false)
+    {
+      preprocList.append(preproc);
+      preprocRowList.append(QVector<int>());
+    }
+    preprocRowList[preprocList.indexOf(preproc)].append(i);
+  }
+
+  QVector<const Sample *> sampleList(samplesCount);
+  for (int j = 0; j < posCount; j++)
+    sampleList[j] = positiveSamples[j].data();
+  for (int j = 0; j < negCount; j++)
+    sampleList[posCount + j] = negativeSamples[j].data();
+
+  const int sampleWidth = sampleList[0]->store->width();
+  const int sampleHeight = sampleList[0]->store->height();
+  QVector<int> channelList(preprocList.count() * samplesCount);
+  for (int p = 0; p < preprocList.count(); p++)
+  {
+    std::string preproc = preprocList[p].toStdString();
+    for (int j = 0; j < samplesCount; j++)
+    {
+      const SampleStore *store = sampleList[j]->store.data();
+      if (store->width() != sampleWidth || store->height() != sampleHeight)
+        throw ObjedException("Samples of different sizes");
+
+      channelList[p * samplesCount + j] = store->channelIndex(preproc);
+      if (channelList[p * samplesCount + j] < 0)
+        throw ObjedException(QString("Samples have no '%0' channel").arg(preprocList[p]));
+    }
+  }
+
+  if (allocate(static_cast<qint64>(rowCount) * stride, memoryLimit, spillDir) == false)
+    throw ObjedException("Cannot allocate feature matrix");
+
+  QVector<IplImage *> integralList(ObjedOpenMP::maxThreadCount() * SAMPLE_BLOCK);
+  for (int i = 0; i < integralList.count(); i++)
+    integralList[i] = cvCreateImage(cvSize(sampleWidth + 1, sampleHeight + 1), IPL_DEPTH_32S, 1);
+
+  const int blockCount = (samplesCount + SAMPLE_BLOCK - 1) / SAMPLE_BLOCK;
+  int computedBlockCount = 0;
+
+#pragma omp parallel for schedule(dynamic)
+  for (int block = 0; block < blockCount; block++)
+  {
+    if (computedBlockCount % 16 == 0)
+    {
+      int progress = 100 * computedBlockCount / blockCount;
+      ObjedConsole::printProgress("Computing feature matrix", progress);
+    }
+
+    IplImage * const *integrals = integralList.constData() + ObjedOpenMP::threadId() * SAMPLE_BLOCK;
+    const int first = block * SAMPLE_BLOCK;
+    const int count = qMin(SAMPLE_BLOCK, samplesCount - first);
+
+    for (int p = 0; p < preprocList.count(); p++)
+    {
+      for (int j = 0; j < count; j++)
+      {
+        const Sample *sample = sampleList[first + j];
+        sample->store->computeIntegral(sample->index, channelList[p * samplesCount + first + j], integrals[j]);
+      }
+
+      const QVector<int> &rows = preprocRowList[p];
+      for (int k = 0; k < rows.count(); k++)
+      {
+        const int i = rows[k];
+        functionList[i](wcList[i].data(), integrals, count, data + static_cast<qint64>(i) * stride + first);
+      }
+    }
+
+#pragma omp atomic
+    computedBlockCount++;
+  }
+
+  for (int i = 0; i < integralList.count(); i++)
+    cvReleaseImage(&integralList[i]);
+
+  for (int i = 0; i < rowCount; i++)
+    std::memset(data + static_cast<qint64>(i) * stride + samplesCount, 0, stride - samplesCount);
+
+  ObjedConsole::printProgress("Feature matrix has been computed", 100);
+}
+
+void FeatureMatrix::histogram(int candidate, const double *weights, 
+  double *posHistogram, double *negHistogram) const
+{
+  const uchar *values = row(candidate);
+  weightedHistogram(values, weights, posCount, posHistogram);
+  weightedHistogram(values + posCount, weights + posCount, negCount, negHistogram);
+}
+
+void FeatureMatrix::histogram(int candidate, const int *columns, const double *weights, 
+  int selectedPosCount, int selectedNegCount, double *posHistogram, double *negHistogram) const
+{
+  const uchar *values = row(candidate);
+  gatheredHistogram(values, columns, weights, selectedPosCount, posHistogram);
+  gatheredHistogram(values, columns + selectedPosCount, weights + selectedPosCount, selectedNegCount, negHistogram);
+}
+
+bool FeatureMatrix::write(QIODevice *device, int first, int last) const
+{
+  Q_ASSERT(device != 0);
+  Q_ASSERT(first >= 0 && first <= last && last <= rowCount);
+
+  const char *rows = reinterpret_cast<const char *>(data) + static_cast<qint64>(first) * stride;
+  return writeDevice(device, rows, static_cast<qint64>(last - first) * stride);
+}
+
+bool FeatureMatrix::read(QIODevice *device, int rowCount, int posCount, int negCount)
+{
+  Q_ASSERT(device != 0);
+  clear();
+
+  this->rowCount = rowCount;
+  this->posCount = posCount;
+  this->negCount = negCount;
+  stride = rowStrideFor(posCount + negCount);
+
+  const qint64 size = static_cast<qint64>(rowCount) * stride;
+  if (allocate(size, 0, QString()) == false)
+    return false;
+
+  return readDevice(device, reinterpret_cast<char *>(data), size);
+}
@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef FEATUREMATRIX_H_INCLUDED
+#define FEATUREMATRIX_H_INCLUDED
+
+#include <QVector>
+
+#include "objedtrainutils.h"
+
+class QTemporaryFile;
+class QIODevice;
+
+// Feature values of all candidate weak classifiers on all samples of a cascade level:
+// row i holds the value of wcList[i] on every positive sample followed by every negative
+// sample (zero padded up to rowStride). The values do not depend on sample weights, so
+// boosting iterations only run weighted histogram passes over the rows
+static const int FEATURE_VALUE_COUNT = 256;
+
+class FeatureMatrix
+{
+  Q_DISABLE_COPY(FeatureMatrix)
+
+public:
+  FeatureMatrix();
+  virtual ~FeatureMatrix();
+
+public:
+  void compute(const WcList &wcList, const SampleList &positiveSamples, const SampleList &negativeSamples,
+    qint64 memoryLimit = 0, const QString &spillDir = QString());
+  void clear();
+
+public:
+  // Raw rows [first, last) are transferred, the reader gets them as rows [0, last - first)
+  bool write(QIODevice *device, int first, int last) const;
+  bool read(QIODevice *device, int rowCount, int posCount, int negCount);
+
+public:
+  inline int candidateCount() const { return rowCount; }
+  inline int positiveCount() const { return posCount; }
+  inline int negativeCount() const { return negCount; }
+  inline int sampleCount() const { return posCount + negCount; }
+  inline int rowStride() const { return stride; }
+  inline bool isMapped() const { return spillFile != 0; }
+
+  void histogram(int candidate, const double *weights, 
+    double *posHistogram, double *negHistogram) const;
+  // Histograms over the selected sample columns only (positive columns go first), weights
+  // are given per selected sample
+  void histogram(int candidate, const int *columns, const double *weights, 
+    int selectedPosCount, int selectedNegCount, double *posHistogram, double *negHistogram) const;
+
+  inline const uchar * row(int candidate) const
+  {
+    Q_ASSERT(candidate >= 0 && candidate < rowCount);
+    return data + static_cast<qint64>(candidate) * stride;
+  }
+
+private:
+  bool allocate(qint64 size, qint64 memoryLimit, const QString &spillDir);
+
+private:
+  int rowCount, posCount, negCount, stride;
+  uchar *data, *memory;
+  QTemporaryFile *spillFile;
+};
+
+#endif  // FEATUREMATRIX_H_INCLUDED
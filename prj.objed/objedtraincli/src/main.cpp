@@ -39,6 +39,7 @@ either expressed or implied, of copyright holders.
 
 #include "objedtrainutils.h"
 #include "objedtraincli.h"
+#include "wcsearch.h"
 
 int main(int argc, char* argv[])
 {
@@ -47,6 +48,10 @@ int main(int argc, char* argv[])
   app.setApplicationName("ObjedTrainCLI");
   app.setApplicationVersion(ObjedSys::version());
 
+  // Worker processes talk to their coordinator over stdin and stdout, so nothing else is printed
+  if (app.arguments().count() == 2 && app.arguments().last() == ShardedWcSearch::WORKER_ARGUMENT)
+    return ShardedWcSearch::runWorker();
+
   QTextStream out(stdout);
   out << QString("%0 (ver. %1)").arg(app.applicationName()).arg(app.applicationVersion()) << endl;
   out << QString("Command-line interface application for training classifiers using Boosting Approach") << endl << endl;
@@ -60,6 +65,7 @@ int main(int argc, char* argv[])
   config.registerValue("MaximumScale", "Specifies the maximum object scale value (must be greater or equal to MinimumScale)",    QVariant(1.0));
   config.registerValue("StepScale", "Specifies the scale step (must be greater then 1.0)",                                       QVariant(1.1));
   config.registerValue("NegativeCount", "Specifies the negative sample count used for training (must be positive number)",       QVariant(1000));
+  config.registerValue("NegativeMining", "Specifies negative mining mode ('Period' or 'Reservoir' single-pass sampling)",        QVariant("Period"));
   config.registerValue("PositiveCountThreshold", "Specifies the minimum threshold of positive sample count needed for training", QVariant(0));
   config.registerValue("NegativeCountThreshold", "Specifies the minimum threshold of negative sample count needed for training", QVariant(0));
   config.registerValue("WeightShift", "Specifies initial distribution of weights (total initial weight of positive samples)",    QVariant(0.5));
@@ -70,11 +76,25 @@ int main(int argc, char* argv[])
   config.registerValue("StoppingCriterion", "Specifies the stopping criterion for level training ('Count', 'Rate', or 'Any')",   QVariant("Any")); 
   config.registerValue("Method", "Specifies training method ('RealAdaBoost', 'RealAdaBoostMax')",                                QVariant("RealAdaBoost"));
   config.registerValue("MethodParams", "Specifies additional parameters for training method",                                    QVariant(""));
+  config.registerValue("FeatureMatrixMemoryLimit", "Specifies feature matrix memory limit in MB (if 0 then unlimited)",          QVariant(0));
+  config.registerValue("FeatureMatrixPath", "Specifies directory for mapped feature matrix (temporary directory if empty)",      QVariant(""));
+  config.registerValue("WorkerCount", "Specifies count of local worker processes for training (if 0 then in-process)",           QVariant(0));
+  config.registerValue("WorkerThreadCount", "Specifies count of threads of each worker process (if 0 then cores / WorkerCount)", QVariant(0));
+  config.registerValue("WeightTrimming", "Specifies weight fraction of the lightest samples skipped by search (if 0 then none)", QVariant(0.0));
+  config.registerValue("WcSubsampleFraction", "Specifies fraction of weak classifiers searched per iteration (if 1 then all)",   QVariant(1.0));
+  config.registerValue("WcSubsampleSeed", "Specifies seed of weak classifier subsampling",                                       QVariant(0));
+  config.registerValue("SearchReportPeriod", "Specifies period in iterations of comparison with full search (if 0 then never)",  QVariant(10));
+  config.registerValue("CostPenalty", "Specifies penalty added to z per unit of weak classifier cost (if 0 then none)",          QVariant(0.0));
+  config.registerValue("NormalizationCost", "Specifies extra cost of normalized weak classifiers (in rectangle sums)",           QVariant(1.0));
+  config.registerValue("ChannelCost", "Specifies cost of a channel not used by preceding stages (in rectangle sums)",            QVariant(8.0));
   config.registerValue("TempIniPath", "Specifies the path to the temporary data file (INI-file), not used if empty",             QVariant(""));
+  config.registerValue("CheckpointPath", "Specifies directory for sample cache and boosting checkpoints (not used if empty)",    QVariant(""));
+  config.registerValue("CheckpointPeriod", "Specifies period in weak classifiers of boosting checkpoints (if 0 then never)",     QVariant(10));
   config.registerValue("LogPath", "Specifies the log path in canonized form (if empty log is not saved)",                        QVariant());
   config.registerListValue("PositiveDatasetList", "Specifies the list of directories in canonized form with positive icons",     QVariantList());
   config.registerListValue("NegativeDatasetList", "Specifies the list of directories in canonized form with negative images",    QVariantList());
   config.registerListValue("WcLineList", "Specifies available weak classifier as floows:\n" + WcMaker::help().join("\n"),        QVariantList());
+  config.registerListValue("WcCostList", "Specifies weak classifier costs as '<Wc> <cost>' (rectangle count by default)",        QVariantList());
   
   if (app.arguments().count() == 2)
   {
@@ -44,6 +44,7 @@ either expressed or implied, of copyright holders.
 #include "objedtraincli.h"
 #include "datasetproc.h"
 #include "trainscproc.h"
+#include "checkpoint.h"
 
 static QStringList getLeaveList(const QString &tempIniPath)
 {
@@ -193,6 +194,7 @@ int ObjedTrainCLI::trainCascadeClassifier(ObjedConfig *config)
   {
     DatasetProcessor datasetProc(config);
     TrainScProcessor trainScProc(config);
+    TrainingCheckpoint checkpoint(config);
 
     QSharedPointer<objed::CascadeClassifier> cascade;
 
@@ -216,24 +218,34 @@ int ObjedTrainCLI::trainCascadeClassifier(ObjedConfig *config)
       QString label = QString("(%0)").arg(QString(cascade->clList.size() + 1, 'C'));
       ObjedConsole::printInfo(QString("Training '%0' node of cascade classifier").arg(label));
 
-      SampleList positiveSamples = datasetProc.preparePositiveSamples(cascade.data());
+      SampleList positiveSamples, negativeSamples;
+      bool cachedSamples = checkpoint.loadSamples(cascade.data(), label, positiveSamples, negativeSamples);
+
+      if (cachedSamples == false)
+        positiveSamples = datasetProc.updatePositiveSamples(cascade.data());
       if (positiveSamples.count() <= positiveSamplesThreshold)
       {
         ObjedConsole::printInfo("Positive sample count is less than threshold value");
         break;
       }
 
-      SampleList negativeSamples = datasetProc.prepareNegativeSamples(cascade.data());
+      if (cachedSamples == false)
+        negativeSamples = datasetProc.prepareNegativeSamples(cascade.data());
       if (negativeSamples.count() <= negativeSamplesThreshold)
       {
         ObjedConsole::printInfo("Negative sample count is less than threshold value");
         break;
       }
 
-      QSharedPointer<objed::Classifier> sc = trainScProc.trainSc(positiveSamples, negativeSamples);
+      if (cachedSamples == false)
+        checkpoint.saveSamples(cascade.data(), label, positiveSamples, negativeSamples);
+
+      trainScProc.setPrecedingClassifier(cascade.data());
+      QSharedPointer<objed::Classifier> sc = trainScProc.trainSc(positiveSamples, negativeSamples, &checkpoint);
       cascade->clList.push_back(sc->clone());
 
       ObjedIO::saveClassifier(cascade.data(), classifierPath);
+      checkpoint.clear();
 
       if (levelCountThreshold > 0 && ++levelCount >= levelCountThreshold)
       {
@@ -269,6 +281,7 @@ int ObjedTrainCLI::trainTreeClassifier(ObjedConfig *config)
   {
     DatasetProcessor datasetProc(config);
     TrainScProcessor trainScProc(config);
+    TrainingCheckpoint checkpoint(config);
 
     QSharedPointer<objed::TreeClassifier> tree;
 
@@ -305,21 +318,30 @@ int ObjedTrainCLI::trainTreeClassifier(ObjedConfig *config)
           ObjedConsole::printInfo(QString("Training '%0' node of tree classifier").arg(label));
           QSharedPointer<ParityCascadeClassifier> parityCascade = buildParityCascade(tree.data(), label);
 
-          SampleList positiveSamples = datasetProc.preparePositiveSamples(parityCascade.data());
+          SampleList positiveSamples, negativeSamples;
+          bool cachedSamples = checkpoint.loadSamples(parityCascade.data(), label, positiveSamples, negativeSamples);
+
+          if (cachedSamples == false)
+            positiveSamples = datasetProc.preparePositiveSamples(parityCascade.data());
           if (positiveSamples.count() <= positiveSamplesThreshold && label.endsWith("lC"))
           {
             leaveList.append(label);
             throw ObjedException("Positive sample count is less than threshold value");
           }
 
-          SampleList negativeSamples = datasetProc.prepareNegativeSamples(parityCascade.data());
+          if (cachedSamples == false)
+            negativeSamples = datasetProc.prepareNegativeSamples(parityCascade.data());
           if (negativeSamples.count() <= negativeSamplesThreshold)
           {
             leaveList.append(label);
             throw ObjedException("Negative sample count is less than threshold value");
           }
 
-          QSharedPointer<objed::Classifier> sc = trainScProc.trainSc(positiveSamples, negativeSamples);
+          if (cachedSamples == false)
+            checkpoint.saveSamples(parityCascade.data(), label, positiveSamples, negativeSamples);
+
+          trainScProc.setPrecedingClassifier(parityCascade.data());
+          QSharedPointer<objed::Classifier> sc = trainScProc.trainSc(positiveSamples, negativeSamples, &checkpoint);
           updateClassifierByLabel(tree.data(), sc.data(), label);
           anyScTrained = true;
         }
@@ -330,6 +352,7 @@ int ObjedTrainCLI::trainTreeClassifier(ObjedConfig *config)
 
         ObjedIO::saveClassifier(tree.data(), classifierPath);
         updateLeaveList(tempIniPath, leaveList);
+        checkpoint.clear();
         
         if (label.lastIndexOf("rC") > 0) 
           label = label.left(label.lastIndexOf("rC")) + "lC";
@@ -30,6 +30,7 @@ either expressed or implied, of copyright holders.
 */
 
 #include <QVariantMap>
+#include <QIODevice>
 
 #include <objedutils/objedconf.h>
 
@@ -43,16 +44,54 @@ either expressed or implied, of copyright holders.
 
 #include "objedtrainutils.h"
 
-Sample::Sample(const ObjedImage *image, const QString &path) :
-imagePool(0), weight(0.0), sourceImagePath(path)
+Sample::Sample(const QSharedPointer<SampleStore> &store, int index, const QString &path) :
+imagePool(0), weight(0.0), sourceImagePath(path), score(0.0f), index(-1)
 {
-  imagePool = objed::ImagePool::create();
-  imagePool->update(image->image());
+  imagePool = &storeImagePool;
+  rebind(store, index);
 }
 
 Sample::~Sample()
 {
-  objed::ImagePool::destroy(imagePool);
+  return;
+}
+
+void Sample::rebind(const QSharedPointer<SampleStore> &store, int index)
+{
+  Q_ASSERT(store.isNull() == false);
+  this->store = store;
+  this->index = index;
+  storeImagePool.bind(store.data(), index);
+}
+
+static void collectPreprocs(const Json::Value &data, QStringList *preprocList)
+{
+  if (data.isObject() == true)
+  {
+    if (data.isMember("preproc") == true && data["preproc"].isString() == true)
+    {
+      QString preproc = QString::fromStdString(data["preproc"].asString());
+      if (preprocList->contains(preproc) == false)
+        preprocList->append(preproc);
+    }
+
+    Json::Value::Members memberList = data.getMemberNames();
+    for (size_t i = 0; i < memberList.size(); i++)
+      collectPreprocs(data[memberList[i]], preprocList);
+  }
+  else if (data.isArray() == true)
+  {
+    for (Json::Value::UInt i = 0; i < data.size(); i++)
+      collectPreprocs(data[i], preprocList);
+  }
+}
+
+QStringList classifierPreprocs(const objed::Classifier *classifier)
+{
+  QStringList preprocList;
+  if (classifier != 0)
+    collectPreprocs(classifier->serialize(), &preprocList);
+  return preprocList;
 }
 
 static QList<int> parseIntRange(const QString &line)
@@ -73,11 +112,9 @@ static QList<int> parseIntRange(const QString &line)
   return intRangeList;
 }
 
-WcList WcMaker::make(const QString &wcLine, const QSize &size)
+QVariantMap WcMaker::parseParams(const QString &wcLine)
 {
   QStringList itemList = wcLine.split(" ", QString::SkipEmptyParts);
-  if (itemList.isEmpty() == true)
-    return WcList();
 
   QVariantMap wcParams;
   for (int i = 1; i < itemList.count(); i++)
@@ -90,6 +127,57 @@ WcList WcMaker::make(const QString &wcLine, const QSize &size)
     QVariant paramValue = paramList.last().simplified();
     wcParams.insert(paramName, paramValue);
   }
+
+  return wcParams;
+}
+
+QString WcMaker::preproc(const QString &wcLine)
+{
+  return parseParams(wcLine)["preproc"].toString();
+}
+
+bool readDevice(QIODevice *device, char *buffer, qint64 size)
+{
+  for (qint64 received = 0; received < size; )
+  {
+    qint64 count = device->read(buffer + received, size - received);
+    if (count < 0)
+      return false;
+    if (count == 0 && device->waitForReadyRead(-1) == false)
+      return false;
+    received += count;
+  }
+
+  return true;
+}
+
+bool writeDevice(QIODevice *device, const char *buffer, qint64 size)
+{
+  for (qint64 written = 0; written < size; )
+  {
+    qint64 count = device->write(buffer + written, size - written);
+    if (count <= 0)
+      return false;
+    written += count;
+  }
+
+  // Processes only send their buffered data from the event loop or when asked to wait
+  while (device->bytesToWrite() > 0)
+  {
+    if (device->waitForBytesWritten(-1) == false)
+      return false;
+  }
+
+  return true;
+}
+
+WcList WcMaker::make(const QString &wcLine, const QSize &size)
+{
+  QStringList itemList = wcLine.split(" ", QString::SkipEmptyParts);
+  if (itemList.isEmpty() == true)
+    return WcList();
+
+  QVariantMap wcParams = parseParams(wcLine);
   
   if (itemList.first().simplified() == "Haar1StumpWc")
     return makeHaar1StumpWc(wcParams, size);
@@ -43,6 +43,9 @@ either expressed or implied, of copyright holders.
 
 #include <objed/objed.h>
 
+#include "samplestore.h"
+
+class QIODevice;
 class Sample;
 typedef QList<QSharedPointer<Sample> > SampleList;
 typedef QList<QSharedPointer<objed::Classifier> > WcList;
@@ -50,14 +53,32 @@ typedef QList<QSharedPointer<objed::Classifier> > WcList;
 class Sample
 {
 public:
-  Sample(const ObjedImage *image, const QString &path = QString());
+  Sample(const QSharedPointer<SampleStore> &store, int index, const QString &path = QString());
   virtual ~Sample();
 
 public:
+  void rebind(const QSharedPointer<SampleStore> &store, int index);
+
+public:
+  // Classifiers prepared on the pool must be evaluated before the thread prepares
+  // them on another sample of the same store (see SampleImagePool)
   objed::ImagePool *imagePool;
   QString sourceImagePath;
   double weight;
 
+public:
+  // Cached results of the strong classifier being trained: one cumulative
+  // score per strong classifier and the resulting stage score
+  std::vector<float> scoreList;
+  float score;
+
+public:
+  QSharedPointer<SampleStore> store;
+  int index;
+
+private:
+  SampleImagePool storeImagePool;
+
 private:
   Sample(const Sample &);
   Sample &operator=(const Sample &);
@@ -68,8 +89,10 @@ class WcMaker
 public:
   static WcList make(const QString &wcLine, const QSize &size);
   static QStringList help();
+  static QString preproc(const QString &wcLine);
 
 private:
+  static QVariantMap parseParams(const QString &wcLine);
   static WcList makeHaar1StumpWc(const QVariantMap &wcParams, const QSize &size);
   static WcList makeHaar2StumpWc(const QVariantMap &wcParams, const QSize &size);
   static WcList makeHaar3StumpWc(const QVariantMap &wcParams, const QSize &size);
@@ -78,6 +101,12 @@ private:
   static WcList makeHaar3PwWc(const QVariantMap &wcParams, const QSize &size);
 };
 
+QStringList classifierPreprocs(const objed::Classifier *classifier);
+
+// Blocking transfer of exactly size bytes (waits on sequential devices such as pipes)
+bool readDevice(QIODevice *device, char *buffer, qint64 size);
+bool writeDevice(QIODevice *device, const char *buffer, qint64 size);
+
 class ParityCascadeClassifier : public objed::Classifier
 {
 public:
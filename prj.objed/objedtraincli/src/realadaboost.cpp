@@ -30,6 +30,7 @@ either expressed or implied, of copyright holders.
 */
 
 #include <QVector>
+#include <QPair>
 
 #include <objedutils/objedconsole.h>
 #include <objedutils/objedconf.h>
@@ -47,54 +48,42 @@ either expressed or implied, of copyright holders.
 #include <objed/src/linearcl.h>
 #include <objed/src/maxcl.h>
 
+#include <algorithm>
 #include <climits>
+#include <random>
 
+#include "featurematrix.h"
 #include "trainscproc.h"
+#include "wcsearch.h"
 
 template<class T>
-static double trainHaarStumpWc(objed::Classifier *wc, const SampleList &posSampleList, const SampleList &negSampleList)
+static double trainHaarStumpWc(objed::Classifier *wc, const double *posHistogram, const double *negHistogram, int sampleCount)
 {
-  const int clWidth2 = wc->width() / 2, clHeight2 = wc->height() / 2;
   T *haarWc = static_cast<T *>(wc);
   Q_ASSERT(haarWc != 0);
 
-  double posWeights0[256] = {0}, posWeights1[256] = {0};
-  double negWeights0[256] = {0}, negWeights1[256] = {0};
+  // Weights1[i] hold samples with value <= i (prefix sums), Weights0[i] - with value > i (suffix sums)
+  double posWeights0[FEATURE_VALUE_COUNT] = {0}, posWeights1[FEATURE_VALUE_COUNT] = {0};
+  double negWeights0[FEATURE_VALUE_COUNT] = {0}, negWeights1[FEATURE_VALUE_COUNT] = {0};
 
-  for (int i = 0; i < posSampleList.count(); i++)
+  double posSum = 0.0, negSum = 0.0;
+  for (int i = 0; i < FEATURE_VALUE_COUNT; i++)
   {
-    Sample *posSample = posSampleList[i].data();
-    int value = haarWc->compute(posSample->imagePool->
-      integral(haarWc->preproc), clWidth2, clHeight2);
-
-    for (int i = 0; i < 256; i++)
-    {
-      if (value > i) 
-        posWeights0[i] += posSample->weight;
-      else 
-        posWeights1[i] +=posSample->weight;
-    }
+    posWeights1[i] = posSum += posHistogram[i];
+    negWeights1[i] = negSum += negHistogram[i];
   }
 
-  for (int i = 0; i < negSampleList.count(); i++)
+  posSum = negSum = 0.0;
+  for (int i = FEATURE_VALUE_COUNT - 1; i > 0; i--)
   {
-    Sample *negSample = negSampleList[i].data();
-    int value = haarWc->compute(negSample->imagePool->
-      integral(haarWc->preproc), clWidth2, clHeight2);
-
-    for (int i = 0; i < 256; i++)
-    {
-      if (value > i)
-        negWeights0[i] += negSample->weight;
-      else 
-        negWeights1[i] += negSample->weight;
-    }
+    posWeights0[i - 1] = posSum += posHistogram[i];
+    negWeights0[i - 1] = negSum += negHistogram[i];
   }
 
   double bestZ = 1.0 + objed::epsilon;
-  double sEpsilon = objed::epsilon / (posSampleList.count() + negSampleList.count());
+  double sEpsilon = objed::epsilon / sampleCount;
 
-  for (int i = 0; i < 256; i++)
+  for (int i = 0; i < FEATURE_VALUE_COUNT; i++)
   {
     double z = 2 * (std::sqrt(posWeights0[i] * negWeights0[i]) + std::sqrt(posWeights1[i] * negWeights1[i]));
     if (z < bestZ)
@@ -110,37 +99,27 @@ static double trainHaarStumpWc(objed::Classifier *wc, const SampleList &posSampl
 }
 
 template<class T>
-static double trainHaarPwWc(objed::Classifier *wc, const SampleList &posSampleList, const SampleList &negSampleList)
+static double trainHaarPwWc(objed::Classifier *wc, const double *posHistogram, const double *negHistogram, int sampleCount)
 {
-  const int clWidth2 = wc->width() / 2, clHeight2 = wc->height() / 2;
   T *haarWc = static_cast<T *>(wc);
   Q_ASSERT(haarWc != 0);
 
-  double *posWeights = new double[haarWc->bins.size()];
-  double *negWeights = new double[haarWc->bins.size()];
-  memset(posWeights, 0, sizeof(double) * haarWc->bins.size());
-  memset(negWeights, 0, sizeof(double) * haarWc->bins.size());
+  const int binCount = static_cast<int>(haarWc->bins.size());
+  double *posWeights = new double[binCount];
+  double *negWeights = new double[binCount];
+  memset(posWeights, 0, sizeof(double) * binCount);
+  memset(negWeights, 0, sizeof(double) * binCount);
 
-  for (int i = 0; i < posSampleList.count(); i++)
+  for (int i = 0; i < FEATURE_VALUE_COUNT; i++)
   {
-    Sample *posSample = posSampleList[i].data();
-    int value = haarWc->compute(posSample->imagePool->
-      integral(haarWc->preproc), clWidth2, clHeight2);
-    posWeights[value * haarWc->bins.size() / 256] += posSample->weight;
-  }
-
-  for (int i = 0; i < negSampleList.count(); i++)
-  {
-    Sample *negSample = negSampleList[i].data();
-    int value = haarWc->compute(negSample->imagePool->
-      integral(haarWc->preproc), clWidth2, clHeight2);
-    negWeights[value * haarWc->bins.size() / 256] += negSample->weight;
+    posWeights[i * binCount / FEATURE_VALUE_COUNT] += posHistogram[i];
+    negWeights[i * binCount / FEATURE_VALUE_COUNT] += negHistogram[i];
   }
 
   double z = 0.0;
-  for (size_t i = 0; i < haarWc->bins.size(); i++)
+  for (int i = 0; i < binCount; i++)
   {
-    double sEpsilon = objed::epsilon / (posSampleList.count() + negSampleList.count());
+    double sEpsilon = objed::epsilon / sampleCount;
     haarWc->bins[i] = 0.5 * std::log((posWeights[i] + sEpsilon) / (negWeights[i] + sEpsilon));
     z += 2 * std::sqrt(posWeights[i] * negWeights[i]);
   }
@@ -151,75 +130,275 @@ static double trainHaarPwWc(objed::Classifier *wc, const SampleList &posSampleLi
   return z;
 }
 
-static double trainWcReal(objed::Classifier *wc,  const SampleList &posSampleList, const SampleList &negSampleList)
+static double trainWcReal(objed::Classifier *wc, const double *posHistogram, const double *negHistogram, int sampleCount)
 {
   if (dynamic_cast<objed::Haar1StumpClassifier *>(wc) != 0)
-    return trainHaarStumpWc<objed::Haar1StumpClassifier>(wc, posSampleList, negSampleList);
+    return trainHaarStumpWc<objed::Haar1StumpClassifier>(wc, posHistogram, negHistogram, sampleCount);
   if (dynamic_cast<objed::Haar2StumpClassifier *>(wc) != 0)
-    return trainHaarStumpWc<objed::Haar2StumpClassifier>(wc, posSampleList, negSampleList);
+    return trainHaarStumpWc<objed::Haar2StumpClassifier>(wc, posHistogram, negHistogram, sampleCount);
   if (dynamic_cast<objed::Haar3StumpClassifier *>(wc) != 0)
-    return trainHaarStumpWc<objed::Haar3StumpClassifier>(wc, posSampleList, negSampleList);
+    return trainHaarStumpWc<objed::Haar3StumpClassifier>(wc, posHistogram, negHistogram, sampleCount);
   if (dynamic_cast<objed::Haar1PwClassifier *>(wc) != 0)
-    return trainHaarPwWc<objed::Haar1PwClassifier>(wc, posSampleList, negSampleList);
+    return trainHaarPwWc<objed::Haar1PwClassifier>(wc, posHistogram, negHistogram, sampleCount);
   if (dynamic_cast<objed::Haar2PwClassifier *>(wc) != 0)
-    return trainHaarPwWc<objed::Haar2PwClassifier>(wc, posSampleList, negSampleList);
+    return trainHaarPwWc<objed::Haar2PwClassifier>(wc, posHistogram, negHistogram, sampleCount);
   if (dynamic_cast<objed::Haar3PwClassifier *>(wc) != 0)
-    return trainHaarPwWc<objed::Haar3PwClassifier>(wc, posSampleList, negSampleList);
+    return trainHaarPwWc<objed::Haar3PwClassifier>(wc, posHistogram, negHistogram, sampleCount);
 
   Q_ASSERT(false);
   return 1.0;
 }
 
-static QSharedPointer<objed::Classifier> realAdaBoost(WcList &wcList, SampleList &positiveSamples, 
-  SampleList &negativeSamples, const QString &progressLabel)
+double trainWc(objed::Classifier *wc, const FeatureMatrix &featureMatrix, int row, 
+  const double *weights, const WcSearchSubset *subset)
 {
-  Q_ASSERT(wcList.count() > 0);
-  Q_ASSERT(positiveSamples.count() > 0);
-  Q_ASSERT(negativeSamples.count() > 0);
+  double posHistogram[FEATURE_VALUE_COUNT], negHistogram[FEATURE_VALUE_COUNT];
+  if (subset != 0 && subset->columnList.isEmpty() == false)
+  {
+    featureMatrix.histogram(row, subset->columnList.constData(), subset->weightList.constData(), subset->positiveCount, 
+      subset->columnList.count() - subset->positiveCount, posHistogram, negHistogram);
+  }
+  else
+  {
+    featureMatrix.histogram(row, weights, posHistogram, negHistogram);
+  }
 
-  if (wcList.isEmpty() == true)
-    throw ObjedException("No weak classifier");
-  if (positiveSamples.isEmpty() == true || negativeSamples.isEmpty() == true)
-    throw ObjedException("No positive or negative samples");
+  return trainWcReal(wc, posHistogram, negHistogram, featureMatrix.sampleCount());
+}
 
-  QVector<double> zList(wcList.count());
-  int trainedWcCount = 0, wcCount = wcList.count();
+int searchBestWc(const WcList &wcList, const FeatureMatrix &featureMatrix, const double *weights, 
+  double *bestZ, const QString &progressLabel, const WcSearchSubset *subset)
+{
+  Q_ASSERT(featureMatrix.candidateCount() == wcList.count());
+
+  QVector<int> candidateList;
+  if (subset != 0 && subset->candidateList.isEmpty() == false)
+  {
+    candidateList = subset->candidateList;
+  }
+  else
+  {
+    candidateList.resize(wcList.count());
+    for (int i = 0; i < candidateList.count(); i++)
+      candidateList[i] = i;
+  }
+
+  QVector<double> zList(candidateList.count());
+  int trainedWcCount = 0, wcCount = candidateList.count();
 
 #pragma omp parallel for schedule(dynamic)
   for (int i = 0; i < wcCount; i++)
   {
-    if (trainedWcCount % 100 == 0)
+    if (progressLabel.isEmpty() == false && trainedWcCount % 100 == 0)
     {
       int progress = 100 * trainedWcCount / wcCount;
       ObjedConsole::printProgress(progressLabel, progress);
     }
 
-    zList[i] = trainWcReal(wcList[i].data(), positiveSamples, negativeSamples);
+    const int candidate = candidateList[i];
+    zList[i] = trainWc(wcList[candidate].data(), featureMatrix, candidate, weights, subset);
 
 #pragma omp atomic
     trainedWcCount++;
   }
 
-  double bestZ = 1.0 + objed::epsilon;
-  objed::Classifier *bestWc = 0;
+  const bool penalized = subset != 0 && subset->penaltyList.isEmpty() == false;
+  double bestScore = 0.0;
+  int bestIndex = -1;
+  *bestZ = 1.0 + objed::epsilon;
 
   for (int i = 0; i < zList.count(); i++)
   {
-    if (zList[i] < bestZ)
+    if (zList[i] >= 1.0 + objed::epsilon)
+      continue;
+
+    double score = penalized == true ? zList[i] + subset->penaltyList[candidateList[i]] : zList[i];
+    if (bestIndex < 0 || score < bestScore)
+    {
+      bestIndex = candidateList[i];
+      bestScore = score;
+      *bestZ = zList[i];
+    }
+  }
+
+  return bestIndex;
+}
+
+// Picks round(fraction * wcCount) distinct candidates (at least one), sorted so that ties
+// are resolved the same way as in the full search. The choice depends only on the seed and
+// the iteration number
+static QVector<int> subsampleCandidates(int wcCount, double fraction, quint32 seed, int iteration)
+{
+  std::seed_seq seedSequence = {seed, static_cast<quint32>(iteration)};
+  std::mt19937 generator(seedSequence);
+
+  QVector<int> candidateList(wcCount);
+  for (int i = 0; i < wcCount; i++)
+    candidateList[i] = i;
+
+  const int count = qBound(1, qRound(fraction * wcCount), wcCount);
+  for (int i = 0; i < count; i++)
+  {
+    std::uniform_int_distribution<int> distribution(i, wcCount - 1);
+    std::swap(candidateList[i], candidateList[distribution(generator)]);
+  }
+
+  candidateList.resize(count);
+  std::sort(candidateList.begin(), candidateList.end());
+  return candidateList;
+}
+
+// Weight trimming: the lightest samples holding together at most the given fraction of the
+// total weight are left out of the search. Nothing is trimmed if a class would lose all samples
+static void trimSamples(const QVector<double> &weightList, int posCount, int negCount, 
+  double trimming, WcSearchSubset *subset)
+{
+  Q_ASSERT(subset != 0);
+
+  const int sampleCount = posCount + negCount;
+  QVector< QPair<double, int> > order(sampleCount);
+  double totalWeight = 0.0;
+  for (int i = 0; i < sampleCount; i++)
+  {
+    order[i] = qMakePair(weightList[i], i);
+    totalWeight += weightList[i];
+  }
+
+  std::sort(order.begin(), order.end());
+
+  double trimmedWeight = 0.0;
+  int trimmedCount = 0;
+  while (trimmedCount < sampleCount && trimmedWeight + order[trimmedCount].first <= trimming * totalWeight)
+    trimmedWeight += order[trimmedCount++].first;
+
+  if (trimmedCount == 0)
+    return;
+
+  QVector<bool> keepList(sampleCount, true);
+  for (int i = 0; i < trimmedCount; i++)
+    keepList[order[i].second] = false;
+
+  subset->columnList.clear();
+  subset->weightList.clear();
+  subset->positiveCount = 0;
+
+  for (int i = 0; i < sampleCount; i++)
+  {
+    if (keepList[i] == false)
+      continue;
+
+    subset->columnList.append(i);
+    subset->weightList.append(weightList[i]);
+    subset->positiveCount += i < posCount;
+  }
+
+  if (subset->positiveCount == 0 || subset->positiveCount == subset->columnList.count())
+  {
+    subset->columnList.clear();
+    subset->weightList.clear();
+    subset->positiveCount = 0;
+  }
+}
+
+QSharedPointer<objed::Classifier> TrainScProcessor::realAdaBoost(const FeatureMatrix &featureMatrix, 
+  SampleList &positiveSamples, SampleList &negativeSamples, const QString &progressLabel)
+{
+  Q_ASSERT(wcList.count() > 0);
+  Q_ASSERT(positiveSamples.count() > 0);
+  Q_ASSERT(negativeSamples.count() > 0);
+
+  if (wcList.isEmpty() == true)
+    throw ObjedException("No weak classifier");
+  if (positiveSamples.isEmpty() == true || negativeSamples.isEmpty() == true)
+    throw ObjedException("No positive or negative samples");
+  if (featureMatrix.candidateCount() != wcList.count() || 
+      featureMatrix.positiveCount() != positiveSamples.count() ||
+      featureMatrix.negativeCount() != negativeSamples.count())
+    throw ObjedException("Feature matrix does not match training samples");
+
+  // Weights are laid out in the same order as feature matrix rows
+  const int posCount = positiveSamples.count(), negCount = negativeSamples.count();
+  QVector<double> weightList(featureMatrix.rowStride(), 0.0);
+  for (int i = 0; i < posCount; i++)
+    weightList[i] = positiveSamples[i]->weight;
+  for (int i = 0; i < negCount; i++)
+    weightList[posCount + i] = negativeSamples[i]->weight;
+
+  WcSearchSubset subset;
+  if (wcSubsampleFraction < 1.0)
+    subset.candidateList = subsampleCandidates(wcList.count(), wcSubsampleFraction, wcSubsampleSeed, boostingIteration);
+  if (weightTrimming > 0.0)
+    trimSamples(weightList, posCount, negCount, weightTrimming, &subset);
+  if (costModel.isEnabled() == true)
+  {
+    // Penalized criterion: z + CostPenalty * (type cost + cost of a channel not computed yet)
+    subset.penaltyList.resize(wcList.count());
+    for (int i = 0; i < wcList.count(); i++)
     {
-      bestWc = wcList[i].data();
-      bestZ = zList[i];
+      double cost = wcCostList[i] + (stageChannelList.contains(wcChannelList[i]) ? 0.0 : costModel.channelCost());
+      subset.penaltyList[i] = costModel.penalty() * cost;
     }
   }
+  const bool approximate = subset.candidateList.isEmpty() == false || subset.columnList.isEmpty() == false;
+
+  double bestZ = 1.0 + objed::epsilon;
+  int bestIndex = -1;
 
-  if (bestZ > 1.0 || bestWc == 0)
+  if (shardedSearch.isNull() == false)
+  {
+    // Workers get trimmed samples with zero weight, which gives the same histograms
+    QVector<double> searchWeightList = weightList;
+    if (subset.columnList.isEmpty() == false)
+    {
+      searchWeightList.fill(0.0);
+      for (int i = 0; i < subset.columnList.count(); i++)
+        searchWeightList[subset.columnList[i]] = subset.weightList[i];
+    }
+
+    ObjedConsole::printProgress(progressLabel, 0);
+    bestIndex = shardedSearch->search(searchWeightList.constData(), searchWeightList.count(), &bestZ, 
+      subset.penaltyList.isEmpty() ? 0 : subset.penaltyList.constData());
+
+    // Workers only report the winner, its parameters are trained here on the same data
+    if (bestIndex >= 0)
+      bestZ = trainWc(wcList[bestIndex].data(), featureMatrix, bestIndex, weightList.constData(), &subset);
+  }
+  else
+  {
+    bestIndex = searchBestWc(wcList, featureMatrix, weightList.constData(), &bestZ, progressLabel, &subset);
+  }
+
+  if (bestZ > 1.0 || bestIndex < 0)
     throw ObjedException("Cannot train next weak classifier (bestZ > 1.0 || bestWc == 0)");
 
   ObjedConsole::printProgress(progressLabel, 100);
-  return QSharedPointer<objed::Classifier>(bestWc->clone(), objed::Classifier::destroy);
+  QSharedPointer<objed::Classifier> bestWc(wcList[bestIndex]->clone(), objed::Classifier::destroy);
+
+  // Compares the approximate choice with the exact search over all candidates and samples
+  boostingIteration++;
+  if (approximate == true && searchReportPeriod > 0 && boostingIteration % searchReportPeriod == 0)
+  {
+    QSharedPointer<objed::Classifier> probeWc(wcList[bestIndex]->clone(), objed::Classifier::destroy);
+    double selectedZ = trainWc(probeWc.data(), featureMatrix, bestIndex, weightList.constData());
+
+    double optimalZ = 1.0 + objed::epsilon;
+    int optimalIndex = shardedSearch.isNull() == false ? 
+      shardedSearch->search(weightList.constData(), weightList.count(), &optimalZ) :
+      searchBestWc(wcList, featureMatrix, weightList.constData(), &optimalZ);
+
+    const int searchedWcCount = subset.candidateList.isEmpty() ? wcList.count() : subset.candidateList.count();
+    const int searchedSampleCount = subset.columnList.isEmpty() ? posCount + negCount : subset.columnList.count();
+    ObjedConsole::printInfo(QString("Iteration %0: selected Wc%1 z = %2, full pool optimum Wc%3 z = %4 "
+      "(%5 of %6 candidates, %7 of %8 samples)").arg(boostingIteration).arg(bestIndex).arg(selectedZ).
+      arg(optimalIndex).arg(optimalZ).arg(searchedWcCount).arg(wcList.count()).
+      arg(searchedSampleCount).arg(posCount + negCount));
+  }
+
+  return bestWc;
 }
 
-void TrainScProcessor::trainScRealAdaBoost(objed::Classifier *&classifier, SampleList &positiveSamples, SampleList &negativeSamples)
+void TrainScProcessor::trainScRealAdaBoost(objed::Classifier *&classifier, const FeatureMatrix &featureMatrix, 
+  SampleList &positiveSamples, SampleList &negativeSamples)
 {
   if (classifier == 0)
     classifier = new objed::AdditiveClassifier(classifierWidth, classifierHeight);
@@ -227,13 +406,18 @@ void TrainScProcessor::trainScRealAdaBoost(objed::Classifier *&classifier, Sampl
   objed::AdditiveClassifier *sc = dynamic_cast<objed::AdditiveClassifier *>(classifier);
   Q_ASSERT(sc != 0);
 
-  setSampleWeights(positiveSamples, negativeSamples, sc);
-  QSharedPointer<objed::Classifier> bestWc = realAdaBoost(wcList, positiveSamples, negativeSamples, 
+  setSampleWeights(positiveSamples, negativeSamples, 0);
+  QSharedPointer<objed::Classifier> bestWc = realAdaBoost(featureMatrix, positiveSamples, negativeSamples, 
     QString("Training strong classifier iteration %0").arg(sc->clList.size() + 1));
   sc->clList.push_back(bestWc->clone());
+  stageChannelList += classifierPreprocs(bestWc.data());
+
+  updateSampleScores(positiveSamples, 0, bestWc.data());
+  updateSampleScores(negativeSamples, 0, bestWc.data());
 }
 
-void TrainScProcessor::trainScRealAdaBoostMax(objed::Classifier *&classifier, SampleList &positiveSamples, SampleList &negativeSamples)
+void TrainScProcessor::trainScRealAdaBoostMax(objed::Classifier *&classifier, const FeatureMatrix &featureMatrix, 
+  SampleList &positiveSamples, SampleList &negativeSamples)
 {
   if (classifier == 0)
   {
@@ -246,7 +430,6 @@ void TrainScProcessor::trainScRealAdaBoostMax(objed::Classifier *&classifier, Sa
   objed::MaxClassifier *maxSc = dynamic_cast<objed::MaxClassifier *>(classifier);
   Q_ASSERT(maxSc != 0);
 
-  const int x = maxSc->width() / 2, y = maxSc->height() / 2;
   const int scCount = maxSc->clList.size();
 
   for (int iSc = 0; iSc < scCount; iSc++)
@@ -257,17 +440,11 @@ void TrainScProcessor::trainScRealAdaBoostMax(objed::Classifier *&classifier, Sa
     objed::AdditiveClassifier *sc = dynamic_cast<objed::AdditiveClassifier *>(maxSc->clList[iSc]);
     Q_ASSERT(sc != 0);
 
+    // Positives are assigned to the strong classifiers giving them the maximum score
     SampleList currPositiveSamples;
     foreach (QSharedPointer<Sample> posSample, positiveSamples)
     {
-      float maxResult = 0.0f;
-      maxSc->prepare(posSample->imagePool);
-      maxSc->evaluate(&maxResult, x, y, 0);
-
-      float result = 0.0f;
-      sc->evaluate(&result, x, y, 0);
-
-      if (result >= maxResult)
+      if (posSample->scoreList[iSc] >= posSample->score)
         currPositiveSamples.append(posSample);
     }
 
@@ -277,10 +454,14 @@ void TrainScProcessor::trainScRealAdaBoostMax(objed::Classifier *&classifier, Sa
       continue;
     }
 
-    setSampleWeights(currPositiveSamples, negativeSamples, sc);
-    QSharedPointer<objed::Classifier> bestWc = realAdaBoost(wcList, positiveSamples, negativeSamples, 
+    setSampleWeights(currPositiveSamples, negativeSamples, iSc);
+    QSharedPointer<objed::Classifier> bestWc = realAdaBoost(featureMatrix, positiveSamples, negativeSamples, 
       QString("Training strong classifier iteration %0-%1").arg(iSc + 1).arg(sc->clList.size() + 1));
     sc->clList.push_back(bestWc->clone());
+    stageChannelList += classifierPreprocs(bestWc.data());
+
+    updateSampleScores(positiveSamples, iSc, bestWc.data());
+    updateSampleScores(negativeSamples, iSc, bestWc.data());
   }
 
 }
\ No newline at end of file
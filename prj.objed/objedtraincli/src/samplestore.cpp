@@ -0,0 +1,314 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <QMutexLocker>
+#include <QFile>
+
+#include <objedutils/objedopenmp.h>
+#include <objedutils/objedexp.h>
+
+#include <objed/src/imgutils.h>
+
+#include <opencv/cv.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "samplestore.h"
+
+// Samples are allocated in chunks, so tiles never move while the store grows
+static const int CHUNK_SAMPLE_COUNT = 1024;
+
+SampleStore::SampleStore(int width, int height, const QStringList &channelList) :
+storeWidth(width), storeHeight(height), tileSize(0), sampleSize(0), sampleCount(0), mappedFile(0), mappedData(0)
+{
+  Q_ASSERT(width > 0 && height > 0);
+  for (int i = 0; i < channelList.count(); i++)
+    this->channelList.push_back(channelList[i].toStdString());
+
+  tileSize = storeWidth * storeHeight;
+  sampleSize = tileSize * static_cast<int>(this->channelList.size());
+  createScratchIntegrals();
+}
+
+SampleStore::SampleStore(int width, int height, const QStringList &channelList, 
+  QFile *mappedFile, const uchar *mappedData, int count) :
+storeWidth(width), storeHeight(height), tileSize(0), sampleSize(0), sampleCount(count), 
+mappedFile(mappedFile), mappedData(mappedData)
+{
+  Q_ASSERT(width > 0 && height > 0);
+  Q_ASSERT(mappedFile != 0 && mappedData != 0 && count >= 0);
+  for (int i = 0; i < channelList.count(); i++)
+    this->channelList.push_back(channelList[i].toStdString());
+
+  tileSize = storeWidth * storeHeight;
+  sampleSize = tileSize * static_cast<int>(this->channelList.size());
+  createScratchIntegrals();
+}
+
+SampleStore::~SampleStore()
+{
+  for (int i = 0; i < chunkList.count(); i++)
+    delete[] chunkList[i];
+
+  for (size_t i = 0; i < scratchIntegralList.size(); i++)
+    cvReleaseImage(&scratchIntegralList[i]);
+
+  if (mappedFile != 0)
+  {
+    mappedFile->unmap(const_cast<uchar *>(mappedData));
+    delete mappedFile;
+  }
+}
+
+void SampleStore::createScratchIntegrals()
+{
+  scratchIntegralList.resize(ObjedOpenMP::maxThreadCount() * channelList.size());
+  for (size_t i = 0; i < scratchIntegralList.size(); i++)
+    scratchIntegralList[i] = cvCreateImage(cvSize(storeWidth + 1, storeHeight + 1), IPL_DEPTH_32S, 1);
+  scratchIndexList.resize(scratchIntegralList.size(), -1);
+}
+
+uchar * SampleStore::allocate()
+{
+  if (mappedFile != 0)
+    throw ObjedException("Cannot append samples to a mapped sample store");
+
+  if (sampleCount == chunkList.count() * CHUNK_SAMPLE_COUNT)
+    chunkList.append(new uchar[static_cast<size_t>(sampleSize) * CHUNK_SAMPLE_COUNT]);
+
+  uchar *sample = chunkList.last() + static_cast<size_t>(sampleCount % CHUNK_SAMPLE_COUNT) * sampleSize;
+  sampleCount++;
+  return sample;
+}
+
+// Channels are computed (the pool is lazy) before the store is locked
+std::vector<const IplImage *> SampleStore::channelImages(objed::ImagePool *imagePool) const
+{
+  Q_ASSERT(imagePool != 0);
+
+  std::vector<const IplImage *> images(channelList.size());
+  for (size_t i = 0; i < channelList.size(); i++)
+  {
+    images[i] = imagePool->image(channelList[i]);
+    if (images[i] == 0)
+      throw ObjedException(QString("Cannot compute '%0' image for sample").arg(channelList[i].c_str()));
+    if (images[i]->depth != IPL_DEPTH_8U || images[i]->nChannels != 1)
+      throw ObjedException(QString("Unsupported '%0' image format for sample").arg(channelList[i].c_str()));
+    if (images[i]->width != storeWidth || images[i]->height != storeHeight)
+      throw ObjedException(QString("Invalid '%0' image size for sample").arg(channelList[i].c_str()));
+  }
+
+  return images;
+}
+
+void SampleStore::copyChannels(uchar *sample, const std::vector<const IplImage *> &images)
+{
+  for (size_t i = 0; i < images.size(); i++)
+  {
+    uchar *tile = sample + i * tileSize;
+    for (int j = 0; j < storeHeight; j++)
+      std::memcpy(tile + j * storeWidth, images[i]->imageData + j * images[i]->widthStep, storeWidth);
+  }
+}
+
+int SampleStore::append(objed::ImagePool *imagePool)
+{
+  std::vector<const IplImage *> images = channelImages(imagePool);
+
+  QMutexLocker locker(&mutex);
+  copyChannels(allocate(), images);
+  return sampleCount - 1;
+}
+
+void SampleStore::replace(int index, objed::ImagePool *imagePool)
+{
+  std::vector<const IplImage *> images = channelImages(imagePool);
+
+  QMutexLocker locker(&mutex);
+  if (mappedFile != 0)
+    throw ObjedException("Cannot replace samples of a mapped sample store");
+  Q_ASSERT(index >= 0 && index < sampleCount);
+
+  uchar *sample = chunkList[index / CHUNK_SAMPLE_COUNT] + 
+    static_cast<size_t>(index % CHUNK_SAMPLE_COUNT) * sampleSize;
+  copyChannels(sample, images);
+
+  // Scratch integrals computed from the previous contents are stale
+  for (size_t i = 0; i < scratchIndexList.size(); i++)
+  {
+    if (scratchIndexList[i] == index)
+      scratchIndexList[i] = -1;
+  }
+}
+
+int SampleStore::append(const SampleStore *store, int index)
+{
+  Q_ASSERT(store != 0 && store != this);
+  Q_ASSERT(store->storeWidth == storeWidth && store->storeHeight == storeHeight);
+  Q_ASSERT(store->channelList == channelList);
+
+  QMutexLocker locker(&mutex);
+  uchar *sample = allocate();
+  std::memcpy(sample, store->tile(index, 0), sampleSize);
+  return sampleCount - 1;
+}
+
+int SampleStore::count() const
+{
+  QMutexLocker locker(&mutex);
+  return sampleCount;
+}
+
+int SampleStore::width() const
+{
+  return storeWidth;
+}
+
+int SampleStore::height() const
+{
+  return storeHeight;
+}
+
+int SampleStore::channelIndex(const std::string &id) const
+{
+  std::vector<std::string>::const_iterator it = std::find(channelList.begin(), channelList.end(), id);
+  return it == channelList.end() ? -1 : static_cast<int>(it - channelList.begin());
+}
+
+const std::vector<std::string> & SampleStore::channelNames() const
+{
+  return channelList;
+}
+
+const uchar * SampleStore::tile(int index, int channel) const
+{
+  Q_ASSERT(index >= 0 && index < sampleCount);
+  Q_ASSERT(channel >= 0 && channel < static_cast<int>(channelList.size()));
+
+  if (mappedData != 0)
+    return mappedData + static_cast<size_t>(index) * sampleSize + channel * tileSize;
+
+  const uchar *sample = chunkList[index / CHUNK_SAMPLE_COUNT] + 
+    static_cast<size_t>(index % CHUNK_SAMPLE_COUNT) * sampleSize;
+  return sample + channel * tileSize;
+}
+
+qint64 SampleStore::memoryUsage() const
+{
+  QMutexLocker locker(&mutex);
+  return static_cast<qint64>(chunkList.count()) * CHUNK_SAMPLE_COUNT * sampleSize;
+}
+
+void SampleStore::computeIntegral(int index, int channel, IplImage *integral) const
+{
+  Q_ASSERT(integral != 0 && integral->depth == IPL_DEPTH_32S);
+  Q_ASSERT(integral->width == storeWidth + 1 && integral->height == storeHeight + 1);
+
+  IplImage image;
+  cvInitImageHeader(&image, cvSize(storeWidth, storeHeight), IPL_DEPTH_8U, 1);
+  image.imageData = image.imageDataOrigin = reinterpret_cast<char *>(const_cast<uchar *>(tile(index, channel)));
+  image.widthStep = storeWidth;
+  objed::PrepareIntegralImage(integral, &image);
+}
+
+IplImage * SampleStore::integral(int index, int channel) const
+{
+  Q_ASSERT(ObjedOpenMP::threadId() < ObjedOpenMP::maxThreadCount());
+  const size_t scratch = ObjedOpenMP::threadId() * channelList.size() + channel;
+
+  // Classifiers prepare and evaluate one sample at a time, so each thread
+  // recomputes an integral only when it moves on to the next sample
+  if (scratchIndexList[scratch] != index)
+  {
+    computeIntegral(index, channel, scratchIntegralList[scratch]);
+    scratchIndexList[scratch] = index;
+  }
+
+  return scratchIntegralList[scratch];
+}
+
+SampleImagePool::SampleImagePool() : store(0), index(-1)
+{
+  return;
+}
+
+SampleImagePool::~SampleImagePool()
+{
+  return;
+}
+
+void SampleImagePool::bind(const SampleStore *store, int index)
+{
+  this->store = store;
+  this->index = index;
+}
+
+bool SampleImagePool::update(IplImage *image)
+{
+  // Samples are immutable views into their store
+  Q_UNUSED(image);
+  Q_ASSERT(false);
+  return false;
+}
+
+IplImage * SampleImagePool::integral(const std::string &id)
+{
+  if (store == 0)
+    return 0;
+
+  int channel = store->channelIndex(id);
+  if (channel < 0)
+    return 0;
+
+  return store->integral(index, channel);
+}
+
+IplImage * SampleImagePool::image(const std::string &id)
+{
+  Q_UNUSED(id);
+  return 0;
+}
+
+IplImage * SampleImagePool::base()
+{
+  return 0;
+}
+
+std::vector<std::string> SampleImagePool::imageNames() const
+{
+  return std::vector<std::string>();
+}
+
+std::vector<std::string> SampleImagePool::integralNames() const
+{
+  return store != 0 ? store->channelNames() : std::vector<std::string>();
+}
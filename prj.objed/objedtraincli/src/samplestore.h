@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef SAMPLESTORE_H_INCLUDED
+#define SAMPLESTORE_H_INCLUDED
+
+#include <QStringList>
+#include <QVector>
+#include <QMutex>
+
+#include <objed/objed.h>
+
+class QFile;
+
+#include <string>
+#include <vector>
+
+// Training samples packed into one arena: every sample is a fixed-size window of
+// width x height 8-bit values per channel, i.e. the channel images of an image pool
+// updated with the window alone. Integrals are not stored, they are computed on access
+class SampleStore
+{
+  Q_DISABLE_COPY(SampleStore)
+
+public:
+  SampleStore(int width, int height, const QStringList &channelList);
+  // Read-only store over count samples laid out back to back in memory mapped from
+  // mappedFile (see TrainingCheckpoint), the store takes ownership of the file
+  SampleStore(int width, int height, const QStringList &channelList, 
+    QFile *mappedFile, const uchar *mappedData, int count);
+  virtual ~SampleStore();
+
+public:
+  // Both methods are thread-safe and return the index of the new sample,
+  // the base image of imagePool must be of the store size
+  int append(objed::ImagePool *imagePool);
+  int append(const SampleStore *store, int index);
+  // Overwrites the sample at index, which must not be read by other threads meanwhile
+  void replace(int index, objed::ImagePool *imagePool);
+
+public:
+  int count() const;
+  int width() const;
+  int height() const;
+  int channelIndex(const std::string &id) const;
+  const std::vector<std::string> & channelNames() const;
+  const uchar * tile(int index, int channel) const;
+  qint64 memoryUsage() const;
+
+public:
+  // Computes the channel integral of the sample into a (width + 1) x (height + 1) image
+  void computeIntegral(int index, int channel, IplImage *integral) const;
+  // Channel integral of the sample in a buffer of the calling thread, it stays valid
+  // until the thread requests the same channel of another sample of the store
+  IplImage * integral(int index, int channel) const;
+
+private:
+  void createScratchIntegrals();
+  uchar * allocate();
+  std::vector<const IplImage *> channelImages(objed::ImagePool *imagePool) const;
+  void copyChannels(uchar *sample, const std::vector<const IplImage *> &images);
+
+private:
+  int storeWidth, storeHeight;
+  std::vector<std::string> channelList;
+  int tileSize, sampleSize;
+
+  QVector<uchar *> chunkList;
+  int sampleCount;
+
+  QFile *mappedFile;
+  const uchar *mappedData;
+  mutable QMutex mutex;
+
+  // One integral per thread and channel along with the index of the sample it holds
+  std::vector<IplImage *> scratchIntegralList;
+  mutable std::vector<int> scratchIndexList;
+};
+
+// Read-only image pool over one sample of a store, provides channel integrals only.
+// Integrals are the per-thread buffers of the store (see SampleStore::integral), so
+// a classifier prepared on the pool reads this sample only until the same thread
+// requests an integral of another sample: prepare and evaluate one sample at a time
+class SampleImagePool : public objed::ImagePool
+{
+public:
+  SampleImagePool();
+  virtual ~SampleImagePool();
+
+public:
+  void bind(const SampleStore *store, int index);
+
+public:
+  virtual bool update(IplImage *image);
+  virtual IplImage * integral(const std::string &id);
+  virtual IplImage * image(const std::string &id);
+  virtual IplImage * base();
+
+  virtual std::vector<std::string> imageNames() const;
+  virtual std::vector<std::string> integralNames() const;
+
+private:
+  const SampleStore *store;
+  int index;
+};
+
+#endif  // SAMPLESTORE_H_INCLUDED
@@ -42,30 +42,27 @@ either expressed or implied, of copyright holders.
 #include <objed/src/linearcl.h>
 #include <objed/src/maxcl.h>
 
+#include <algorithm>
+#include <limits>
+
+#include "featurematrix.h"
+#include "checkpoint.h"
 #include "trainscproc.h"
+#include "wcsearch.h"
 
-static int calculateDetectionCount(objed::Classifier *classifier, SampleList &sampleList)
+static int calculateDetectionCount(const SampleList &sampleList)
 {
-  if (classifier == 0)
-    return 0;
-
-  long long count = 0;
-  int clWd = classifier->width();
-  int clHt = classifier->height();
-
+  int count = 0;
   for (int i = 0; i < sampleList.count(); i++)
-  {
-    float result = objed::epsilon;
-    classifier->prepare(sampleList[i]->imagePool);
-    classifier->evaluate(&result, clWd / 2, clHt / 2);
-    count += result > 0.0;
-  }
+    count += sampleList[i]->score > 0.0;
 
   return count;
 }
 
 TrainScProcessor::TrainScProcessor(ObjedConfig *config) :
-classifierWidth(0), classifierHeight(0), falseNegativeRate(0.0), falsePositiveRate(0.0), wcCountThreshold(0), weightShift(0.5)
+classifierWidth(0), classifierHeight(0), falseNegativeRate(0.0), falsePositiveRate(0.0), wcCountThreshold(0), weightShift(0.5),
+featureMatrixMemoryLimit(0), weightTrimming(0.0), wcSubsampleFraction(1.0), wcSubsampleSeed(0), searchReportPeriod(0), 
+boostingIteration(0), costModel(config)
 {
   classifierWidth = config->value("ClassifierWidth").toInt();
   classifierHeight = config->value("ClassifierHeight").toInt();
@@ -86,6 +83,22 @@ classifierWidth(0), classifierHeight(0), falseNegativeRate(0.0), falsePositiveRa
   if (weightShift <= 0 || weightShift >= 1.0)
     throw ObjedException("Invalid WeightShift value");
 
+  featureMatrixMemoryLimit = config->value("FeatureMatrixMemoryLimit").toLongLong() * 1024 * 1024;
+  if (featureMatrixMemoryLimit < 0)
+    throw ObjedException("Invalid FeatureMatrixMemoryLimit value");
+  featureMatrixPath = config->value("FeatureMatrixPath").toString();
+
+  weightTrimming = config->value("WeightTrimming").toDouble();
+  if (weightTrimming < 0.0 || weightTrimming >= 1.0)
+    throw ObjedException("Invalid WeightTrimming value");
+  wcSubsampleFraction = config->value("WcSubsampleFraction").toDouble();
+  if (wcSubsampleFraction <= 0.0 || wcSubsampleFraction > 1.0)
+    throw ObjedException("Invalid WcSubsampleFraction value");
+  wcSubsampleSeed = config->value("WcSubsampleSeed").toUInt();
+  searchReportPeriod = config->value("SearchReportPeriod").toInt();
+  if (searchReportPeriod < 0)
+    throw ObjedException("Invalid SearchReportPeriod value");
+
   method = config->value("Method").toString();
   methodParams = config->value("MethodParams").toString();
 
@@ -98,6 +111,30 @@ classifierWidth(0), classifierHeight(0), falseNegativeRate(0.0), falsePositiveRa
 
   if (wcList.isEmpty() == true) 
     throw ObjedException("There are no weak classifiers");
+
+  for (int i = 0; i < wcList.count(); i++)
+  {
+    wcCostList.append(costModel.wcCost(wcList[i].data()));
+    wcChannelList.append(classifierPreprocs(wcList[i].data()).value(0));
+  }
+
+  int workerCount = config->value("WorkerCount").toInt();
+  if (workerCount < 0)
+    throw ObjedException("Invalid WorkerCount value");
+  int workerThreadCount = config->value("WorkerThreadCount").toInt();
+  if (workerThreadCount < 0)
+    throw ObjedException("Invalid WorkerThreadCount value");
+  if (workerCount > 0 && wcSubsampleFraction < 1.0)
+    throw ObjedException("WcSubsampleFraction cannot be used with worker processes");
+  if (workerCount > 0)
+  {
+    QStringList wcLineStringList;
+    for (int i = 0; i < wcLineList.count(); i++)
+      wcLineStringList.append(wcLineList[i].toString());
+
+    shardedSearch.reset(new ShardedWcSearch(workerCount, workerThreadCount, wcLineStringList, 
+      QSize(classifierWidth, classifierHeight), wcList.count()));
+  }
 }
 
 TrainScProcessor::~TrainScProcessor()
@@ -105,45 +142,50 @@ TrainScProcessor::~TrainScProcessor()
   return;
 }
 
-QSharedPointer<objed::Classifier> TrainScProcessor::trainSc(SampleList &positiveSamples, SampleList &negativeSamples)
+void TrainScProcessor::setPrecedingClassifier(const objed::Classifier *classifier)
 {
-  for (int i = 0; i < wcList.count(); i++)
-  {
-    if (i % 100 == 0)
-    {
-      int progress = 100 * i / wcList.count();
-      ObjedConsole::printProgress("Preparing weak classifiers for training", progress);
-    }
+  precedingChannelList = classifierPreprocs(classifier);
+}
 
-    for (int j = 0; j < positiveSamples.count(); j++)
-      wcList[i]->prepare(positiveSamples[j]->imagePool);
-    for (int j = 0; j < negativeSamples.count(); j++)
-      wcList[i]->prepare(negativeSamples[j]->imagePool);
-  }
+QSharedPointer<objed::Classifier> TrainScProcessor::trainSc(SampleList &positiveSamples, SampleList &negativeSamples, 
+  TrainingCheckpoint *checkpoint)
+{
+  FeatureMatrix featureMatrix;
+  featureMatrix.compute(wcList, positiveSamples, negativeSamples, 
+    featureMatrixMemoryLimit, featureMatrixPath);
+  if (shardedSearch.isNull() == false)
+    shardedSearch->load(featureMatrix);
 
-  ObjedConsole::printProgress("Weak classifiers have been prepared", 100);
+  const int scCount = method.toLower() == "realadaboostmax" ? qMax(1, methodParams.toInt()) : 1;
+  resetSampleScores(positiveSamples, scCount);
+  resetSampleScores(negativeSamples, scCount);
 
   objed::Classifier *classifier = 0;
   int iterationCount = 0;
+  if (checkpoint != 0)
+    checkpoint->loadBoosting(&classifier, &iterationCount, &boostingIteration, positiveSamples, negativeSamples);
+
+  stageChannelList = precedingChannelList + classifierPreprocs(classifier);
   
   while (true)
   {
     if (method.toLower() == "realadaboost")
-      trainScRealAdaBoost(classifier, positiveSamples, negativeSamples);
+      trainScRealAdaBoost(classifier, featureMatrix, positiveSamples, negativeSamples);
     else if (method.toLower() == "realadaboostmax")
-      trainScRealAdaBoostMax(classifier, positiveSamples, negativeSamples);
+      trainScRealAdaBoostMax(classifier, featureMatrix, positiveSamples, negativeSamples);
     else
       throw ObjedException("Unknown training method");
     
-    int currFalsePositiveCount = calculateDetectionCount(classifier, negativeSamples);
-    int currFalseNegativeCount = positiveSamples.count() - calculateDetectionCount(classifier, positiveSamples);
+    int currFalsePositiveCount = calculateDetectionCount(negativeSamples);
+    int currFalseNegativeCount = positiveSamples.count() - calculateDetectionCount(positiveSamples);
     double currFalsePositiveRate = static_cast<double>(currFalsePositiveCount) / negativeSamples.count();
     double currFalseNegativeRate = static_cast<double>(currFalseNegativeCount) / positiveSamples.count();
 
     ObjedConsole::printInfo(QString("Current strong classifier quality: %0/%1").
       arg(currFalseNegativeRate, 0, 'f').arg(currFalsePositiveRate, 0, 'f'));
 
-    bool countCriterion = wcCountThreshold > 0 && (++iterationCount) >= wcCountThreshold;
+    iterationCount++;
+    bool countCriterion = wcCountThreshold > 0 && iterationCount >= wcCountThreshold;
     bool rateCriterion = (currFalseNegativeRate <= (falseNegativeRate + std::numeric_limits<double>::epsilon())) &&
                          (currFalsePositiveRate <= (falsePositiveRate + std::numeric_limits<double>::epsilon()));
     bool totalCriterion = countCriterion || rateCriterion;
@@ -154,12 +196,33 @@ QSharedPointer<objed::Classifier> TrainScProcessor::trainSc(SampleList &positive
       totalCriterion = rateCriterion;
 
     if (totalCriterion == true)
+    {
+      printStageCost(classifier, currFalsePositiveRate);
       break;
+    }
+
+    // The last iteration is not saved, a finished strong classifier goes to the cascade
+    if (checkpoint != 0 && checkpoint->isBoostingDue(iterationCount) == true)
+      checkpoint->saveBoosting(classifier, iterationCount, boostingIteration, positiveSamples, negativeSamples);
   }
 
   return QSharedPointer<objed::Classifier>(classifier, objed::Classifier::destroy);
 }
 
+// Every window reaching the stage evaluates all its weak classifiers, and the stage passes
+// falsePositiveRate of the negative windows on to the following stages
+void TrainScProcessor::printStageCost(const objed::Classifier *classifier, double falsePositiveRate)
+{
+  double wcCost = 0.0;
+  QStringList newChannelList;
+  double cost = costModel.classifierCost(classifier, precedingChannelList, &wcCost, &newChannelList);
+
+  QString channels = newChannelList.isEmpty() ? QString("no new channels") : 
+    QString("new channels %0").arg(newChannelList.join(", "));
+  ObjedConsole::printInfo(QString("Expected stage cost: %0 per window (%1 in weak classifiers, %2), "
+    "%3 of negative windows go further").arg(cost).arg(wcCost).arg(channels).arg(falsePositiveRate, 0, 'f'));
+}
+
 void TrainScProcessor::resetSampleWeights(SampleList &positiveSamples, SampleList &negativeSamples)
 {
   foreach (QSharedPointer<Sample> sample, positiveSamples)
@@ -184,32 +247,54 @@ void TrainScProcessor::normalizeSampleWeights(SampleList &positiveSamples, Sampl
     negativeSamples[i]->weight /= weightSum;
 }
 
-void TrainScProcessor::setSampleWeights(SampleList &positiveSamples, SampleList &negativeSamples, objed::Classifier *classifier)
+void TrainScProcessor::setSampleWeights(SampleList &positiveSamples, SampleList &negativeSamples, int scIndex)
 {
   resetSampleWeights(positiveSamples, negativeSamples);
-  if (classifier == 0)
-    return;
-
-  const int x = classifier->width() / 2;
-  const int y = classifier->height() / 2;
 
   for (int i = 0; i < positiveSamples.count(); i++)
+    positiveSamples[i]->weight *= std::exp(-positiveSamples[i]->scoreList[scIndex]);
+
+  for (int i = 0; i < negativeSamples.count(); i++)
+    negativeSamples[i]->weight *= std::exp(negativeSamples[i]->scoreList[scIndex]);
+
+  normalizeSampleWeights(positiveSamples, negativeSamples);
+}
+
+void TrainScProcessor::resetSampleScores(SampleList &samples, int scCount)
+{
+  for (int i = 0; i < samples.count(); i++)
   {
-    float result = 0.0f;
-    classifier->prepare(positiveSamples[i]->imagePool);
-    classifier->evaluate(&result, x, y);
-    positiveSamples[i]->weight *= std::exp(-result);
+    samples[i]->scoreList.assign(scCount, 0.0f);
+    samples[i]->score = 0.0f;
   }
+}
 
-  for (int i = 0; i < negativeSamples.count(); i++)
+// Adds the result of the weak classifier just appended to strong classifier scIndex,
+// accumulating in the same order as AdditiveClassifier and MaxClassifier evaluate
+void TrainScProcessor::updateSampleScores(SampleList &samples, int scIndex, objed::Classifier *wc)
+{
+  const int x = wc->width() / 2, y = wc->height() / 2;
+
+  for (int i = 0; i < samples.count(); i++)
   {
+    Sample *sample = samples[i].data();
+
     float result = 0.0f;
-    classifier->prepare(negativeSamples[i]->imagePool);
-    classifier->evaluate(&result, x, y);
-    negativeSamples[i]->weight *= std::exp(result);
-  }
+    wc->prepare(sample->imagePool);
+    wc->evaluate(&result, x, y);
+    sample->scoreList[scIndex] += result;
 
-  normalizeSampleWeights(positiveSamples, negativeSamples);
+    if (sample->scoreList.size() == 1)
+    {
+      sample->score = sample->scoreList[0];
+    }
+    else
+    {
+      sample->score = -std::numeric_limits<float>::max();
+      for (size_t j = 0; j < sample->scoreList.size(); j++)
+        sample->score = std::max(sample->score, sample->scoreList[j]);
+    }
+  }
 }
 
 float TrainScProcessor::calculateError(SampleList &positiveSamples, SampleList &negativeSamples, objed::Classifier *classifier)
@@ -34,7 +34,11 @@ either expressed or implied, of copyright holders.
 #define TRAINSCPROC_H_INCLUDED
 
 #include "objedtrainutils.h"
+#include "wccost.h"
 
+class TrainingCheckpoint;
+class ShardedWcSearch;
+class FeatureMatrix;
 class ObjedConfig;
 
 class TrainScProcessor
@@ -46,19 +50,30 @@ public:
   virtual ~TrainScProcessor();
 
 public:
-  QSharedPointer<objed::Classifier> trainSc(
-    SampleList &positiveSamples, SampleList &negativeSamples);
+  // Channels of the preceding stages are not charged by the cost model
+  void setPrecedingClassifier(const objed::Classifier *classifier);
+
+  // Boosting resumes from the checkpoint and saves its state there if it is given
+  QSharedPointer<objed::Classifier> trainSc(SampleList &positiveSamples, 
+    SampleList &negativeSamples, TrainingCheckpoint *checkpoint = 0);
 
 private:
   void resetSampleWeights(SampleList &positiveSamples, SampleList &negativeSamples);
   void normalizeSampleWeights(SampleList &positiveSamples, SampleList &negativeSamples);
-  void setSampleWeights(SampleList &positiveSamples, SampleList &negativeSamples, objed::Classifier *classifier);
+  void setSampleWeights(SampleList &positiveSamples, SampleList &negativeSamples, int scIndex);
+  void resetSampleScores(SampleList &samples, int scCount);
+  void updateSampleScores(SampleList &samples, int scIndex, objed::Classifier *wc);
   float calculateError(SampleList &positiveSamples, SampleList &negativeSamples, objed::Classifier *classifier);
   int calculateErrorCount(SampleList &positiveSamples, SampleList &negativeSamples, objed::Classifier *classifier);
+  void printStageCost(const objed::Classifier *classifier, double falsePositiveRate);
 
 private:
-  void trainScRealAdaBoost(objed::Classifier *&classifier, SampleList &positiveSamples, SampleList &negativeSamples);
-  void trainScRealAdaBoostMax(objed::Classifier *&classifier, SampleList &positiveSamples, SampleList &negativeSamples);
+  QSharedPointer<objed::Classifier> realAdaBoost(const FeatureMatrix &featureMatrix, 
+    SampleList &positiveSamples, SampleList &negativeSamples, const QString &progressLabel);
+  void trainScRealAdaBoost(objed::Classifier *&classifier, const FeatureMatrix &featureMatrix, 
+    SampleList &positiveSamples, SampleList &negativeSamples);
+  void trainScRealAdaBoostMax(objed::Classifier *&classifier, const FeatureMatrix &featureMatrix, 
+    SampleList &positiveSamples, SampleList &negativeSamples);
 
 private:
   int classifierWidth;
@@ -74,7 +89,23 @@ private:
 
   double weightShift;
 
+  qint64 featureMatrixMemoryLimit;
+  QString featureMatrixPath;
+
+  double weightTrimming;
+  double wcSubsampleFraction;
+  quint32 wcSubsampleSeed;
+  int searchReportPeriod;
+  int boostingIteration;
+
   WcList wcList;
+  QSharedPointer<ShardedWcSearch> shardedSearch;
+
+  WcCostModel costModel;
+  QVector<double> wcCostList;
+  QStringList wcChannelList;
+  QStringList precedingChannelList;
+  QStringList stageChannelList;
 };
 
 #endif  // TRAINSCPROC_H_INCLUDED
@@ -0,0 +1,142 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <objedutils/objedconfig.h>
+#include <objedutils/objedexp.h>
+
+#include <objed/src/haar1stumpcl.h>
+#include <objed/src/haar2stumpcl.h>
+#include <objed/src/haar3stumpcl.h>
+#include <objed/src/haar1pwcl.h>
+#include <objed/src/haar2pwcl.h>
+#include <objed/src/haar3pwcl.h>
+
+#include "objedtrainutils.h"
+#include "wccost.h"
+
+WcCostModel::WcCostModel(ObjedConfig *config) : costPenalty(0.0), normalizationCost(0.0), newChannelCost(0.0)
+{
+  costPenalty = config->value("CostPenalty").toDouble();
+  normalizationCost = config->value("NormalizationCost").toDouble();
+  newChannelCost = config->value("ChannelCost").toDouble();
+  if (costPenalty < 0.0 || normalizationCost < 0.0 || newChannelCost < 0.0)
+    throw ObjedException("Invalid weak classifier cost model");
+
+  typeCostMap[QString::fromStdString(objed::Haar1StumpClassifier::typeStatic())] = 1.0;
+  typeCostMap[QString::fromStdString(objed::Haar2StumpClassifier::typeStatic())] = 2.0;
+  typeCostMap[QString::fromStdString(objed::Haar3StumpClassifier::typeStatic())] = 3.0;
+  typeCostMap[QString::fromStdString(objed::Haar1PwClassifier::typeStatic())] = 1.0;
+  typeCostMap[QString::fromStdString(objed::Haar2PwClassifier::typeStatic())] = 2.0;
+  typeCostMap[QString::fromStdString(objed::Haar3PwClassifier::typeStatic())] = 3.0;
+
+  // Overrides use weak classifier names of WcLineList (Haar2StumpWc stands for haar2StumpClassifier)
+  QVariantList wcCostList = config->listValue("WcCostList");
+  for (int i = 0; i < wcCostList.count(); i++)
+  {
+    QStringList itemList = wcCostList[i].toString().split(" ", QString::SkipEmptyParts);
+    bool ok = itemList.count() == 2;
+    double cost = ok == true ? itemList[1].toDouble(&ok) : 0.0;
+    if (ok == false || cost < 0.0 || itemList[0].endsWith("Wc") == false)
+      throw ObjedException(QString("Invalid weak classifier cost '%0'").arg(wcCostList[i].toString()));
+
+    QString type = itemList[0].left(itemList[0].length() - 2) + "Classifier";
+    type[0] = type[0].toLower();
+    if (typeCostMap.contains(type) == false)
+      throw ObjedException(QString("Unknown weak classifier '%0' in WcCostList").arg(itemList[0]));
+
+    typeCostMap[type] = cost;
+  }
+}
+
+WcCostModel::~WcCostModel()
+{
+  return;
+}
+
+double WcCostModel::wcCost(const objed::Classifier *wc) const
+{
+  Q_ASSERT(wc != 0);
+  return wcCost(wc->serialize());
+}
+
+double WcCostModel::wcCost(const Json::Value &data) const
+{
+  double cost = typeCostMap.value(QString::fromStdString(data["type"].asString()), 0.0);
+  if (data.isMember("normalize") == true && data["normalize"].asBool() == true)
+    cost += normalizationCost;
+  return cost;
+}
+
+double WcCostModel::collectCost(const Json::Value &data) const
+{
+  double cost = 0.0;
+  if (data.isObject() == true)
+  {
+    if (data.isMember("type") == true && typeCostMap.contains(QString::fromStdString(data["type"].asString())) == true)
+      return wcCost(data);
+
+    Json::Value::Members memberList = data.getMemberNames();
+    for (size_t i = 0; i < memberList.size(); i++)
+      cost += collectCost(data[memberList[i]]);
+  }
+  else if (data.isArray() == true)
+  {
+    for (Json::Value::UInt i = 0; i < data.size(); i++)
+      cost += collectCost(data[i]);
+  }
+
+  return cost;
+}
+
+double WcCostModel::classifierCost(const objed::Classifier *classifier, const QStringList &paidChannelList, 
+  double *wcPart, QStringList *newChannelList) const
+{
+  if (classifier == 0)
+    return 0.0;
+
+  // Every weak classifier of a stage is evaluated on each window the stage gets
+  double cost = collectCost(classifier->serialize());
+  if (wcPart != 0)
+    *wcPart = cost;
+
+  QStringList channelList = classifierPreprocs(classifier);
+  for (int i = 0; i < channelList.count(); i++)
+  {
+    if (paidChannelList.contains(channelList[i]) == true)
+      continue;
+
+    cost += newChannelCost;
+    if (newChannelList != 0)
+      newChannelList->append(channelList[i]);
+  }
+
+  return cost;
+}
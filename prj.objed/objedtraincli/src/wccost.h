@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef WCCOST_H_INCLUDED
+#define WCCOST_H_INCLUDED
+
+#include <QStringList>
+#include <QHash>
+
+#include <objed/objed.h>
+
+class ObjedConfig;
+
+// Evaluation cost of classifiers in rectangle sums per window. A weak classifier costs
+// its type cost (the rectangle count by default, WcCostList overrides it as lines like
+// "Haar3StumpWc 4") plus NormalizationCost if it normalizes. Each channel the classifier
+// reads and the preceding stages do not costs ChannelCost once, for computing the
+// preprocessed image and its integral
+class WcCostModel
+{
+public:
+  WcCostModel(ObjedConfig *config);
+  virtual ~WcCostModel();
+
+public:
+  inline bool isEnabled() const { return costPenalty > 0.0; }
+  inline double penalty() const { return costPenalty; }
+  inline double channelCost() const { return newChannelCost; }
+
+  double wcCost(const objed::Classifier *wc) const;
+  double classifierCost(const objed::Classifier *classifier, const QStringList &paidChannelList, 
+    double *wcPart = 0, QStringList *newChannelList = 0) const;
+
+private:
+  double wcCost(const Json::Value &data) const;
+  double collectCost(const Json::Value &data) const;
+
+private:
+  double costPenalty;
+  double normalizationCost;
+  double newChannelCost;
+  QHash<QString, double> typeCostMap;
+};
+
+#endif  // WCCOST_H_INCLUDED
@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QByteArray>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QThread>
+#include <QFile>
+
+#include <objedutils/objedexp.h>
+
+#include <objed/objedutils.h>
+
+#include "featurematrix.h"
+#include "wcsearch.h"
+
+const char * const ShardedWcSearch::WORKER_ARGUMENT = "--wc-search-worker";
+
+enum WorkerCommand
+{
+  WORKER_SETUP = 1,
+  WORKER_MATRIX = 2,
+  WORKER_SEARCH = 3,
+  WORKER_QUIT = 4
+};
+
+// Messages are framed by their size, bulk feature matrix rows follow WORKER_MATRIX unframed
+static bool sendMessage(QIODevice *device, const QByteArray &message)
+{
+  qint64 size = message.size();
+  return writeDevice(device, reinterpret_cast<const char *>(&size), sizeof(size)) && 
+    writeDevice(device, message.constData(), message.size());
+}
+
+static bool receiveMessage(QIODevice *device, QByteArray *message)
+{
+  qint64 size = 0;
+  if (readDevice(device, reinterpret_cast<char *>(&size), sizeof(size)) == false || size < 0)
+    return false;
+
+  message->resize(static_cast<int>(size));
+  return readDevice(device, message->data(), size);
+}
+
+ShardedWcSearch::ShardedWcSearch(int workerCount, int workerThreadCount, const QStringList &wcLineList, 
+  const QSize &size, int candidateCount)
+{
+  Q_ASSERT(workerCount > 0 && workerThreadCount >= 0);
+  workerCount = qMin(workerCount, qMax(1, candidateCount));
+
+  // Workers share the cores of the host instead of each running a thread per core
+  if (workerThreadCount == 0)
+    workerThreadCount = qMax(1, QThread::idealThreadCount() / workerCount);
+  QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+  environment.insert("OMP_NUM_THREADS", QString::number(workerThreadCount));
+
+  for (int i = 0; i <= workerCount; i++)
+    shardList.append(static_cast<int>(static_cast<qint64>(candidateCount) * i / workerCount));
+
+  for (int i = 0; i < workerCount; i++)
+  {
+    QProcess *worker = new QProcess();
+    workerList.append(worker);
+
+    worker->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    worker->setProcessEnvironment(environment);
+    worker->start(QCoreApplication::applicationFilePath(), QStringList() << WORKER_ARGUMENT);
+    if (worker->waitForStarted(-1) == false)
+      throw ObjedException("Cannot start weak classifier search worker");
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << qint32(WORKER_SETUP) << wcLineList << qint32(size.width()) << qint32(size.height()) << 
+      qint32(shardList[i]) << qint32(shardList[i + 1]);
+
+    if (sendMessage(worker, message) == false)
+      throw ObjedException("Cannot set up weak classifier search worker");
+  }
+}
+
+ShardedWcSearch::~ShardedWcSearch()
+{
+  QByteArray message;
+  QDataStream stream(&message, QIODevice::WriteOnly);
+  stream << qint32(WORKER_QUIT);
+
+  foreach (QProcess *worker, workerList)
+  {
+    sendMessage(worker, message);
+    worker->closeWriteChannel();
+    if (worker->waitForFinished() == false)
+      worker->kill();
+    delete worker;
+  }
+}
+
+void ShardedWcSearch::load(const FeatureMatrix &featureMatrix)
+{
+  Q_ASSERT(featureMatrix.candidateCount() == shardList.last());
+
+  QByteArray message;
+  QDataStream stream(&message, QIODevice::WriteOnly);
+  stream << qint32(WORKER_MATRIX) << qint32(featureMatrix.positiveCount()) << qint32(featureMatrix.negativeCount());
+
+  for (int i = 0; i < workerList.count(); i++)
+  {
+    if (sendMessage(workerList[i], message) == false || 
+        featureMatrix.write(workerList[i], shardList[i], shardList[i + 1]) == false)
+      throw ObjedException("Cannot send feature matrix to weak classifier search worker");
+  }
+}
+
+int ShardedWcSearch::search(const double *weights, int weightCount, double *bestZ, const double *penalties)
+{
+  for (int i = 0; i < workerList.count(); i++)
+  {
+    // Each worker gets the penalties of its own shard only
+    QVector<double> penaltyList;
+    if (penalties != 0)
+    {
+      for (int j = shardList[i]; j < shardList[i + 1]; j++)
+        penaltyList.append(penalties[j]);
+    }
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << qint32(WORKER_SEARCH) << qint32(weightCount) << penaltyList;
+    stream.writeRawData(reinterpret_cast<const char *>(weights), weightCount * sizeof(double));
+
+    if (sendMessage(workerList[i], message) == false)
+      throw ObjedException("Cannot send weights to weak classifier search worker");
+  }
+
+  // Shards are visited in candidate order and only a strictly smaller score replaces the
+  // current best, exactly as the in-process search scans its z list
+  int bestIndex = -1;
+  double bestScore = 0.0;
+  *bestZ = 1.0 + objed::epsilon;
+
+  for (int i = 0; i < workerList.count(); i++)
+  {
+    QByteArray reply;
+    if (receiveMessage(workerList[i], &reply) == false)
+      throw ObjedException("Weak classifier search worker does not respond");
+
+    QDataStream replyStream(reply);
+    qint32 index = -1;
+    double z = 0.0, score = 0.0;
+    replyStream >> index >> z >> score;
+
+    if (index >= 0 && (bestIndex < 0 || score < bestScore))
+    {
+      bestIndex = shardList[i] + index;
+      bestScore = score;
+      *bestZ = z;
+    }
+  }
+
+  return bestIndex;
+}
+
+int ShardedWcSearch::runWorker()
+{
+  QFile input, output;
+  if (input.open(0, QIODevice::ReadOnly | QIODevice::Unbuffered) == false)
+    return -1;
+  if (output.open(1, QIODevice::WriteOnly | QIODevice::Unbuffered) == false)
+    return -1;
+
+  WcList wcList;
+  FeatureMatrix featureMatrix;
+  QVector<double> weightList;
+
+  while (true)
+  {
+    QByteArray message;
+    if (receiveMessage(&input, &message) == false)
+      return -1;
+
+    QDataStream stream(message);
+    qint32 command = 0;
+    stream >> command;
+
+    if (command == WORKER_SETUP)
+    {
+      QStringList wcLineList;
+      qint32 width = 0, height = 0, first = 0, last = 0;
+      stream >> wcLineList >> width >> height >> first >> last;
+
+      // The same lines produce the same candidates in the same order as in the coordinator
+      WcList fullWcList;
+      for (int i = 0; i < wcLineList.count(); i++)
+        fullWcList.append(WcMaker::make(wcLineList[i], QSize(width, height)));
+      if (last > fullWcList.count())
+        return -1;
+
+      wcList = fullWcList.mid(first, last - first);
+    }
+    else if (command == WORKER_MATRIX)
+    {
+      qint32 posCount = 0, negCount = 0;
+      stream >> posCount >> negCount;
+      if (featureMatrix.read(&input, wcList.count(), posCount, negCount) == false)
+        return -1;
+    }
+    else if (command == WORKER_SEARCH)
+    {
+      qint32 weightCount = 0;
+      WcSearchSubset subset;
+      stream >> weightCount >> subset.penaltyList;
+
+      weightList.resize(weightCount);
+      stream.readRawData(reinterpret_cast<char *>(weightList.data()), weightList.count() * sizeof(double));
+      if (weightList.count() < featureMatrix.rowStride())
+        return -1;
+      if (subset.penaltyList.isEmpty() == false && subset.penaltyList.count() != wcList.count())
+        return -1;
+
+      double bestZ = 0.0;
+      qint32 bestIndex = searchBestWc(wcList, featureMatrix, weightList.constData(), &bestZ, QString(), &subset);
+      double bestScore = bestZ;
+      if (bestIndex >= 0 && subset.penaltyList.isEmpty() == false)
+        bestScore += subset.penaltyList[bestIndex];
+
+      QByteArray reply;
+      QDataStream replyStream(&reply, QIODevice::WriteOnly);
+      replyStream << bestIndex << bestZ << bestScore;
+      if (sendMessage(&output, reply) == false)
+        return -1;
+    }
+    else if (command == WORKER_QUIT)
+    {
+      return 0;
+    }
+    else
+    {
+      return -1;
+    }
+  }
+}
@@ -0,0 +1,98 @@
+/*
+Copyright (c) 2011-2013, Sergey Usilin. All rights reserved.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY COPYRIGHT HOLDERS "AS IS" AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of copyright holders.
+*/
+
+#pragma once
+#ifndef WCSEARCH_H_INCLUDED
+#define WCSEARCH_H_INCLUDED
+
+#include <QStringList>
+#include <QVector>
+#include <QSize>
+#include <QList>
+
+#include "objedtrainutils.h"
+
+class FeatureMatrix;
+class QProcess;
+
+// Restricts a search to part of wcList and part of the samples. Samples are given by their
+// feature matrix columns (positives first) and their own weights. Empty candidateList means
+// all candidates, empty columnList means all samples with the weights passed to the search.
+// penaltyList (one value per wcList candidate, empty if none) is added to z on selection
+struct WcSearchSubset
+{
+  WcSearchSubset() : positiveCount(0) {}
+
+  QVector<int> candidateList;
+  QVector<int> columnList;
+  QVector<double> weightList;
+  int positiveCount;
+  QVector<double> penaltyList;
+};
+
+// Trains every candidate of wcList on its feature matrix row and returns the index of the
+// first one with the minimal (penalized) z among those with z below 1.0 + epsilon, or -1.
+// bestZ gets its own z. Candidates keep the parameters trained for the current weights
+int searchBestWc(const WcList &wcList, const FeatureMatrix &featureMatrix, const double *weights, 
+  double *bestZ, const QString &progressLabel = QString(), const WcSearchSubset *subset = 0);
+
+// Trains one candidate on its feature matrix row and returns its z
+double trainWc(objed::Classifier *wc, const FeatureMatrix &featureMatrix, int row, 
+  const double *weights, const WcSearchSubset *subset = 0);
+
+// Splits wcList into contiguous shards searched by worker processes running on the
+// same host (objedtraincli started with WORKER_ARGUMENT), talking over their stdin and
+// stdout. Shard results are combined in candidate order, so the selected weak
+// classifier is the same as for an in-process search. Every worker runs workerThreadCount
+// OpenMP threads, or its share of the host cores if it is 0
+class ShardedWcSearch
+{
+  Q_DISABLE_COPY(ShardedWcSearch)
+
+public:
+  ShardedWcSearch(int workerCount, int workerThreadCount, const QStringList &wcLineList, 
+    const QSize &size, int candidateCount);
+  virtual ~ShardedWcSearch();
+
+public:
+  void load(const FeatureMatrix &featureMatrix);
+  int search(const double *weights, int weightCount, double *bestZ, const double *penalties = 0);
+
+public:
+  static const char * const WORKER_ARGUMENT;
+  static int runWorker();
+
+private:
+  QList<QProcess *> workerList;
+  QList<int> shardList;
+};
+
+#endif  // WCSEARCH_H_INCLUDED
@@ -39,6 +39,7 @@ namespace objed
 {
   class Classifier;
   class Detector;
+  class DetectionContext;
 }
 
 struct ObjedOpenMP
@@ -49,6 +50,12 @@ struct ObjedOpenMP
   typedef QVector<QSharedPointer<objed::Classifier> > ClassifierList;
   static ClassifierList multiplyClassifier(const objed::Classifier *classifier);
 
+  // One context per thread, all of them detecting with the same detector
+  typedef QVector<QSharedPointer<objed::DetectionContext> > ContextList;
+  static ContextList createContexts(const objed::Detector *detector);
+
+  // Deprecated, use createContexts: the detectors share the given one, which must outlive them,
+  // and each of them detects in a context of its own
   typedef QVector<QSharedPointer<objed::Detector> > DetectorList;
   static DetectorList multiplyDetector(const objed::Detector *detector);
 };
@@ -34,6 +34,7 @@ either expressed or implied, of copyright holders.
 #include <objedutils/objedio.h>
 
 #include <objed/objed.h>
+#include <objed/src/binarycl.h>
 
 QSharedPointer<objed::Classifier> ObjedIO::loadClassifier(const QString &classifierPath)
 {
@@ -52,6 +53,17 @@ void ObjedIO::saveClassifier(const objed::Classifier *classifier, const QString
   if (classifierPath.isEmpty() == true)
     throw ObjedException(QString("Invalid classifier path to save"));
 
+  if (QFileInfo(classifierPath).suffix().toLower() == "objedb")
+  {
+    if (objed::BinaryClassifier::write(classifier, classifierPath.toStdString()) == false)
+    {
+      QString classifierName = QFileInfo(classifierPath).fileName();
+      throw ObjedException(QString("Cannot save classifier %0 in binary format").arg(classifierName));
+    }
+
+    return;
+  }
+
   Json::StyledWriter dataWriter;
   Json::Value data = classifier->serialize();
   std::string strData = dataWriter.write(data);
@@ -38,6 +38,49 @@ either expressed or implied, of copyright holders.
 #include <omp.h>
 #endif  // _OPENMP
 
+// Detector of multiplyDetector(): the shared detector bound to one of the contexts of createContexts()
+class ContextDetector : public objed::Detector
+{
+public:
+  ContextDetector(const objed::Detector *detector, const QSharedPointer<objed::DetectionContext> &context) : 
+    detector(detector), context(context) {};
+
+public:
+  virtual objed::DetectionList detect(IplImage *image, objed::DebugInfo *debugInfo)
+  {
+    return detector->detectInContext(context.data(), image, debugInfo);
+  }
+
+  virtual objed::DetectionCoverage coverage(const objed::DetectionContext *context) const
+  {
+    return detector->coverage(context != 0 ? context : this->context.data());
+  }
+
+  virtual std::string type() const
+  {
+    return detector->type();
+  }
+
+  virtual objed::Detector * clone() const
+  {
+    return detector->clone();
+  }
+
+  virtual void setImagePool(objed::ImagePool *extImagePool)
+  {
+    context = QSharedPointer<objed::DetectionContext>(
+      detector->createContext(extImagePool), objed::DetectionContext::destroy);
+  }
+
+  virtual void resetImagePool()
+  {
+    setImagePool(0);
+  }
+
+private:
+  const objed::Detector *detector;
+  QSharedPointer<objed::DetectionContext> context;
+};
 
 int ObjedOpenMP::maxThreadCount()
 {
@@ -70,13 +113,25 @@ ObjedOpenMP::ClassifierList ObjedOpenMP::multiplyClassifier(const objed::Classif
   return classifierList;
 }
 
+ObjedOpenMP::ContextList ObjedOpenMP::createContexts(const objed::Detector *detector)
+{
+  ContextList contextList;
+
+  for (int i = 0; i < maxThreadCount(); i++)
+    contextList.append(QSharedPointer<objed::DetectionContext>(
+      detector->createContext(), objed::DetectionContext::destroy));
+
+  return contextList;
+}
+
 ObjedOpenMP::DetectorList ObjedOpenMP::multiplyDetector(const objed::Detector *detector)
 {
+  ContextList contextList = createContexts(detector);
   DetectorList detectorList;
 
-  for (int i = 0; i < maxThreadCount(); i++)
+  for (int i = 0; i < contextList.size(); i++)
     detectorList.append(QSharedPointer<objed::Detector>(
-    detector->clone(), objed::Detector::destroy));
+      new ContextDetector(detector, contextList[i]), objed::Detector::destroy));
 
   return detectorList;
 }